@@ -0,0 +1,34 @@
+#version 460
+
+layout (location = 0) out vec4 lineColor;
+
+layout (binding = 0) uniform UBO {
+	mat4 inMtx;
+	float time;
+} ubo;
+
+struct BoxInstance
+{
+	mat4 model;
+	vec4 color;
+};
+
+layout (binding = 2) readonly buffer Boxes { BoxInstance data[]; } boxes;
+
+// Corner bits: 4 -> -x, 2 -> -y, 1 -> -z. Two corners per edge
+const int edges[24] = int[24](
+	0, 1,  2, 3,  4, 5,  6, 7,
+	0, 2,  1, 3,  4, 6,  5, 7,
+	0, 4,  1, 5,  2, 6,  3, 7
+);
+
+void main()
+{
+	BoxInstance box = boxes.data[gl_InstanceIndex];
+
+	const int c = edges[gl_VertexIndex];
+	const vec3 p = vec3((c & 4) != 0 ? -1.0 : 1.0, (c & 2) != 0 ? -1.0 : 1.0, (c & 1) != 0 ? -1.0 : 1.0);
+
+	gl_Position = ubo.inMtx * box.model * vec4(p, 1.0);
+	lineColor = box.color;
+}
@@ -0,0 +1,11 @@
+#version 460
+
+// Overdraw view of the scene renderers: every shaded fragment adds a constant (additive blending into a black target).
+// 1 layer is dark red, 8 layers saturate red, 16 layers are yellow. With the depth prepass each pixel is shaded once
+
+layout (location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = vec4(1.0 / 8.0, 1.0 / 16.0, 0.0, 1.0);
+}
@@ -0,0 +1,71 @@
+#version 460
+
+// Screen-space ambient occlusion with a per-frame rotation and a per-frame subset of the kernel:
+// over several frames the accumulation in SSAOAccumulate.comp sees every offset with many rotations
+
+layout (location = 0) in vec2 uv;
+layout (location = 0) out vec4 outColor;
+
+layout (binding = 0) uniform SSAOParams
+{
+	float scale;
+	float bias;
+	float zNear;
+	float zFar;
+	float radius;
+	float attScale;
+	float distScale;
+	uint frameIndex;
+	uint samplesPerFrame;
+} params;
+
+layout (binding = 1) uniform sampler2D texDepth;
+layout (binding = 2) uniform sampler2D texRotation;
+
+const int kKernelSize = 16;
+
+const vec3 offsets[kKernelSize] = vec3[kKernelSize](
+	vec3(-0.5, -0.5, -0.5), vec3( 0.5, -0.5, -0.5), vec3(-0.5,  0.5, -0.5), vec3( 0.5,  0.5, -0.5),
+	vec3(-0.5, -0.5,  0.5), vec3( 0.5, -0.5,  0.5), vec3(-0.5,  0.5,  0.5), vec3( 0.5,  0.5,  0.5),
+	vec3(-0.7,  0.0,  0.2), vec3( 0.7,  0.0, -0.2), vec3( 0.0, -0.7, -0.2), vec3( 0.0,  0.7,  0.2),
+	vec3(-0.3, -0.3,  0.8), vec3( 0.3,  0.3, -0.8), vec3( 0.3, -0.3,  0.8), vec3(-0.3,  0.3, -0.8)
+);
+
+float linearDepth(float d)
+{
+	return params.zNear * params.zFar / (params.zFar - d * (params.zFar - params.zNear));
+}
+
+void main()
+{
+	const vec2 size = vec2(textureSize(texDepth, 0));
+	const float Z = linearDepth(textureLod(texDepth, uv, 0.0).r);
+
+	// Shift the rotation pattern and spin it by the golden angle every frame
+	const ivec2 rotSize = textureSize(texRotation, 0);
+	const ivec2 frameOffset = ivec2(params.frameIndex * 3u, params.frameIndex * 7u);
+	const vec3 rotation = texelFetch(texRotation, (ivec2(uv * size) + frameOffset) % rotSize, 0).xyz * 2.0 - vec3(1.0);
+	const float angle = float(params.frameIndex) * 2.3999632;
+	const vec2 cs = vec2(cos(angle), sin(angle));
+	const vec3 plane = normalize(vec3(rotation.x * cs.x - rotation.y * cs.y, rotation.x * cs.y + rotation.y * cs.x, rotation.z));
+
+	const uint numSamples = clamp(params.samplesPerFrame, 1u, uint(kKernelSize));
+	const uint first = (params.frameIndex * numSamples) % uint(kKernelSize);
+
+	float att = 0.0;
+
+	for (uint i = 0; i != numSamples; i++)
+	{
+		const vec3 rSample = reflect(offsets[(first + i) % uint(kKernelSize)], plane);
+		const float zSample = linearDepth(textureLod(texDepth, uv + params.radius * rSample.xy / Z, 0.0).r);
+		const float dist = max(Z - zSample, 0.0) / params.distScale;
+		const float occl = 15.0 * max(dist * (2.0 - dist), 0.0);
+		att += 1.0 / (1.0 + occl * occl);
+	}
+
+	// The same response as the 8-sample VK02_SSAO.frag, normalized by the number of samples
+	att /= float(numSamples);
+	att = clamp(att * att + 0.45, 0.0, 1.0) * params.attScale;
+
+	outColor = vec4(vec3(att), 1.0);
+}
@@ -0,0 +1,91 @@
+// Offline SPIR-V cache builder: compiles every shader in a folder so that applications start with a warm cache
+//
+// Usage: jc3DShaderPrecompiler <shaderFolder> [-o cacheFolder] [-DNAME[=VALUE] ...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <jc3DTestSharedLibs/Utils.h>
+#include <jc3DTestSharedLibs/UtilsVulkan.h>
+#include <jc3DTestSharedLibs/UtilsSPIRVCache.h>
+
+static bool isShaderFile(const std::string& fileName)
+{
+	static const char* kExtensions[] = { ".vert", ".frag", ".geom", ".comp", ".tesc", ".tese" };
+
+	for (const char* ext: kExtensions)
+		if (endsWith(fileName.c_str(), ext))
+			return true;
+
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <shaderFolder> [-o cacheFolder] [-DNAME[=VALUE] ...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char* shaderFolder = argv[1];
+	std::vector<std::string> defines;
+
+	for (int i = 2; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			setSPIRVCacheFolder(argv[++i]);
+		else if (!strncmp(argv[i], "-D", 2) && argv[i][2])
+			defines.push_back(argv[i] + 2);
+		else
+		{
+			printf("Unknown argument: %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!std::filesystem::is_directory(shaderFolder))
+	{
+		printf("Cannot open shader folder '%s'\n", shaderFolder);
+		return EXIT_FAILURE;
+	}
+
+	glslang_initialize_process();
+
+	int numCompiled = 0;
+	int numFailed = 0;
+
+	for (const auto& entry: std::filesystem::recursive_directory_iterator(shaderFolder))
+	{
+		if (!entry.is_regular_file())
+			continue;
+
+		const std::string fileName = entry.path().generic_string();
+
+		if (!isShaderFile(fileName))
+			continue;
+
+		ShaderModule shaderModule;
+
+		if (compileShaderFile(fileName.c_str(), shaderModule, defines) > 0)
+		{
+			printf("OK      %s\n", fileName.c_str());
+			numCompiled++;
+		}
+		else
+		{
+			printf("FAILED  %s\n", fileName.c_str());
+			numFailed++;
+		}
+	}
+
+	glslang_finalize_process();
+
+	printf("\n%d shader(s) cached in %s, %d failed\n", numCompiled, getSPIRVCacheFolder().c_str(), numFailed);
+
+	return numFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
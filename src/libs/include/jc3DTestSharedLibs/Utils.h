@@ -14,8 +14,22 @@ int endsWith(const char* s, const char* part);
 
 std::string readShaderFile(const char* fileName);
 
+/* Expands #include <...> and #include "..." (paths are relative to the working directory). Each file is included once,
+   circular includes are reported as errors. #line directives use the index in 'dependencies' as the source string number.
+   'dependencies' receives the main file followed by all included files. */
+std::string readShaderFile(const char* fileName, std::vector<std::string>* dependencies);
+
+/* Drop memoized shader sources (modified files are reloaded automatically, this also frees the memory) */
+void clearShaderFileCache();
+
 void printShaderSource(const char* text);
 
+// Boost-style hash mixing for composite cache keys and signatures
+inline size_t hashCombine(size_t seed, size_t value)
+{
+	return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
 template <typename T>
 inline void mergeVectors(std::vector<T>& v1, const std::vector<T>& v2)
 {
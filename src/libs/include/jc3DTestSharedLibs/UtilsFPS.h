@@ -1,8 +1,12 @@
 ﻿#pragma once
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 
+#include <chrono>
+#include <thread>
+
 class FramesPerSecondCounter
 {
 public:
@@ -12,20 +16,40 @@ public:
 		assert(avgInterval > 0.0f);
 	}
 
-	bool tick(float deltaSeconds, bool frameRendered = true)
+	/* inputLatencySeconds: time from sampling the input to the presentation of the frame (see FrameLimiter), zero if unknown */
+	bool tick(float deltaSeconds, bool frameRendered = true, float inputLatencySeconds = 0.0f)
 	{
 		if (frameRendered)
+		{
 			numFrames_++;
+			frameTimeSum_ += deltaSeconds;
+			frameTimeSumSq_ += (double)deltaSeconds * deltaSeconds;
+			inputLatencySum_ += inputLatencySeconds;
+		}
 
 		accumulatedTime_ += deltaSeconds;
 
 		if (accumulatedTime_ > avgInterval_)
 		{
 			currentFPS_ = static_cast<float>(numFrames_ / accumulatedTime_);
+
+			if (numFrames_ > 0)
+			{
+				const double mean = frameTimeSum_ / numFrames_;
+				const double variance = frameTimeSumSq_ / numFrames_ - mean * mean;
+				frameTimeMs_ = static_cast<float>(mean * 1000.0);
+				frameTimeStdDevMs_ = static_cast<float>(sqrt(variance > 0.0 ? variance : 0.0) * 1000.0);
+				inputLatencyMs_ = static_cast<float>(inputLatencySum_ / numFrames_ * 1000.0);
+			}
+
 			if (printFPS_)
-				printf("FPS: %.1f\n", currentFPS_);
+				printf("FPS: %.1f (frame %.2f ms, stddev %.2f ms, input-to-present %.2f ms)\n", currentFPS_, frameTimeMs_, frameTimeStdDevMs_, inputLatencyMs_);
+
 			numFrames_ = 0;
 			accumulatedTime_ = 0;
+			frameTimeSum_ = 0;
+			frameTimeSumSq_ = 0;
+			inputLatencySum_ = 0;
 			return true;
 		}
 
@@ -34,6 +58,11 @@ public:
 
 	inline float getFPS() const { return currentFPS_; }
 
+	// Frame pacing over the last averaging interval
+	inline float getFrameTimeMs() const { return frameTimeMs_; }
+	inline float getFrameTimeStdDevMs() const { return frameTimeStdDevMs_; }
+	inline float getInputLatencyMs() const { return inputLatencyMs_; }
+
 	bool printFPS_ = true;
 
 private:
@@ -41,4 +70,82 @@ private:
 	unsigned int numFrames_ = 0;
 	double accumulatedTime_ = 0;
 	float currentFPS_ = 0.0f;
+
+	double frameTimeSum_ = 0;
+	double frameTimeSumSq_ = 0;
+	double inputLatencySum_ = 0;
+
+	float frameTimeMs_ = 0.0f;
+	float frameTimeStdDevMs_ = 0.0f;
+	float inputLatencyMs_ = 0.0f;
+};
+
+/**
+	CPU frame limiter which waits just in time: the sleep happens *before* the input is sampled, and the wake-up
+	time is the frame deadline minus the predicted CPU cost of the frame (an exponential moving average).
+	Compared to sleeping after the present this removes up to a whole frame of input latency.
+*/
+class FrameLimiter
+{
+public:
+	/* Zero or negative disables the limiter */
+	inline void setTargetFPS(float fps) { targetFrameSeconds_ = (fps > 0.0f) ? 1.0 / fps : 0.0; }
+	inline float getTargetFPS() const { return (targetFrameSeconds_ > 0.0) ? static_cast<float>(1.0 / targetFrameSeconds_) : 0.0f; }
+
+	/* Call right before polling input */
+	void beginFrame()
+	{
+		if (targetFrameSeconds_ > 0.0 && hasPreviousFrame_)
+		{
+			const Clock::time_point deadline = lastFrameEnd_ + toDuration(targetFrameSeconds_);
+			sleepUntil(deadline - toDuration(predictedWorkSeconds_ + kSafetyMarginSeconds));
+		}
+
+		frameStart_ = Clock::now();
+	}
+
+	/* Call right after drawFrame(): it returns after vkQueuePresentKHR() and a vkDeviceWaitIdle(), so the frame is complete */
+	void endFrame()
+	{
+		lastFrameEnd_ = Clock::now();
+
+		const double work = std::chrono::duration<double>(lastFrameEnd_ - frameStart_).count();
+		predictedWorkSeconds_ = hasPreviousFrame_ ? predictedWorkSeconds_ + kSmoothing * (work - predictedWorkSeconds_) : work;
+		inputLatencySeconds_ = work;
+		hasPreviousFrame_ = true;
+	}
+
+	/* From the input sampling in beginFrame() to the present in endFrame(), including the CPU and the GPU work of the frame.
+	   The time the presentation engine holds the image (compositor, scan-out) is not visible here */
+	inline float getInputLatencySeconds() const { return static_cast<float>(inputLatencySeconds_); }
+	inline float getPredictedWorkSeconds() const { return static_cast<float>(predictedWorkSeconds_); }
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr double kSmoothing = 0.1;
+	static constexpr double kSafetyMarginSeconds = 0.0005;
+
+	static Clock::duration toDuration(double seconds) {
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+	}
+
+	// OS sleeps are coarse, so sleep until ~1 ms before the wake-up time and yield for the rest
+	static void sleepUntil(Clock::time_point t)
+	{
+		const auto coarse = t - std::chrono::milliseconds(1);
+		if (Clock::now() < coarse)
+			std::this_thread::sleep_until(coarse);
+
+		while (Clock::now() < t)
+			std::this_thread::yield();
+	}
+
+	double targetFrameSeconds_ = 0.0;
+	double predictedWorkSeconds_ = 0.0;
+	double inputLatencySeconds_ = 0.0;
+	bool hasPreviousFrame_ = false;
+
+	Clock::time_point frameStart_;
+	Clock::time_point lastFrameEnd_;
 };
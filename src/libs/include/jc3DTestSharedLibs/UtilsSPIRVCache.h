@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+	Content-addressed on-disk cache for compiled SPIR-V.
+
+	The key covers everything that affects the compiler output: the preprocessed source (after include expansion),
+	the shader stage, the list of defines and the glslang version. Stale entries are never hit, so the cache needs no invalidation.
+*/
+
+constexpr const char* kDefaultSPIRVCacheFolder = ".cache/spirv/";
+
+void setSPIRVCacheFolder(const char* folder);
+const std::string& getSPIRVCacheFolder();
+
+// Globally enable/disable cache lookups (e.g., for shader hot-reloading experiments)
+void setSPIRVCacheEnabled(bool enabled);
+bool isSPIRVCacheEnabled();
+
+uint64_t getSPIRVCacheKey(const std::string& preprocessedSource, uint32_t stage, const std::vector<std::string>& defines);
+
+bool loadSPIRVFromCache(uint64_t key, std::vector<unsigned int>& SPIRV);
+bool saveSPIRVToCache(uint64_t key, const std::vector<unsigned int>& SPIRV);
+
+// "NAME" -> "#define NAME", "NAME=VALUE" -> "#define NAME VALUE"; inserted right after the #version directive
+std::string insertShaderDefines(const std::string& source, const std::vector<std::string>& defines);
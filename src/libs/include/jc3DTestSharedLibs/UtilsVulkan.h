@@ -2,6 +2,7 @@
 
 #include <array>
 #include <functional>
+#include <string>
 #include <vector>
 
 #define VK_NO_PROTOTYPES
@@ -57,6 +58,39 @@ struct VulkanRenderDevice final
 
 	VkCommandBuffer computeCommandBuffer;
 	VkCommandPool computeCommandPool;
+
+	// VK_KHR_timeline_semaphore is enabled (see createDevice2WithCompute())
+	bool timelineSemaphores = false;
+
+	// Extra waits of the next graphics submission in drawFrame(), e.g. async compute results (see ComputedItem::waitInFrame()), cleared after it.
+	// The values are only used for timeline semaphores
+	std::vector<VkSemaphore> frameWaitSemaphores;
+	std::vector<uint64_t> frameWaitValues;
+	std::vector<VkPipelineStageFlags> frameWaitStages;
+
+	// Process-wide pipeline cache: loaded at device creation, saved in destroyVulkanRenderDevice()
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	// Startup statistics to compare cold and warm pipeline cache runs
+	bool pipelineCacheWarm = false;
+	uint32_t pipelinesCreated = 0;
+	double pipelineCreationMs = 0.0;
+
+	// Swapchain images can be copied from (VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+	bool supportScreenshots = false;
+
+	// Requested swapchain parameters (zero image count means minImageCount + 1) and the present mode actually used
+	VkPresentModeKHR requestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	uint32_t requestedImageCount = 0;
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+	// Set by drawFrame() on VK_ERROR_OUT_OF_DATE_KHR/VK_SUBOPTIMAL_KHR (or by the app to apply a new present mode), cleared by recreateSwapchain()
+	bool swapchainOutOfDate = false;
+
+	// Offscreen mode without a surface: swapchainImages are plain device images which are rendered in turn
+	bool headless = false;
+	uint32_t headlessImageIndex = 0;
+	std::vector<VkDeviceMemory> headlessImageMemory;
 };
 
 // Features we need for our Vulkan context
@@ -69,6 +103,17 @@ struct VulkanContextFeatures
 
 	bool vertexPipelineStoresAndAtomics_ = false;
 	bool fragmentStoresAndAtomics_ = false;
+
+	// FIFO is vsync, MAILBOX replaces queued frames (low latency without tearing), IMMEDIATE may tear.
+	// Unsupported modes fall back to FIFO
+	VkPresentModeKHR presentMode_ = VK_PRESENT_MODE_MAILBOX_KHR;
+	// Zero means minImageCount + 1, clamped to the surface limits
+	uint32_t swapchainImageCount_ = 0;
+
+	// No window and no surface, frames go to a ring of offscreen images (CI, benchmarks, software rasterizers like lavapipe)
+	bool headless_ = false;
+	// Frames rendered by a headless VulkanApp::mainLoop(), zero means until VulkanApp::requestExit()
+	uint32_t headlessFrameCount_ = 0;
 };
 
 /* To avoid breaking chapter 1-6 samples, we introduce a class which differs from VulkanInstance in that it has a ctor & dtor */
@@ -132,9 +177,10 @@ void CHECK(bool check, const char* fileName, int lineNumber);
 
 bool setupDebugCallbacks(VkInstance instance, VkDebugUtilsMessengerEXT* messenger, VkDebugReportCallbackEXT* reportCallback);
 
-VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* fileName);
+VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* fileName, const std::vector<std::string>& defines = {});
 
-size_t compileShaderFile(const char* file, ShaderModule& shaderModule);
+/* Compiled binaries are looked up in (and added to) the SPIR-V disk cache, see UtilsSPIRVCache.h */
+size_t compileShaderFile(const char* file, ShaderModule& shaderModule, const std::vector<std::string>& defines = {});
 
 inline VkPipelineShaderStageCreateInfo shaderStageInfo(VkShaderStageFlagBits shaderStage, ShaderModule& module, const char* entryPoint)
 {
@@ -177,29 +223,51 @@ inline VkWriteDescriptorSet imageWriteDescriptorSet(VkDescriptorSet ds, const Vk
 	};
 }
 
-void createInstance(VkInstance* instance);
+/* A headless instance has no surface extensions and only enables the validation layer if it is installed */
+void createInstance(VkInstance* instance, bool headless = false);
 
 VkResult createDevice(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures deviceFeatures, uint32_t graphicsFamily, VkDevice* device);
 
-VkResult createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t graphicsFamily, uint32_t width, uint32_t height, VkSwapchainKHR* swapchain, bool supportScreenshots = false);
+VkResult createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t graphicsFamily, uint32_t width, uint32_t height, VkSwapchainKHR* swapchain, bool supportScreenshots = false,
+	VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR, uint32_t desiredImageCount = 0, VkPresentModeKHR* outPresentMode = nullptr,
+	VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
 
 size_t createSwapchainImages(VkDevice device, VkSwapchainKHR swapchain, std::vector<VkImage>& swapchainImages, std::vector<VkImageView>& swapchainImageViews);
 
+constexpr uint32_t kHeadlessImageCount = 3;
+
+/* Offscreen replacement of the swapchain images; they are left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL after every frame */
+size_t createHeadlessSwapchainImages(VulkanRenderDevice& vkDev, uint32_t width, uint32_t height, uint32_t imageCount);
+
+/* Replace the swapchain (or the headless images) with one of the new size and the current requestedPresentMode, keeping the device.
+   Waits for the device to become idle. The size is clamped to the surface limits, framebufferWidth/Height receive the actual size.
+   The number of images must not change, as everything allocated per swapchain image would have to be rebuilt */
+void recreateSwapchain(VulkanInstance& vk, VulkanRenderDevice& vkDev, uint32_t width, uint32_t height);
+
 VkResult createSemaphore(VkDevice device, VkSemaphore* outSemaphore);
 
-bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+/* Only mip level 0 is sampled unless maxLod is raised */
+bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT, float maxLod = 0.0f);
 
 bool createDescriptorPool(VulkanRenderDevice& vkDev, uint32_t uniformBufferCount, uint32_t storageBufferCount, uint32_t samplerCount, VkDescriptorPool* descriptorPool);
 
 bool isDeviceSuitable(VkPhysicalDevice device);
+/* Also accepts CPU and virtual devices */
+bool isDeviceSuitableHeadless(VkPhysicalDevice device);
+
+/* The device exposes VK_KHR_timeline_semaphore with the timelineSemaphore feature */
+bool isTimelineSemaphoreSupported(VkPhysicalDevice device);
+
+/* Compute shaders may use the basic and arithmetic subgroup operations (GL_KHR_shader_subgroup_arithmetic) */
+bool isSubgroupArithmeticSupported(VkPhysicalDevice device);
 
 SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
 
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, VkPresentModeKHR preferredMode = VK_PRESENT_MODE_MAILBOX_KHR);
 
-uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities);
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities, uint32_t desiredImageCount = 0);
 
 VkResult findSuitablePhysicalDevice(VkInstance instance, std::function<bool(VkPhysicalDevice)> selector, VkPhysicalDevice* physicalDevice);
 
@@ -224,9 +292,28 @@ bool createGraphicsPipeline(
 	bool dynamicScissorState = false,
 	int32_t customWidth  = -1,
 	int32_t customHeight = -1,
-	uint32_t numPatchControlPoints = 0);
+	uint32_t numPatchControlPoints = 0,
+	/* Depth prepass support: LESS_OR_EQUAL without depth writes for the main pass, no color writes for the prepass itself */
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS,
+	bool depthWrite = true,
+	bool colorWrite = true,
+	/* src + dst, for overdraw visualisation */
+	bool additiveBlending = false);
 
 VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline);
+/* Same as above, but goes through vkDev.pipelineCache and updates creation statistics */
+VkResult createComputePipeline(VulkanRenderDevice& vkDev, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline,
+	const VkSpecializationInfo* specializationInfo = nullptr);
+
+VkResult createGraphicsPipelineWithCache(VulkanRenderDevice& vkDev, const VkGraphicsPipelineCreateInfo& pipelineInfo, VkPipeline* pipeline);
+
+/* Pipeline cache persistence. Cached data is discarded if vendor, device or pipeline cache UUID do not match */
+constexpr const char* kPipelineCacheFileName = ".cache/pipeline_cache.bin";
+
+bool createPipelineCache(VulkanRenderDevice& vkDev, const char* fileName = kPipelineCacheFileName);
+bool savePipelineCache(const VulkanRenderDevice& vkDev, const char* fileName = kPipelineCacheFileName);
+// Takes the same lock as the pipeline creation, pipelines may still be created on worker threads
+void printPipelineCacheStats(const VulkanRenderDevice& vkDev);
 
 bool createSharedBuffer(VulkanRenderDevice& vkDev, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 
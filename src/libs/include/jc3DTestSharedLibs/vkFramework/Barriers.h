@@ -18,6 +18,8 @@ struct ShaderOptimalToColorBarrier : public Renderer
 		tex_(tex)
 	{}
 
+	bool isStatic() const override { return true; }
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
 		transitionImageLayoutCmd(cmdBuffer, tex_.image.image, tex_.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -34,6 +36,8 @@ struct ShaderOptimalToDepthBarrier : public Renderer
 		tex_(tex)
 	{}
 
+	bool isStatic() const override { return true; }
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
 		transitionImageLayoutCmd(cmdBuffer, tex_.image.image, tex_.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
@@ -50,6 +54,8 @@ struct ColorToShaderOptimalBarrier : public Renderer
 		tex_(tex)
 	{}
 
+	bool isStatic() const override { return true; }
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
 		transitionImageLayoutCmd(cmdBuffer, tex_.image.image, tex_.format, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -66,6 +72,8 @@ struct ColorWaitBarrier : public Renderer
 		tex_(tex)
 	{}
 
+	bool isStatic() const override { return true; }
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
 		transitionImageLayoutCmd(cmdBuffer, tex_.image.image, tex_.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -82,6 +90,8 @@ struct DepthToShaderOptimalBarrier : public Renderer
 		tex_(tex)
 	{}
 
+	bool isStatic() const override { return true; }
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
 	{
 		transitionImageLayoutCmd(cmdBuffer, tex_.image.image, tex_.format, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -102,6 +112,8 @@ struct ImageBarrier : public Renderer
 		image_(image)
 	{}
 
+	bool isStatic() const override { return true; }
+
 	virtual void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE)
 	{
 		VkImageMemoryBarrier barrier = {
@@ -10,7 +10,7 @@ struct CompositeRenderer: public Renderer
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb1 = VK_NULL_HANDLE, VkRenderPass rp1 = VK_NULL_HANDLE) override
 	{
 		for (auto& r: renderers_)
-		if (r.enabled_)
+		if (r.isActive())
 		{
 			VkRenderPass rp = rp1;
 			VkFramebuffer fb = fb1;
@@ -26,8 +26,34 @@ struct CompositeRenderer: public Renderer
 
 	void updateBuffers(size_t currentImage) override
 	{
+		cullRenderItems(renderers_);
+
 		for (auto& r: renderers_)
-			r.renderer_.updateBuffers(currentImage);
+			if (r.isActive())
+				r.renderer_.updateBuffers(currentImage);
+	}
+
+	bool isStatic() const override
+	{
+		for (const auto& r: renderers_)
+			if (r.isActive() && !r.renderer_.isStatic())
+				return false;
+
+		return true;
+	}
+
+	size_t commandSignature() const override
+	{
+		size_t signature = Renderer::commandSignature();
+
+		for (const auto& r: renderers_)
+		{
+			signature = hashCombine(signature, r.isActive() ? 1 : 0);
+			if (r.isActive())
+				signature = hashCombine(signature, r.renderer_.commandSignature());
+		}
+
+		return signature;
 	}
 
 protected:
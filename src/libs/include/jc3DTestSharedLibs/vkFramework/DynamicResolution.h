@@ -0,0 +1,165 @@
+#pragma once
+
+#include <jc3DTestSharedLibs/vkFramework/VulkanShaderProcessor.h>
+
+#include <algorithm>
+#include <cmath>
+
+struct DynamicResolutionParams
+{
+	float targetFrameMs = 16.0f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	// The scale moves in steps, so renderers with dynamic viewports are only re-recorded now and then
+	float step = 0.05f;
+	// No change while the frame time stays within this fraction of the target
+	float tolerance = 0.1f;
+	// Frames to wait after a change until the timings reflect the new scale
+	uint32_t settleFrames = 8;
+};
+
+/**
+	Keeps the GPU frame time near a target by changing the render scale of the context (see VulkanRenderContext::setRenderScale()).
+	The scene renderers set Renderer::dynamicViewport_, their targets keep the full size and an UpscaleProcessor
+	brings the rendered part back to the output resolution. Call update() once per frame
+*/
+struct DynamicResolution
+{
+	explicit DynamicResolution(VulkanRenderContext& ctx, const DynamicResolutionParams& params = {})
+	: ctx_(ctx)
+	, params_(params)
+	{
+		ctx_.enableGpuFrameTimer();
+	}
+
+	void update()
+	{
+		const float frameMs = ctx_.getGpuFrameTimeMs();
+
+		if (frameMs <= 0.0f)
+			return;
+
+		// Load spikes come through within a few frames
+		smoothedMs_ = (smoothedMs_ > 0.0f) ? smoothedMs_ + (frameMs - smoothedMs_) * 0.25f : frameMs;
+
+		if (settle_ > 0)
+		{
+			settle_--;
+			return;
+		}
+
+		const float ratio = params_.targetFrameMs / smoothedMs_;
+
+		if (std::abs(ratio - 1.0f) <= params_.tolerance)
+			return;
+
+		// The cost of most passes is proportional to the number of pixels, i.e. to the square of the scale
+		const float scale = ctx_.getRenderScale();
+		const float ideal = std::clamp(scale * std::sqrt(ratio), params_.minScale, params_.maxScale);
+		const float newScale = std::clamp(std::round(ideal / params_.step) * params_.step, params_.minScale, params_.maxScale);
+
+		if (newScale == scale)
+			return;
+
+		ctx_.setRenderScale(newScale);
+		settle_ = params_.settleFrames;
+	}
+
+	inline void setParams(const DynamicResolutionParams& params) { params_ = params; }
+	inline const DynamicResolutionParams& getParams() const { return params_; }
+
+	inline float getSmoothedFrameMs() const { return smoothedMs_; }
+
+private:
+	VulkanRenderContext& ctx_;
+	DynamicResolutionParams params_;
+
+	float smoothedMs_ = 0.0f;
+	uint32_t settle_ = 0;
+};
+
+// The output of UpscaleProcessor, written as a storage image
+const VkFormat UpscaleFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+/* Upscales the part of 'input' rendered with the current render scale to the whole 'output' (an UpscaleFormat storage texture).
+   The input is expected in SHADER_READ_ONLY_OPTIMAL, the output ends up there as well */
+struct UpscaleProcessor: public ComputeProcessor
+{
+	UpscaleProcessor(VulkanRenderContext& ctx, VulkanTexture input, VulkanTexture output)
+	: ComputeProcessor(ctx, DescriptorSetInfo { .textures = { csTextureAttachment(input), storageImageAttachment(output) } },
+		"data/shaders/chapter08/DynamicUpscale.comp", (output.width + 7) / 8, (output.height + 7) / 8, 1, {}, std::vector<uint8_t>(2 * sizeof(float)))
+	, input_(input)
+	, output_(output)
+	{}
+
+	void updateBuffers(size_t currentImage) override
+	{
+		// The renderers round the scaled size, the shader needs the part that was actually rendered
+		const VkExtent2D extent = ctx_.getRenderExtent(input_.width, input_.height);
+		const float scale[2] = { (float)extent.width / (float)input_.width, (float)extent.height / (float)input_.height };
+		// Re-records the commands only when the scale changes
+		setPushConstants(scale, sizeof(scale));
+	}
+
+	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override
+	{
+		// The input has just been rendered, the output may still be sampled by the previous frame
+		const VkMemoryBarrier inputBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+		};
+
+		VkImageMemoryBarrier outputBarrier = imageBarrier(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT);
+
+		vkCmdPipelineBarrier(cmdBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &inputBarrier, 0, nullptr, 1, &outputBarrier);
+
+		ComputeProcessor::fillCommandBuffer(cmdBuffer, currentImage, fb, rp);
+
+		outputBarrier = imageBarrier(VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		vkCmdPipelineBarrier(cmdBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &outputBarrier);
+	}
+
+	/* The textures were re-created for a new framebuffer size */
+	void updateTextures(VulkanTexture input, VulkanTexture output)
+	{
+		input_ = input;
+		output_ = output;
+		updateAttachments(DescriptorSetInfo { .textures = { csTextureAttachment(input), storageImageAttachment(output) } },
+			(output.width + 7) / 8, (output.height + 7) / 8);
+	}
+
+private:
+	VulkanTexture input_;
+	VulkanTexture output_;
+
+	VkImageMemoryBarrier imageBarrier(VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess) const
+	{
+		return VkImageMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = srcAccess,
+			.dstAccessMask = dstAccess,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = output_.image.image,
+			.subresourceRange = VkImageSubresourceRange {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			}
+		};
+	}
+};
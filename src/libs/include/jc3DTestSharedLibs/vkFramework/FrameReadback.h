@@ -0,0 +1,84 @@
+#pragma once
+
+#include <jc3DTestSharedLibs/UtilsVulkan.h>
+
+#include <future>
+#include <string>
+#include <vector>
+
+/**
+	Non-blocking readback of rendered frames and offscreen textures (screenshots, frame dumps, golden images)
+
+	Copies are recorded at the end of a frame into host-visible buffers owned by the swapchain image slot.
+	When the same slot comes around again its previous submission has completed, so the pixels are picked up
+	without waiting for the GPU and encoded on a worker thread.
+
+	8-bit images are saved as .png, floating point images as Radiance .hdr
+*/
+struct FrameReadback
+{
+	explicit FrameReadback(VulkanRenderDevice& vkDev);
+	~FrameReadback();
+
+	/* The next rendered frame; needs VulkanContextFeatures::supportScreenshots_ unless the context is headless */
+	void captureScreen(const char* fileName);
+
+	/* 'frameCount' consecutive frames saved as <prefix>00000.png, <prefix>00001.png etc. */
+	void startFrameDump(const char* prefix, uint32_t frameCount);
+
+	/* An offscreen texture at the end of the next frame, it is expected (and left) in 'layout' */
+	void captureTexture(const VulkanTexture& tex, const char* fileName, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	/* Called by VulkanRenderContext before the renderers update their buffers: collects the finished copies of this slot and assigns new requests to it */
+	void beginFrame(uint32_t imageIndex);
+
+	/* Called by VulkanRenderContext after the final render pass */
+	void recordCopies(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+
+	/* Images and buffers copied by the command buffer of this image, part of the command buffer signature */
+	size_t commandSignature(uint32_t imageIndex) const;
+
+	/* Wait for the device and write everything requested so far */
+	void flush();
+
+	inline bool isDumping() const { return dumpRemaining_ > 0; }
+
+private:
+	struct Request
+	{
+		VkImage image = VK_NULL_HANDLE; // null for the swapchain image of the slot
+		VkFormat format = VK_FORMAT_B8G8R8A8_UNORM;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		std::string fileName;
+	};
+
+	struct StagingBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* ptr = nullptr;
+	};
+
+	struct Slot
+	{
+		std::vector<Request> requests;
+		std::vector<StagingBuffer> buffers;
+	};
+
+	void collect(Slot& slot);
+	void destroyBuffer(StagingBuffer& b);
+
+	VulkanRenderDevice& vkDev_;
+
+	std::vector<Slot> slots_;
+	std::vector<Request> pendingRequests_;
+
+	std::string dumpPrefix_;
+	uint32_t dumpRemaining_ = 0;
+	uint32_t dumpFrame_ = 0;
+
+	std::vector<std::future<void>> encodes_;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <jc3DTestSharedLibs/vkFramework/VulkanResources.h>
+
+/**
+	Linear allocator for small per-frame uniform data (matrices, per-draw parameters)
+
+	One persistently mapped buffer is split into a region per swapchain image. Every frame the region of the current image
+	is reset and renderers suballocate from it, so all uniforms of a frame cost no map calls and a single descriptor set
+	with a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC binding per layout. The returned offsets are passed to vkCmdBindDescriptorSets().
+
+	Offsets are deterministic as long as renderers allocate in the same order every frame, which keeps cached command buffers valid.
+*/
+struct FrameUniformAllocator
+{
+	static constexpr uint32_t kDefaultBytesPerFrame = 256 * 1024;
+
+	FrameUniformAllocator(VulkanResources& resources, VulkanRenderDevice& vkDev, uint32_t bytesPerFrame = kDefaultBytesPerFrame);
+
+	/* Called by VulkanRenderContext before the renderers update their buffers */
+	void beginFrame(uint32_t imageIndex);
+
+	/* Copy the data into the current frame region and return its dynamic offset */
+	uint32_t upload(const void* data, uint32_t size);
+
+	template <class T>
+	inline uint32_t upload(const T& data) { return upload(&data, (uint32_t)sizeof(T)); }
+
+	/* A dynamic uniform buffer binding covering 'range' bytes at any offset returned by upload() */
+	inline BufferAttachment attachment(uint32_t range, VkShaderStageFlags shaderStageFlags) const {
+		return dynamicUniformBufferAttachment(buffer_, range, shaderStageFlags);
+	}
+
+	inline uint32_t bytesUsed() const { return offset_ - frameBase_; }
+
+private:
+	VulkanBuffer buffer_;
+
+	uint32_t alignment_;
+	uint32_t bytesPerFrame_;
+
+	uint32_t frameBase_ = 0;
+	uint32_t offset_ = 0;
+};
@@ -12,12 +12,25 @@ struct GuiRenderer: public Renderer
 	void fillCommandBuffer(VkCommandBuffer commandBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
 	void updateBuffers(size_t currentImage) override;
 
+	// Vertex and index bytes uploaded by the last updateBuffers() call
+	inline VkDeviceSize getBytesPerFrame() const { return bytesPerFrame_; }
+	inline VkDeviceSize getBufferCapacity(size_t image) const { return storages_[image].size; }
+
 private:
+	// (Re)allocate the persistently mapped storage buffer of one swapchain image and queue its descriptor set update
+	void allocateStorage(size_t image, VkDeviceSize vtxSize, VkDeviceSize idxSize);
+
 	std::vector<VulkanTexture> allTextures;
 
-	// storage buffer with index and vertex data
+	// storage buffer with vertex data followed by index data (at an aligned offset), grows (doubling) when a frame does not fit
 	std::vector<VulkanBuffer> storages_;
+	std::vector<VkDeviceSize> vtxSizes_;
+	std::vector<VkDeviceSize> idxSizes_;
+	VkDeviceSize storageAlignment_ = 1;
+
+	VkDeviceSize bytesPerFrame_ = 0;
 };
 
 void imguiTextureWindow(const char* Title, uint32_t texId);
+void imguiUploadStats(const GuiRenderer& gui);
 int renderSceneTree(const Scene& scene, int node);
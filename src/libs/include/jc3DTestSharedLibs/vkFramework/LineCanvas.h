@@ -20,12 +20,24 @@ struct LineCanvas: public Renderer
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
 	void updateBuffers(size_t currentImage) override;
 
-	void clear() { lines_.clear(); }
+	bool isStatic() const override { return true; }
+	size_t commandSignature() const override;
+
+	void clear() { lines_.clear(); boxes_.clear(); }
 	void line(const vec3& p1, const vec3& p2, const vec4& c);
 	void plane3d(const vec3& orig, const vec3& v1, const vec3& v2, int n1, int n2, float s1, float s2, const vec4& color, const vec4& outlineColor);
 
+	/* The 12 edges of the [-1, 1] cube transformed by 'm', drawn as a single instance instead of 24 line vertices */
+	void box(const glm::mat4& m, const vec4& color);
+
 	inline void setCameraMatrix(const glm::mat4& mvp) { mvp_ = mvp; }
 
+	inline size_t getLineCount() const { return lines_.size() / 2; }
+	inline size_t getBoxCount() const { return boxes_.size(); }
+
+	// Size of both per-frame regions, i.e. the capacity of a single frame
+	inline VkDeviceSize getFrameCapacity() const { return lineRing_.regionSize + boxRing_.regionSize; }
+
 private:
 	glm::mat4 mvp_;
 
@@ -39,13 +51,34 @@ private:
 		vec4 color;
 	};
 
+	struct BoxInstance {
+		glm::mat4 model;
+		vec4 color;
+	};
+
 	std::vector<VertexData> lines_;
+	std::vector<BoxInstance> boxes_;
+
+	// A persistently mapped storage buffer with a region per swapchain image; grows (doubling) when a frame does not fit
+	struct FrameRing
+	{
+		VulkanBuffer buffer = {};
+		VkDeviceSize regionSize = 0;
+	};
+
+	FrameRing lineRing_;
+	FrameRing boxRing_;
+
+	VkDeviceSize storageAlignment_ = 1;
+
+	std::shared_future<VkPipeline> pendingBoxPipeline_;
+	VkPipeline boxPipeline_ = VK_NULL_HANDLE;
 
-	// Storage Buffer with index and vertex data
-	std::vector<VulkanBuffer> storages_;
+	// Returns true if the buffer was re-allocated and the descriptor sets have to be rewritten
+	bool reserve(FrameRing& ring, VkDeviceSize bytes);
+	void updateDescriptorSets();
 
-	static constexpr unsigned kMaxLinesCount = 4 * 8 * 65536;
-	static constexpr unsigned kMaxLinesDataSize = kMaxLinesCount * sizeof(LineCanvas::VertexData) * 2;
+	static constexpr VkDeviceSize kInitialRegionSize = 64 * 1024;
 };
 
 void drawBox3d(LineCanvas& canvas, const glm::mat4& m, const BoundingBox& box, const glm::vec4& color);
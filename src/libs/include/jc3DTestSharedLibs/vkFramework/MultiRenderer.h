@@ -71,6 +71,8 @@ private:
 constexpr const char* DefaultMeshVertexShader = "data/shaders/chapter07/VK01.vert";
 constexpr const char* DefaultMeshFragmentShader = "data/shaders/chapter07/VK01.frag";
 
+constexpr const char* OverdrawFragmentShader = "data/shaders/chapter08/Overdraw.frag";
+
 struct MultiRenderer: public Renderer
 {
 	MultiRenderer(
@@ -84,6 +86,7 @@ struct MultiRenderer: public Renderer
 		const std::vector<TextureAttachment>& auxTextures = std::vector<TextureAttachment> {});
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
+	bool isStatic() const override { return true; }
 	void updateBuffers(size_t currentImage) override;
 
 	void updateIndirectBuffers(size_t currentImage, bool* visibility = nullptr);
@@ -103,12 +106,42 @@ struct MultiRenderer: public Renderer
 	// Async loading in Chapter9
 	bool checkLoadedTextures();
 
+	/* Position-only pass (no fragment shader) over the opaque shapes, then their shading with depth test LESS_OR_EQUAL
+	   and no depth writes, so every pixel is shaded about once. Alpha-tested shapes skip the prepass and are drawn last
+	   with the default depth state, their holes come from the discard in the fragment shader */
+	void setDepthPrepass(bool enabled);
+	inline bool isDepthPrepassEnabled() const { return depthPrepass_; }
+
+	/* Replaces the shading with a count of the shaded fragments (Overdraw.frag) */
+	void setOverdrawView(bool enabled);
+	inline bool isOverdrawViewEnabled() const { return overdrawView_; }
+
 private:
 	VKSceneData& sceneData_;
 
+	std::string vertShaderFile_;
+	std::string fragShaderFile_;
+	PipelineInfo pInfo_;
+
+	bool depthPrepass_ = false;
+	bool overdrawView_ = false;
+
+	// Created on first use. Index bit 0: shading after the prepass, bit 1: overdraw view. Index 0 is the default pipeline
+	std::shared_future<VkPipeline> prepassPipeline_;
+	std::shared_future<VkPipeline> shadingPipelines_[4];
+
+	std::shared_future<VkPipeline> requestShadingPipeline(uint32_t index);
+
 	std::vector<VulkanBuffer> indirect_;
+	// The draws of indirect_ split for the prepass: opaque shapes first, then the alpha-tested ones (instanceCount 0 in the other half)
+	std::vector<VulkanBuffer> splitIndirect_;
 	std::vector<VulkanBuffer> shape_;
 
+	bool hasAlphaTested_ = false;
+
+	bool isAlphaTested(uint32_t shapeIndex) const;
+	void fillIndirectBuffer(VulkanBuffer& buffer, bool* visibility, bool split);
+
 	struct UBO {
 		mat4 proj_;
 		mat4 view_;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <jc3DTestSharedLibs/vkFramework/VulkanResources.h>
+
+/**
+	Pipeline variants of one set of shaders, selected by a feature bitmask.
+
+	Feature bit i is passed to the shaders as a 'layout(constant_id = firstConstantID + i) const bool' specialization constant,
+	so runtime branches on uniforms become compile-time constants and near-duplicate shader files can be merged.
+	Every shader is compiled once, only vkCreateGraphicsPipelines() is repeated per variant.
+	Variants are created in the background on first request and cached.
+*/
+struct PipelinePermutations
+{
+	PipelinePermutations(VulkanResources& resources, VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+		const std::vector<const char*>& shaderFiles, const PipelineInfo& pInfo, uint32_t numFeatures, uint32_t firstConstantID = 0);
+
+	/* Start creating the variant (if it does not exist yet) */
+	std::shared_future<VkPipeline> request(uint32_t features);
+
+	/* Blocks until the variant is created */
+	inline VkPipeline get(uint32_t features) { return VulkanResources::waitPipeline(request(features)); }
+
+	inline uint32_t getNumFeatures() const { return numFeatures_; }
+	inline size_t getNumVariants() const { return variants_.size(); }
+
+private:
+	VulkanResources& resources_;
+
+	VkRenderPass renderPass_;
+	VkPipelineLayout pipelineLayout_;
+
+	std::vector<std::string> shaderFiles_;
+	PipelineInfo pInfo_;
+
+	uint32_t numFeatures_;
+	uint32_t firstConstantID_;
+
+	std::unordered_map<uint32_t, std::shared_future<VkPipeline>> variants_;
+};
@@ -12,6 +12,9 @@ struct QuadRenderer: public Renderer
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
 	void updateBuffers(size_t currentImage) override;
 
+	bool isStatic() const override { return true; }
+	size_t commandSignature() const override { return hashCombine(Renderer::commandSignature(), quads_.size()); }
+
 	void quad(float x1, float y1, float x2, float y2, int texIdx);
 	void clear() { quads_.clear(); }
 
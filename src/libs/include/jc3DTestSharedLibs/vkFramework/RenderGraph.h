@@ -0,0 +1,287 @@
+#pragma once
+
+#include <jc3DTestSharedLibs/vkFramework/VulkanShaderProcessor.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+/**
+	A frame graph for chains of offscreen passes (screen-space effects, reductions etc.)
+
+	Passes declare which textures they read and write instead of interleaving barrier renderers by hand.
+	compile() then
+		- culls passes which do not contribute to any output,
+		- places transient textures with disjoint lifetimes into shared memory blocks,
+		- creates pass renderers (culled passes never create their pipelines),
+	and fillCommandBuffer() emits one merged vkCmdPipelineBarrier() before each pass, only for the images which need it.
+
+	Graphics passes are expected to use the default offscreen render pass created by Renderer::initRenderPass()
+	(COLOR_ATTACHMENT_OPTIMAL on entry and exit, LOAD_OP_LOAD), i.e. any QuadProcessor with a single output.
+*/
+
+enum RenderGraphAccess: uint8_t
+{
+	eRenderGraphAccess_ColorAttachment = 0, // the color output of a graphics pass
+	eRenderGraphAccess_SampledFragment = 1, // combined image sampler in a fragment shader
+	eRenderGraphAccess_SampledCompute  = 2, // combined image sampler in a compute shader
+	eRenderGraphAccess_StorageRead     = 3, // storage image read by a compute shader
+	eRenderGraphAccess_StorageWrite    = 4, // storage image written by a compute shader; previous contents may be discarded (culling, aliasing)
+	eRenderGraphAccess_StorageReadWrite = 5, // storage image read and then updated in place by a compute shader
+};
+
+struct RenderGraphUse
+{
+	uint32_t texture;
+	RenderGraphAccess access;
+};
+
+inline RenderGraphUse rgColorOutput(uint32_t tex)    { return RenderGraphUse { tex, eRenderGraphAccess_ColorAttachment }; }
+inline RenderGraphUse rgSampled(uint32_t tex)        { return RenderGraphUse { tex, eRenderGraphAccess_SampledFragment }; }
+inline RenderGraphUse rgSampledCompute(uint32_t tex) { return RenderGraphUse { tex, eRenderGraphAccess_SampledCompute }; }
+inline RenderGraphUse rgStorageRead(uint32_t tex)    { return RenderGraphUse { tex, eRenderGraphAccess_StorageRead }; }
+inline RenderGraphUse rgStorageWrite(uint32_t tex)   { return RenderGraphUse { tex, eRenderGraphAccess_StorageWrite }; }
+inline RenderGraphUse rgStorageReadWrite(uint32_t tex) { return RenderGraphUse { tex, eRenderGraphAccess_StorageReadWrite }; }
+
+struct RenderGraph: public Renderer
+{
+	using PassFactory = std::function<std::unique_ptr<Renderer>()>;
+	// Points an existing pass renderer at re-created textures, see rebuild()
+	using PassUpdater = std::function<void(Renderer&)>;
+
+	RenderGraph(VulkanRenderContext& c, const char* name = "RenderGraph");
+	virtual ~RenderGraph();
+
+	/* Textures owned elsewhere; they are expected in 'layout' before the graph runs and are returned to it afterwards */
+	uint32_t importTexture(const char* name, VulkanTexture tex, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	/* Textures which only live inside the graph. Zero width/height means framebuffer size. Created by compile() */
+	uint32_t addTransientTexture(const char* name, int width = 0, int height = 0, VkFormat format = VK_FORMAT_B8G8R8A8_UNORM,
+		VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	/* Framebuffer-sized transient texture divided by 2^downscale in both dimensions (at least 1x1), for half-resolution effects, pyramids etc. */
+	uint32_t addScaledTransientTexture(const char* name, uint32_t downscale, VkFormat format = VK_FORMAT_B8G8R8A8_UNORM,
+		VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	/* The factory is invoked by compile(), when all transient textures have memory; passes are recorded in the order they are added.
+	   Without an updater, rebuild() re-creates the pass renderer with the factory */
+	uint32_t addPass(const char* name, const std::vector<RenderGraphUse>& uses, const PassFactory& factory, const PassUpdater& updater = nullptr);
+
+	/* Fullscreen QuadProcessor pass: an optional uniform buffer followed by the sampled inputs, rendering into a single output */
+	uint32_t addQuadPass(const char* name, const std::vector<uint32_t>& inputs, uint32_t output, const char* shaderFile, BufferAttachment uniformBuffer = BufferAttachment {})
+	{
+		std::vector<RenderGraphUse> uses = { rgColorOutput(output) };
+		for (auto i: inputs)
+			uses.push_back(rgSampled(i));
+
+		const auto makeDSInfo = [this, inputs, uniformBuffer]() {
+			DescriptorSetInfo dsInfo;
+			if (uniformBuffer.buffer.buffer != VK_NULL_HANDLE)
+				dsInfo.buffers.push_back(uniformBuffer);
+			for (auto i: inputs)
+				dsInfo.textures.push_back(fsTextureAttachment(getTexture(i)));
+			return dsInfo;
+		};
+
+		return addPass(name, uses,
+			[this, makeDSInfo, output, shaderFile]() {
+				return std::make_unique<QuadProcessor>(ctx_, makeDSInfo(), std::vector<VulkanTexture> { getTexture(output) }, shaderFile);
+			},
+			[this, makeDSInfo, output](Renderer& r) {
+				static_cast<QuadProcessor&>(r).updateAttachments(makeDSInfo(), { getTexture(output) });
+			});
+	}
+
+	/* Single-dispatch ComputeProcessor pass: an optional uniform buffer followed by one binding per use, in order
+	   (rgSampledCompute() is a combined image sampler, rgStorageRead()/rgStorageWrite()/rgStorageReadWrite() a storage image).
+	   The dispatch covers the first written image with localSizeX * localSizeY tiles, so a 1x1 output means a single workgroup.
+	   'defines' select shader variants which cannot be specialization constants, e.g. code with optional SPIR-V capabilities */
+	uint32_t addComputePass(const char* name, const std::vector<RenderGraphUse>& uses, const char* shaderFile, uint32_t localSizeX, uint32_t localSizeY,
+		const SpecializationInfo& specialization = {}, const std::vector<uint8_t>& pushConstants = {}, BufferAttachment uniformBuffer = BufferAttachment {},
+		const std::vector<std::string>& defines = {})
+	{
+		const auto makeDSInfo = [this, uses, uniformBuffer]() {
+			DescriptorSetInfo dsInfo;
+			if (uniformBuffer.buffer.buffer != VK_NULL_HANDLE)
+				dsInfo.buffers.push_back(uniformBuffer);
+			for (const auto& u: uses)
+				dsInfo.textures.push_back((u.access == eRenderGraphAccess_SampledCompute) ?
+					csTextureAttachment(getTexture(u.texture)) : storageImageAttachment(getTexture(u.texture)));
+			return dsInfo;
+		};
+
+		// Recomputed on rebuild(), framebuffer-sized outputs change their size
+		const auto getGroups = [this, uses, localSizeX, localSizeY]() {
+			for (const auto& u: uses)
+			{
+				if (u.access != eRenderGraphAccess_StorageWrite && u.access != eRenderGraphAccess_StorageReadWrite)
+					continue;
+				const VulkanTexture t = getTexture(u.texture);
+				return std::pair<uint32_t, uint32_t> { (t.width + localSizeX - 1) / localSizeX, (t.height + localSizeY - 1) / localSizeY };
+			}
+			return std::pair<uint32_t, uint32_t> { 1, 1 };
+		};
+
+		return addPass(name, uses,
+			[this, makeDSInfo, getGroups, shaderFile, specialization, pushConstants, defines]() {
+				const auto groups = getGroups();
+				return std::make_unique<ComputeProcessor>(ctx_, makeDSInfo(), shaderFile, groups.first, groups.second, 1, specialization, pushConstants, defines);
+			},
+			[makeDSInfo, getGroups](Renderer& r) {
+				const auto groups = getGroups();
+				static_cast<ComputeProcessor&>(r).updateAttachments(makeDSInfo(), groups.first, groups.second);
+			});
+	}
+
+	/* Outputs are kept alive until the end of the graph, are never aliased and end up in SHADER_READ_ONLY_OPTIMAL */
+	void markOutput(uint32_t tex);
+
+	void compile();
+
+	/* Replace an imported texture (e.g., re-created for a new framebuffer size); takes effect in rebuild() */
+	void setImportedTexture(uint32_t tex, VulkanTexture texture);
+
+	/* After a swapchain resize: re-creates transient textures whose size changed (zero width/height follow the framebuffer size),
+	   then updates all pass renderers. Pipelines and render passes are kept. The GPU must be idle */
+	void rebuild();
+
+	VulkanTexture getTexture(uint32_t tex) const;
+
+	inline Renderer* getPassRenderer(uint32_t pass) const { return passes_[pass].renderer.get(); }
+
+	/* Disabled passes are skipped (together with their barriers) at record time, and so are the passes
+	   which only feed disabled ones (e.g., a bloom pyramid nobody composes) */
+	inline void setPassEnabled(uint32_t pass, bool enabled)
+	{
+		if (passes_[pass].enabled == enabled)
+			return;
+		passes_[pass].enabled = enabled;
+		updateLiveness();
+	}
+	inline bool isPassEnabled(uint32_t pass) const { return passes_[pass].enabled; }
+
+	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
+	void updateBuffers(size_t currentImage) override;
+
+	bool isStatic() const override;
+	size_t commandSignature() const override;
+
+	void printStats() const;
+
+	/* GPU time of every pass from timestamp queries (one query set per swapchain image).
+	   The times are read back in updateBuffers() and lag behind by one use of the swapchain image; disabled passes report zero */
+	void setTimestampsEnabled(bool enabled);
+	inline bool isTimestampsEnabled() const { return timestampPool_ != VK_NULL_HANDLE; }
+	inline float getPassTimeMs(uint32_t pass) const { return passes_[pass].gpuTimeMs; }
+	float getTotalTimeMs() const;
+	void printTimings() const;
+
+private:
+	struct Texture
+	{
+		std::string name;
+		VulkanTexture texture = {};
+
+		bool transient = false;
+		bool output = false;
+
+		// Zero means framebuffer size, shifted right by 'downscale'
+		int requestedWidth = 0;
+		int requestedHeight = 0;
+		uint32_t downscale = 0;
+
+		VkImageLayout externalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		VkFilter filter = VK_FILTER_LINEAR;
+		VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+		// Filled by compile()
+		VkImageUsageFlags usage = 0;
+		int firstUse = -1;
+		int lastUse = -1;
+		int slot = -1;
+		VkDeviceSize size = 0;
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags writeAccess = 0;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::vector<RenderGraphUse> uses;
+		PassFactory factory;
+		PassUpdater updater;
+		std::unique_ptr<Renderer> renderer;
+
+		bool enabled = true;
+		bool culled = false;
+		// Enabled and contributing to an output through enabled passes only
+		bool live = true;
+
+		float gpuTimeMs = 0.0f;
+	};
+
+	// A block of device memory shared by transient textures with disjoint lifetimes
+	struct MemorySlot
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeBits = ~0u;
+		int lastUse = -1;
+
+		// Every stage/access which touches the slot, used to order the first write of a frame after the previous frame
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags writeAccess = 0;
+	};
+
+	// Synchronization state of a single image while the graph is being recorded
+	struct ImageState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0;
+		VkPipelineStageFlags visibleStages = 0;
+	};
+
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		std::vector<VkImageMemoryBarrier> barriers;
+	};
+
+	void updateTransientSize(Texture& t) const;
+	void readTimestamps(size_t currentImage);
+
+	void cullPasses();
+	void updateLiveness();
+	void computeLifetimes();
+	void allocateTransients();
+	void destroyTransients();
+
+	static void addBarrier(BarrierBatch& batch, const Texture& tex, ImageState& state,
+		VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, bool write,
+		std::vector<ImageState>& slotStates);
+	void flushBarriers(VkCommandBuffer cmdBuffer, BarrierBatch& batch);
+
+	// A null command buffer only updates barrier statistics
+	void record(VkCommandBuffer cmdBuffer, size_t currentImage);
+
+	std::string name_;
+	bool compiled_ = false;
+
+	std::vector<Texture> textures_;
+	std::vector<Pass> passes_;
+	std::vector<MemorySlot> slots_;
+
+	// passes_.size() + 1 timestamps per swapchain image
+	VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+	float timestampPeriodNs_ = 0.0f;
+
+	// Statistics
+	VkDeviceSize transientBytes_ = 0;
+	VkDeviceSize aliasedBytes_ = 0;
+	uint32_t barrierBatches_ = 0;
+	uint32_t imageBarriers_ = 0;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "VulkanApp.h"
+#include "PipelinePermutations.h"
 
 struct Renderer
 {
@@ -13,14 +14,75 @@ struct Renderer
 	virtual void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) = 0;
 	virtual void updateBuffers(size_t currentImage) {}
 
+	// A static renderer records the same commands every frame as long as commandSignature() stays the same
+	// (only buffer contents change), so the recorded command buffers can be reused
+	virtual bool isStatic() const { return false; }
+
+	// Everything the recorded commands depend on besides buffer contents: draw counts, bound resources etc.
+	virtual size_t commandSignature() const
+	{
+		size_t signature = commandVersion_;
+		for (auto offset: dynamicOffsets_)
+			signature = hashCombine(signature, offset);
+		// The viewport is recorded into the command buffer
+		if (dynamicViewport_)
+			signature = hashCombine(signature, std::hash<float>()(ctx_.getRenderScale()));
+		return signature;
+	}
+
+	// Forces re-recording of cached command buffers (e.g., after descriptor sets were rewritten)
+	inline void invalidateCommands() { commandVersion_++; }
+
 	inline void updateUniformBuffer(uint32_t currentImage, const uint32_t offset, const uint32_t size, const void* data) {
-		uploadBufferData(ctx_.vkDev, uniforms_[currentImage].memory, offset, data, size);
+		if (uniforms_[currentImage].ptr)
+			memcpy((uint8_t*)uniforms_[currentImage].ptr + offset, data, size);
+		else
+			uploadBufferData(ctx_.vkDev, uniforms_[currentImage].memory, offset, data, size);
 	}
 
 	void initPipeline(const std::vector<const char*>& shaders, const PipelineInfo& pInfo, uint32_t vtxConstSize = 0, uint32_t fragConstSize = 0)
 	{
-		pipelineLayout_ = ctx_.resources.addPipelineLayout(descriptorSetLayout_, vtxConstSize, fragConstSize);
-		graphicsPipeline_ = ctx_.resources.addPipeline(renderPass_.handle, pipelineLayout_, shaders, pInfo);
+		pipelineLayout_ = pInfo.pushConstants.empty() ?
+			ctx_.resources.addPipelineLayout(descriptorSetLayout_, vtxConstSize, fragConstSize) :
+			ctx_.resources.addPipelineLayout(descriptorSetLayout_, pInfo.pushConstants);
+		// The pipeline is created in the background and resolved when it is bound for the first time
+		pendingPipeline_ = ctx_.resources.addPipelineAsync(renderPass_.handle, pipelineLayout_, shaders, pInfo);
+	}
+
+	/* Like initPipeline(), but the shader branches are selected by specialization constants, see PipelinePermutations */
+	void initPipelinePermutations(const std::vector<const char*>& shaders, const PipelineInfo& pInfo, uint32_t numFeatures, uint32_t features = 0,
+		uint32_t vtxConstSize = 0, uint32_t fragConstSize = 0)
+	{
+		pipelineLayout_ = pInfo.pushConstants.empty() ?
+			ctx_.resources.addPipelineLayout(descriptorSetLayout_, vtxConstSize, fragConstSize) :
+			ctx_.resources.addPipelineLayout(descriptorSetLayout_, pInfo.pushConstants);
+		permutations_ = std::make_unique<PipelinePermutations>(ctx_.resources, renderPass_.handle, pipelineLayout_, shaders, pInfo, numFeatures);
+		features_ = ~features;
+		setFeatures(features);
+	}
+
+	/* Switch to another pipeline variant; it is created on first use */
+	void setFeatures(uint32_t features)
+	{
+		if (!permutations_ || features == features_)
+			return;
+
+		features_ = features;
+		pendingPipeline_ = permutations_->request(features);
+		invalidateCommands();
+	}
+
+	inline uint32_t getFeatures() const { return features_; }
+
+	inline VkPipeline getPipeline()
+	{
+		if (pendingPipeline_.valid())
+		{
+			graphicsPipeline_ = VulkanResources::waitPipeline(pendingPipeline_);
+			pendingPipeline_ = {};
+		}
+
+		return graphicsPipeline_;
 	}
 
 	PipelineInfo initRenderPass(const PipelineInfo& pInfo, const std::vector<VulkanTexture>& outputs,
@@ -51,6 +113,36 @@ struct Renderer
 		return outInfo;
 	}
 
+	/* Rebuild the offscreen framebuffer for re-created (e.g., resized) outputs of the same formats; the render pass and the pipeline are kept */
+	void updateOutputs(const std::vector<VulkanTexture>& outputs)
+	{
+		if (outputs.empty() || framebuffer_ == VK_NULL_HANDLE)
+			return;
+
+		ctx_.resources.destroyFramebuffer(framebuffer_);
+		framebuffer_ = ctx_.resources.addFramebuffer(renderPass_, outputs);
+
+		processingWidth = outputs[0].width;
+		processingHeight = outputs[0].height;
+
+		invalidateCommands();
+	}
+
+	/* The area beginRenderPass() renders to */
+	VkRect2D getRenderRect() const
+	{
+		// On-screen renderers follow the swapchain size
+		const bool offscreen = (framebuffer_ != VK_NULL_HANDLE);
+
+		const uint32_t width  = offscreen ? processingWidth  : ctx_.vkDev.framebufferWidth;
+		const uint32_t height = offscreen ? processingHeight : ctx_.vkDev.framebufferHeight;
+
+		return VkRect2D {
+			.offset = { 0, 0 },
+			.extent = dynamicViewport_ ? ctx_.getRenderExtent(width, height) : VkExtent2D { .width = width, .height = height }
+		};
+	}
+
 	void beginRenderPass(VkRenderPass rp, VkFramebuffer fb, VkCommandBuffer commandBuffer, size_t currentImage)
 	{
 		const VkClearValue clearValues[2] = {
@@ -58,18 +150,33 @@ struct Renderer
 			VkClearValue { .depthStencil = { 1.0f, 0 } }
 		};
 
-		const VkRect2D rect {
-			.offset = { 0, 0 },
-			.extent = { .width = processingWidth, .height = processingHeight }
-		};
+		const VkRect2D rect = getRenderRect();
 
 		ctx_.beginRenderPass(commandBuffer, rp, currentImage, rect,
 			fb,
 			(renderPass_.info.clearColor_ ? 1u : 0u) + (renderPass_.info.clearDepth_ ? 1u : 0u),
 			renderPass_.info.clearColor_ ? &clearValues[0] : (renderPass_.info.clearDepth_ ? &clearValues[1] : nullptr));
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1, &descriptorSets_[currentImage], 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline());
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1, &descriptorSets_[currentImage],
+			static_cast<uint32_t>(dynamicOffsets_.size()), dynamicOffsets_.empty() ? nullptr : dynamicOffsets_.data());
+
+		const VkViewport viewport = {
+			.x = 0.0f,
+			.y = 0.0f,
+			.width = static_cast<float>(rect.extent.width),
+			.height = static_cast<float>(rect.extent.height),
+			.minDepth = 0.0f,
+			.maxDepth = 1.0f
+		};
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+	}
+
+	/* Per-draw data which does not need a descriptor set at all */
+	inline void pushConstants(VkCommandBuffer commandBuffer, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data) {
+		vkCmdPushConstants(commandBuffer, pipelineLayout_, stages, offset, size, data);
 	}
 
 	VkFramebuffer framebuffer_ = nullptr;
@@ -78,24 +185,39 @@ struct Renderer
 	uint32_t processingWidth;
 	uint32_t processingHeight;
 
+	// Render into the part of the targets given by VulkanRenderContext::getRenderExtent() (dynamic resolution)
+	bool dynamicViewport_ = false;
+
 	// Updating individual textures (9 is the binding in our Chapter7-Chapter9 IBL scene shaders)
 	void updateTexture(uint32_t textureIndex, VulkanTexture newTexture, uint32_t bindingIndex = 9)
 	{
 		for (auto ds: descriptorSets_)
-			updateTextureInDescriptorSetArray(ctx_.vkDev, ds, newTexture, textureIndex, bindingIndex);
+			ctx_.resources.updateDescriptorSetTexture(ds, newTexture, textureIndex, bindingIndex);
+
+		invalidateCommands();
 	}
 
 protected:
 	VulkanRenderContext& ctx_;
 
-	// Descriptor set (layout + pool + sets) -> uses uniform buffers, textures, framebuffers
+	// Descriptor set (layout + sets from the shared pools) -> uses uniform buffers, textures, framebuffers
 	VkDescriptorSetLayout descriptorSetLayout_ = nullptr;
-	VkDescriptorPool descriptorPool_ = nullptr;
 	std::vector<VkDescriptorSet> descriptorSets_;
 
 	// 4. Pipeline & render pass (using DescriptorSets & pipeline state options)
 	VkPipelineLayout pipelineLayout_ = nullptr;
 	VkPipeline graphicsPipeline_ = nullptr;
+	std::shared_future<VkPipeline> pendingPipeline_;
+
+	// Only used after initPipelinePermutations()
+	std::unique_ptr<PipelinePermutations> permutations_;
+	uint32_t features_ = 0;
 
 	std::vector<VulkanBuffer> uniforms_;
+
+	// Offsets of UNIFORM_BUFFER_DYNAMIC bindings (in binding order), usually allocated from ctx_.frameUniforms in updateBuffers()
+	std::vector<uint32_t> dynamicOffsets_;
+
+private:
+	size_t commandVersion_ = 0;
 };
@@ -11,6 +11,7 @@
 #include <functional>
 #include <memory>
 #include <limits>
+#include <optional>
 
 #include <imgui.h>
 
@@ -21,6 +22,8 @@
 #include <jc3DTestSharedLibs/UtilsFPS.h>
 
 #include <jc3DTestSharedLibs/vkFramework/VulkanResources.h>
+#include <jc3DTestSharedLibs/vkFramework/FrameUniformAllocator.h>
+#include <jc3DTestSharedLibs/vkFramework/FrameReadback.h>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -37,7 +40,16 @@ struct Resolution
 
 GLFWwindow* initVulkanApp(int width, int height, Resolution* resolution = nullptr);
 
-bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc);
+/* No GLFW at all, returns a null window. Negative sizes are percentages of 1920x1080 */
+GLFWwindow* initVulkanAppHeadless(int width, int height, Resolution* resolution = nullptr);
+
+/* JC3D_HEADLESS=<frameCount> in the environment turns any app into a headless one (e.g., for CI runs) */
+VulkanContextFeatures applyHeadlessOverride(const VulkanContextFeatures& ctxFeatures);
+
+/* If isCommandBufferValidFunc is given, the command pool is not reset and the command buffer for the acquired image is re-recorded only when the function returns false.
+   An out-of-date or suboptimal swapchain sets vkDev.swapchainOutOfDate instead of failing */
+bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc,
+	const std::function<bool(uint32_t)>& isCommandBufferValidFunc = nullptr);
 
 struct Renderer;
 
@@ -45,12 +57,41 @@ struct RenderItem {
 	Renderer& renderer_;
 	bool enabled_ = true;
 	bool useDepth_ = true;
+
+	/* Optional dependencies, see cullRenderItems(). Layout barriers declare their texture as both input and output */
+	std::vector<VkImage> inputs_;
+	std::vector<VkImage> outputs_;
+
+	// Set by cullRenderItems(): enabled, but nothing active consumes the outputs
+	bool culled_ = false;
+
 	explicit RenderItem(Renderer& r, bool useDepth = true)
 	: renderer_(r)
 	, useDepth_(useDepth)
 	{}
+
+	RenderItem& reads(const std::vector<VulkanTexture>& textures)
+	{
+		for (const auto& t: textures)
+			inputs_.push_back(t.image.image);
+		return *this;
+	}
+
+	RenderItem& writes(const std::vector<VulkanTexture>& textures)
+	{
+		for (const auto& t: textures)
+			outputs_.push_back(t.image.image);
+		return *this;
+	}
+
+	inline bool isActive() const { return enabled_ && !culled_; }
 };
 
+/* Frame scheduling: an item which declares outputs only runs if a later active item reads one of them,
+   so disabling a consumer (e.g., SSAO) also removes its producers and their barriers.
+   Items without outputs (on-screen renderers) run whenever they are enabled */
+void cullRenderItems(std::vector<RenderItem>& items);
+
 struct VulkanRenderContext
 {
 	VulkanInstance vk;
@@ -58,9 +99,17 @@ struct VulkanRenderContext
 	VulkanContextCreator ctxCreator;
 	VulkanResources resources;
 
+	// Small per-frame uniform data of all renderers
+	FrameUniformAllocator frameUniforms;
+
+	// Screenshots, frame dumps and texture captures
+	FrameReadback readback;
+
 	VulkanRenderContext(void* window, uint32_t screenWidth, uint32_t screenHeight, const VulkanContextFeatures& ctxFeatures = VulkanContextFeatures()):
 		ctxCreator(vk, vkDev, window, screenWidth, screenHeight, ctxFeatures),
 		resources(vkDev),
+		frameUniforms(resources, vkDev),
+		readback(vkDev),
 
 		depthTexture(resources.addDepthTexture(vkDev.framebufferWidth, vkDev.framebufferHeight, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)),
 
@@ -75,9 +124,37 @@ struct VulkanRenderContext
 	{
 	}
 
+	~VulkanRenderContext();
+
 	void updateBuffers(uint32_t imageIndex);
 	void composeFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
+	// Check if the command buffer recorded earlier for this swapchain image can be submitted as is
+	bool isCommandBufferValid(uint32_t imageIndex);
+
+	/* Re-create the swapchain, the depth buffer and the swapchain framebuffers for a new size (the device is kept),
+	   then run the resize handlers. The actual size may differ, see vkDev.framebufferWidth/Height */
+	void resize(uint32_t width, uint32_t height);
+
+	/* Handlers run in registration order, so register producers of size-dependent textures before their consumers.
+	   Everything created with a zero (i.e. framebuffer) size has to be re-created here */
+	inline void addResizeHandler(const std::function<void(uint32_t, uint32_t)>& handler) { resizeHandlers_.push_back(handler); }
+
+	/* Takes effect when the swapchain is re-created before the next frame */
+	void setPresentMode(VkPresentModeKHR presentMode);
+
+	/* GPU time of whole frames from two timestamps around composeFrame(). The time is read back in updateBuffers(),
+	   one use of the swapchain image later; it stays zero if the device cannot write timestamps on the graphics queue */
+	void enableGpuFrameTimer();
+	inline float getGpuFrameTimeMs() const { return gpuFrameTimeMs_; }
+
+	/* Dynamic resolution: renderers with Renderer::dynamicViewport_ set draw into the top-left 'scale' part of their targets,
+	   which keep their full size. Scale changes re-record the affected command buffers */
+	void setRenderScale(float scale);
+	inline float getRenderScale() const { return renderScale_; }
+	// Part of a width x height target covered by the scaled viewport, at least 1x1
+	VkExtent2D getRenderExtent(uint32_t width, uint32_t height) const;
+
 	// For Chapter 8 & 9
 	inline PipelineInfo pipelineParametersForOutputs(const std::vector<VulkanTexture>& outputs) const {
 		return PipelineInfo {
@@ -89,6 +166,12 @@ struct VulkanRenderContext
 
 	std::vector<RenderItem> onScreenRenderers_;
 
+	// Reuse recorded command buffers while all enabled renderers are static and their signatures do not change
+	bool reuseCommandBuffers_ = true;
+
+	// Seconds since the start of VulkanApp::mainLoop(); advances in fixed steps when headless
+	double time_ = 0.0;
+
 	VulkanTexture depthTexture;
 
 	// Framebuffers and renderpass for on-screen rendering
@@ -101,6 +184,18 @@ struct VulkanRenderContext
 	std::vector<VkFramebuffer> swapchainFramebuffers;
 	std::vector<VkFramebuffer> swapchainFramebuffers_NoDepth;
 
+	// Signatures of the frames recorded into each of the swapchain command buffers
+	std::vector<std::optional<size_t>> recordedSignatures_;
+
+	std::vector<std::function<void(uint32_t, uint32_t)>> resizeHandlers_;
+
+	// Two timestamps per swapchain image, see enableGpuFrameTimer()
+	VkQueryPool frameTimestamps_ = VK_NULL_HANDLE;
+	float timestampPeriodNs_ = 0.0f;
+	float gpuFrameTimeMs_ = 0.0f;
+
+	float renderScale_ = 1.0f;
+
 	void beginRenderPass(VkCommandBuffer cmdBuffer, VkRenderPass pass, size_t currentImage, const VkRect2D area,
 		VkFramebuffer fb = VK_NULL_HANDLE,
 		uint32_t clearValueCount = 0, const VkClearValue* clearValues = nullptr)
@@ -121,18 +216,26 @@ struct VulkanRenderContext
 struct VulkanApp
 {
 	VulkanApp(int screenWidth, int screenHeight, const VulkanContextFeatures& ctxFeatures = VulkanContextFeatures())
-		: window_(initVulkanApp(screenWidth, screenHeight, &resolution_)),
-		ctx_(window_, resolution_.width, resolution_.height, ctxFeatures),
+		: ctxFeatures_(applyHeadlessOverride(ctxFeatures)),
+		window_(ctxFeatures_.headless_ ?
+			initVulkanAppHeadless(screenWidth, screenHeight, &resolution_) :
+			initVulkanApp(screenWidth, screenHeight, &resolution_)),
+		ctx_(window_, resolution_.width, resolution_.height, ctxFeatures_),
 		onScreenRenderers_(ctx_.onScreenRenderers_)
 	{
-		glfwSetWindowUserPointer(window_, this);
-		assignCallbacks();
+		if (window_)
+		{
+			glfwSetWindowUserPointer(window_, this);
+			assignCallbacks();
+		}
 	}
 
 	~VulkanApp()
 	{
 		glslang_finalize_process();
-		glfwTerminate();
+
+		if (window_)
+			glfwTerminate();
 	}
 
 	virtual void drawUI() {}
@@ -159,6 +262,15 @@ struct VulkanApp
 	virtual void update(float deltaSeconds) = 0;
 
 	inline float getFPS() const { return fpsCounter_.getFPS(); }
+	inline const FramesPerSecondCounter& getFPSCounter() const { return fpsCounter_; }
+
+	// Zero means unlimited (FIFO presentation still limits to the refresh rate)
+	inline void setFrameRateLimit(float fps) { frameLimiter_.setTargetFPS(fps); }
+
+	inline bool isHeadless() const { return window_ == nullptr; }
+
+	// Leave mainLoop() after the current frame
+	inline void requestExit() { exitRequested_ = true; }
 
 protected:
 	struct MouseState
@@ -167,15 +279,27 @@ protected:
 		bool pressedLeft = false;
 	} mouseState_;
 
+	VulkanContextFeatures ctxFeatures_;
 	Resolution resolution_;
 	GLFWwindow* window_ = nullptr;
 	VulkanRenderContext ctx_;
 	std::vector<RenderItem>& onScreenRenderers_;
 	FramesPerSecondCounter fpsCounter_;
+	FrameLimiter frameLimiter_;
 
 private:
+	bool exitRequested_ = false;
+
+	// Set by the GLFW framebuffer size callback
+	bool framebufferResized_ = false;
+
 	void assignCallbacks();
 
+	// Returns false while the window is minimized
+	bool handleResize();
+
+	bool shouldExit(uint32_t framesRendered) const;
+
 	void updateBuffers(uint32_t imageIndex);
 };
 
@@ -1,10 +1,18 @@
 #pragma once
+#include <jc3DTestSharedLibs/Utils.h>
 #include <jc3DTestSharedLibs/UtilsVulkan.h>
 #include <volk/volk.h>
 
+#include <taskflow/taskflow.hpp>
+
 #include <cstring>
+#include <future>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 
 /**
@@ -64,6 +72,21 @@ inline TextureAttachment fsTextureAttachment(VulkanTexture tex) {
 	return makeTextureAttachment(tex, VK_SHADER_STAGE_FRAGMENT_BIT);
 }
 
+inline TextureAttachment csTextureAttachment(VulkanTexture tex) {
+	return makeTextureAttachment(tex, VK_SHADER_STAGE_COMPUTE_BIT);
+}
+
+/* Image load/store in a compute shader, the image is expected in VK_IMAGE_LAYOUT_GENERAL */
+inline TextureAttachment storageImageAttachment(VulkanTexture tex) {
+	return TextureAttachment {
+		.dInfo = {
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.shaderStageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+		},
+		.texture = tex
+	};
+}
+
 inline TextureArrayAttachment fsTextureArrayAttachment(const std::vector<VulkanTexture>& textures) {
 	return TextureArrayAttachment {
 		.dInfo = {
@@ -95,6 +118,11 @@ inline BufferAttachment uniformBufferAttachment(VulkanBuffer buffer, uint32_t of
 	return makeBufferAttachment(buffer, offset, size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, shaderStageFlags);
 }
 
+/* The buffer is bound with a dynamic offset (vkCmdBindDescriptorSets), 'size' is the range visible to the shader */
+inline BufferAttachment dynamicUniformBufferAttachment(VulkanBuffer buffer, uint32_t size, VkShaderStageFlags shaderStageFlags) {
+	return makeBufferAttachment(buffer, 0, size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, shaderStageFlags);
+}
+
 inline BufferAttachment storageBufferAttachment(VulkanBuffer buffer, uint32_t offset, uint32_t size, VkShaderStageFlags shaderStageFlags) {
 	return makeBufferAttachment(buffer, offset, size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, shaderStageFlags);
 }
@@ -107,6 +135,42 @@ struct DescriptorSetInfo
 	std::vector<TextureArrayAttachment> textureArrays;
 };
 
+/* Values of 'layout(constant_id = N) const' declarations, shared by all shader stages of a pipeline.
+   Entries for constant ids which a shader does not declare are ignored */
+struct SpecializationInfo
+{
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<uint8_t> data;
+
+	template <class T>
+	SpecializationInfo& add(uint32_t constantID, T value)
+	{
+		static_assert(std::is_arithmetic_v<T>, "Specialization constants are scalars");
+
+		// GLSL 'bool' specialization constants are 32-bit
+		using StoredT = std::conditional_t<std::is_same_v<T, bool>, VkBool32, T>;
+		const StoredT v = static_cast<StoredT>(value);
+
+		entries.push_back(VkSpecializationMapEntry { .constantID = constantID, .offset = static_cast<uint32_t>(data.size()), .size = sizeof(StoredT) });
+		data.insert(data.end(), (const uint8_t*)&v, (const uint8_t*)&v + sizeof(StoredT));
+
+		return *this;
+	}
+
+	inline bool empty() const { return entries.empty(); }
+
+	/* The result points into this structure */
+	inline VkSpecializationInfo get() const
+	{
+		return VkSpecializationInfo {
+			.mapEntryCount = static_cast<uint32_t>(entries.size()),
+			.pMapEntries = entries.data(),
+			.dataSize = data.size(),
+			.pData = data.data()
+		};
+	}
+};
+
 /* A structure with pipeline parameters */
 struct PipelineInfo
 {
@@ -119,9 +183,26 @@ struct PipelineInfo
 
 	bool useBlending = true;
 
+	/* Scissors are set per draw by the renderer (viewport and scissor are always dynamic, Renderer::beginRenderPass() covers the whole framebuffer) */
 	bool dynamicScissorState = false;
 
 	uint32_t patchControlPoints = 0;
+
+	/* Push constant ranges of the pipeline layout created by Renderer::initPipeline() */
+	std::vector<VkPushConstantRange> pushConstants = {};
+
+	/* Compile-time constants of all shader stages */
+	SpecializationInfo specialization = {};
+
+	/* Depth state with useDepth. After a depth prepass the main pass uses VK_COMPARE_OP_LESS_OR_EQUAL without depth writes */
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	bool depthWrite = true;
+
+	/* A depth-only pipeline (prepass) masks all color writes */
+	bool colorWrite = true;
+
+	/* src + dst, e.g. for counting fragments (overdraw visualisation) */
+	bool additiveBlending = false;
 };
 
 /**
@@ -150,14 +231,27 @@ struct VulkanResources
 
 	VulkanTexture loadTexture2D(const char* filename);
 
+	/* Equirectangular image converted into cube faces on the CPU */
 	VulkanTexture loadCubeMap(const char* fileName, uint32_t mipLevels = 1);
 
+	/* The same conversion in a compute shader (EquirectToCube.comp), followed by a full mip chain (CubeDownsample.comp).
+	   Zero faceSize means width / 4, like the CPU path. The result is R32G32B32A32_SFLOAT, its sampler covers all mips */
+	VulkanTexture loadCubeMapGPU(const char* fileName, uint32_t faceSize = 0, bool generateMips = true);
+
+	/* Image based lighting from a cube map with mips (see loadCubeMapGPU()), R16G16B16A16_SFLOAT results.
+	   The specular map stores roughness mip / (mipLevels - 1) in each mip, the irradiance map the cosine-weighted hemisphere */
+	VulkanTexture prefilterSpecularCubeMap(VulkanTexture envMap, uint32_t faceSize = 256, uint32_t mipLevels = 6, uint32_t sampleCount = 1024);
+	VulkanTexture computeIrradianceCubeMap(VulkanTexture envMap, uint32_t faceSize = 32, uint32_t sampleCount = 2048);
+
 	VulkanTexture loadKTX(const char* fileName);
 
 	VulkanTexture createFontTexture(const char* fontFile);
 
 	VulkanTexture addColorTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
 
+	/* Sampled and storage image (e.g., history buffers written by compute shaders), starts in SHADER_READ_ONLY_OPTIMAL */
+	VulkanTexture addStorageTexture(int texWidth = 0, int texHeight = 0, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
 	VulkanTexture addDepthTexture(int texWidth = 0, int texHeight = 0, VkImageLayout layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
 	VulkanTexture addSolidRGBATexture(uint32_t color = 0xFFFFFFFF);
@@ -202,26 +296,58 @@ struct VulkanResources
 		.flags_ = eRenderPassBit_Offscreen | eRenderPassBit_First });
 
 	VkPipelineLayout addPipelineLayout(VkDescriptorSetLayout dsLayout, uint32_t vtxConstSize = 0, uint32_t fragConstSize = 0);
+	VkPipelineLayout addPipelineLayout(VkDescriptorSetLayout dsLayout, const std::vector<VkPushConstantRange>& pushConstants);
 
 	VkPipeline addPipeline(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
 		const std::vector<const char*>& shaderFiles,
 		const PipelineInfo& pipelineParams = PipelineInfo { .width = 0, .height = 0, .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, .useDepth = true, .useBlending = false, .dynamicScissorState = false });
 
-	VkPipeline addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout);
+	/* Compiles the shaders and creates the pipeline on the worker threads of 'executor'. Distinct shaders are compiled concurrently,
+	   each shader file is compiled only once. The future must be resolved (see waitPipeline()) before the pipeline is bound.
+	   It holds VK_NULL_HANDLE if a shader or the pipeline could not be created. */
+	std::shared_future<VkPipeline> addPipelineAsync(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+		const std::vector<const char*>& shaderFiles,
+		const PipelineInfo& pipelineParams = PipelineInfo { .width = 0, .height = 0, .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, .useDepth = true, .useBlending = false, .dynamicScissorState = false });
+
+	/* Resolves the result of addPipelineAsync(), exits if the pipeline could not be created */
+	static VkPipeline waitPipeline(const std::shared_future<VkPipeline>& pipeline);
+
+	/* Start compiling a shader on a worker thread (unless it is already compiled or being compiled) */
+	void compileShaderAsync(const char* fileName);
+
+	/* Blocks until the shader is compiled. Compiles it on the calling thread if no worker has started it yet */
+	bool getShaderModule(const char* fileName, ShaderModule* shaderModule);
+
+	VkPipeline addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout, const SpecializationInfo& specialization = {}, const std::vector<std::string>& defines = {});
 
 	/* Calculate the descriptor pool size from the list of buffers and textures */
 	VkDescriptorPool addDescriptorPool(const DescriptorSetInfo& dsInfo, uint32_t dSetCount = 1);
 
+	/* Layouts are cached by their binding signature: identical DescriptorSetInfos share one VkDescriptorSetLayout */
 	VkDescriptorSetLayout addDescriptorSetLayout(const DescriptorSetInfo& dsInfo);
 
 	VkDescriptorSet addDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout dsLayout);
 
+	/* Allocate a set from the shared pools; another pool is added when the current one runs out */
+	VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout dsLayout);
+
+	/* Descriptor writes are queued and submitted with a single vkUpdateDescriptorSets() call by flushDescriptorUpdates(),
+	   which VulkanRenderContext calls at the beginning of every frame */
 	void updateDescriptorSet(VkDescriptorSet ds, const DescriptorSetInfo& dsInfo);
+	void updateDescriptorSetTexture(VkDescriptorSet ds, VulkanTexture t, uint32_t textureIndex, uint32_t bindingIdx);
+
+	/* Returns the number of submitted descriptor writes */
+	uint32_t flushDescriptorUpdates();
 
 	const std::vector<VulkanTexture>& getTextures() const { return allTextures; } 
 
 	std::vector<VkFramebuffer> addFramebuffers(VkRenderPass renderPass, VkImageView depthView = VK_NULL_HANDLE);
 
+	/* Early destruction of size-dependent objects (swapchain resizes, growing buffers). The caller makes sure the GPU no longer uses them */
+	void destroyTexture(const VulkanTexture& texture);
+	void destroyFramebuffer(VkFramebuffer framebuffer);
+	void destroyBuffer(const VulkanBuffer& buffer);
+
 	/**  Helper functions for small Chapter 8/9 demos */
 	std::pair<BufferAttachment, BufferAttachment> makeMeshBuffers(const std::vector<float>& vertices, const std::vector<unsigned int>& indices);
 
@@ -247,21 +373,63 @@ private:
 	std::vector<VkDescriptorSetLayout> allDSLayouts;
 	std::vector<VkDescriptorPool>      allDPools;
 
-	std::vector<ShaderModule> shaderModules;
-	std::map<std::string, int> shaderMap;
+	struct BindingSignatureHash
+	{
+		size_t operator()(const std::vector<uint32_t>& key) const
+		{
+			size_t seed = key.size();
+			for (auto k: key)
+				seed = hashCombine(seed, k);
+			return seed;
+		}
+	};
+
+	std::unordered_map<std::vector<uint32_t>, VkDescriptorSetLayout, BindingSignatureHash> dsLayoutCache;
+	std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> dsLayoutPoolSizes;
+
+	VkDescriptorPool currentSharedDPool = VK_NULL_HANDLE;
+
+	/* Sampled and storage cube map, the layout is left undefined */
+	VulkanTexture addStorageCubeMap(uint32_t faceSize, uint32_t mipLevels, VkFormat format);
+
+	VulkanTexture prefilterCubeMap(VulkanTexture envMap, uint32_t faceSize, uint32_t mipLevels, uint32_t sampleCount, bool irradiance);
+
+	struct PendingDescriptorWrite
+	{
+		VkWriteDescriptorSet write;
+		size_t infoOffset; // in pendingBufferInfos or pendingImageInfos
+		bool isBuffer = false;
+	};
+
+	std::vector<PendingDescriptorWrite> pendingWrites;
+	std::vector<VkDescriptorBufferInfo> pendingBufferInfos;
+	std::vector<VkDescriptorImageInfo>  pendingImageInfos;
+
+	VkDescriptorPool createDescriptorPoolWithSizes(uint32_t maxSets, const VkDescriptorPoolSize* sizes, uint32_t numSizes);
+
+	// Guards shaderMap and allPipelines which are accessed from the pipeline creation jobs
+	std::mutex mutex;
+
+	// std::call_once lets exactly one thread compile a shader; the others wait for a thread which is already running,
+	// so pipeline jobs never wait for a job stuck in the queue behind them
+	struct ShaderJob
+	{
+		std::once_flag once;
+		ShaderModule module;
+		bool compiled = false;
+	};
+
+	std::map<std::string, ShaderJob> shaderMap;
+
+	// A fixed number of workers for all shader and pipeline jobs
+	tf::Executor executor;
 
 	bool createGraphicsPipeline(
 		VulkanRenderDevice& vkDev,
 		VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
 		const std::vector<const char*>& shaderFiles,
 		VkPipeline* pipeline,
-		VkPrimitiveTopology topology,
-		bool useDepth,
-		bool useBlending,
-		bool dynamicScissorState,
-		int32_t customWidth,
-		int32_t customHeight,
-		uint32_t numPatchControlPoints);
+		const PipelineInfo& pInfo);
 };
 
 /* A helper function for inplace allocation of VulkanBuffers. Helpful to avoid multiline buffer initialization in constructors */
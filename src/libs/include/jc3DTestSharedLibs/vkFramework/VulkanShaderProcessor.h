@@ -18,11 +18,45 @@ struct VulkanShaderProcessor: public Renderer
 		RenderPass screenRenderPass = RenderPass());
 
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
+	bool isStatic() const override { return true; }
+
+	/* Point the processor at re-created inputs and outputs (same layout and formats): rewrites the descriptor set and rebuilds the framebuffer */
+	void updateAttachments(const DescriptorSetInfo& dsInfo, const std::vector<VulkanTexture>& outputs);
 
 private:
 	uint32_t indexBufferSize;
 };
 
+/*
+   @brief Compute counterpart of the QuadProcessor: a single dispatch with one descriptor set
+
+   Bindings follow the DescriptorSetInfo order (buffers, then sampled textures and storage images). Push constants are optional and
+   recorded into the command buffer, so setPushConstants() re-records the commands
+*/
+struct ComputeProcessor: public Renderer
+{
+	ComputeProcessor(VulkanRenderContext& ctx,
+		const DescriptorSetInfo& dsInfo,
+		const char* shaderFile,
+		uint32_t groupsX, uint32_t groupsY = 1, uint32_t groupsZ = 1,
+		const SpecializationInfo& specialization = {},
+		const std::vector<uint8_t>& pushConstants = {},
+		const std::vector<std::string>& defines = {});
+
+	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb = VK_NULL_HANDLE, VkRenderPass rp = VK_NULL_HANDLE) override;
+	bool isStatic() const override { return true; }
+
+	/* Point the processor at re-created textures/buffers (same layout), e.g., after a resize */
+	void updateAttachments(const DescriptorSetInfo& dsInfo, uint32_t groupsX, uint32_t groupsY = 1, uint32_t groupsZ = 1);
+
+	/* 'size' must match the size given to the constructor */
+	void setPushConstants(const void* data, uint32_t size);
+
+private:
+	uint32_t groups_[3];
+	std::vector<uint8_t> pushConstants_;
+};
+
 struct QuadProcessor: public VulkanShaderProcessor
 {
 	QuadProcessor(VulkanRenderContext& ctx, const DescriptorSetInfo& dsInfo,
@@ -1,7 +1,7 @@
 #pragma once
 #include <jc3DTestSharedLibs/vkFramework/effects/LuminanceCalculator.h>
 
-#include <jc3DTestSharedLibs/vkFramework/Barriers.h>
+#include <jc3DTestSharedLibs/vkFramework/RenderGraph.h>
 
 struct HDRUniformBuffer
 {
@@ -11,147 +11,191 @@ struct HDRUniformBuffer
 	float adaptationSpeed;
 };
 
-/** Apply bloom to input buffer */
-struct HDRProcessor: public CompositeRenderer
+/* Bright-pass of the first bloom downsample (push constants of BloomDownsample.comp) */
+struct BloomParams
 {
-	HDRProcessor(VulkanRenderContext& c, VulkanTexture input, VulkanTexture avgLuminance, BufferAttachment uniformBuffer): CompositeRenderer(c),
+	float threshold = 1.0f;
+	float knee = 0.5f;
+};
 
-		brightnessTex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+// Half resolution down to 1/32
+const int BloomLevels = 5;
 
-		adaptedLuminanceTex1(c.resources.addColorTexture(1, 1, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		adaptedLuminanceTex2(c.resources.addColorTexture(1, 1, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-
-		bloomX1Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		bloomY1Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		bloomX2Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		bloomY2Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+/* Per-pixel stages fused into the final composition pass (PostComposite.comp) */
+enum PostStage: uint32_t
+{
+	ePostStage_Bloom   = 1 << 0,
+	ePostStage_Streaks = 1 << 1,
+	ePostStage_ToneMap = 1 << 2,
+	ePostStage_All     = ePostStage_Bloom | ePostStage_Streaks | ePostStage_ToneMap,
+};
 
-		streaks1Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		streaks2Tex(c.resources.addColorTexture(0, 0, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+// The composition pass writes the result as a storage image
+const VkFormat HDRResultFormat = VK_FORMAT_R8G8B8A8_UNORM;
 
+/** Apply bloom to input buffer */
+struct HDRProcessor: public RenderGraph
+{
+	/* Intermediate textures (bloom pyramid) share memory unless keepIntermediates is set, which is needed to display them.
+	   Without an avgLuminance texture the graph reduces the input luminance itself, right before the adaptation pass which consumes it.
+	   Streaks, bloom composition and tone mapping run as a single compute pass; 'postStages' selects which of them are compiled in,
+	   without bloom and streaks the bloom pyramid is culled */
+	HDRProcessor(VulkanRenderContext& c, VulkanTexture input, VulkanTexture avgLuminance, BufferAttachment uniformBuffer, bool keepIntermediates = false,
+		LuminanceReduction luminanceMode = eLuminanceReduction_LogAverage, uint32_t postStages = ePostStage_All): RenderGraph(c, "HDR"),
 		// Output is an 8-bit RGB framebuffer
 		streaksPatternTex(c.resources.loadTexture2D("data/StreaksRotationPattern.bmp")),
 
-		resultTex(c.resources.addColorTexture()),
-
-		brightness(c, DescriptorSetInfo { .textures = { fsTextureAttachment(input) } }, { brightnessTex }, "data/shaders/chapter08/VK03_BrightPass.frag"),
-
-		bloomX1(c, DescriptorSetInfo { .textures = { fsTextureAttachment(brightnessTex) } }, { bloomX1Tex }, "data/shaders/chapter08/VK03_BloomX.frag"),
-		bloomY1(c, DescriptorSetInfo { .textures = { fsTextureAttachment(   bloomX1Tex) } }, { bloomY1Tex }, "data/shaders/chapter08/VK03_BloomY.frag"),
-		bloomX2(c, DescriptorSetInfo { .textures = { fsTextureAttachment(   bloomY1Tex) } }, { bloomX2Tex }, "data/shaders/chapter08/VK03_BloomX.frag"),
-		bloomY2(c, DescriptorSetInfo { .textures = { fsTextureAttachment(   bloomX2Tex) } }, { bloomY2Tex }, "data/shaders/chapter08/VK03_BloomY.frag"),
-
-		streaks1(c, DescriptorSetInfo { .textures = { fsTextureAttachment(  bloomY2Tex), fsTextureAttachment(streaksPatternTex) } }, { streaks1Tex }, "data/shaders/chapter08/VK03_Streaks.frag"),
-		streaks2(c, DescriptorSetInfo { .textures = { fsTextureAttachment( streaks1Tex), fsTextureAttachment(streaksPatternTex) } }, { streaks2Tex }, "data/shaders/chapter08/VK03_Streaks.frag"),
-
-		adaptationEven(c, DescriptorSetInfo { .buffers = { uniformBuffer }, .textures = { fsTextureAttachment(avgLuminance), fsTextureAttachment(adaptedLuminanceTex1) } },
-			{ adaptedLuminanceTex2 }, "data/shaders/chapter08/VK03_LightAdaptation.frag"),
-		adaptationOdd(c, DescriptorSetInfo { .buffers = { uniformBuffer }, .textures = { fsTextureAttachment(avgLuminance), fsTextureAttachment(adaptedLuminanceTex2) } },
-			{ adaptedLuminanceTex1 }, "data/shaders/chapter08/VK03_LightAdaptation.frag"),
-
-		adaptation1ToColor(c, adaptedLuminanceTex1),
-		adaptation1ToShader(c, adaptedLuminanceTex1),
-
-		adaptation2ToColor(c, adaptedLuminanceTex2),
-		adaptation2ToShader(c, adaptedLuminanceTex2),
-
-		composerEven(c, DescriptorSetInfo { .buffers = { uniformBuffer }, .textures = { fsTextureAttachment(input), fsTextureAttachment(adaptedLuminanceTex2), fsTextureAttachment(streaks2Tex) } },
-			{ resultTex }, "data/shaders/chapter08/VK03_HDR.frag"),
-		composerOdd (c, DescriptorSetInfo { .buffers = { uniformBuffer }, .textures = { fsTextureAttachment(input), fsTextureAttachment(adaptedLuminanceTex1), fsTextureAttachment(streaks2Tex) } },
-			{ resultTex }, "data/shaders/chapter08/VK03_HDR.frag"),
-
-		bloomX1ToColor(c, bloomX1Tex),
-		bloomX1ToShader(c, bloomX1Tex),
-		bloomX2ToColor(c, bloomX2Tex),
-		bloomX2ToShader(c, bloomX2Tex),
-
-		bloomY1ToColor(c, bloomY1Tex),
-		bloomY1ToShader(c, bloomY1Tex),
-		bloomY2ToColor(c, bloomY2Tex),
-		bloomY2ToShader(c, bloomY2Tex),
-
-		streaks1ToColor(c, streaks1Tex),
-		streaks1ToShader(c, streaks1Tex),
-		streaks2ToColor(c, streaks2Tex),
-		streaks2ToShader(c, streaks2Tex),
-
-		brightnessToColor(c, brightnessTex),
-		brightnessToShader(c, brightnessTex),
+		adaptedLuminanceTex1(c.resources.addColorTexture(1, 1, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
+		adaptedLuminanceTex2(c.resources.addColorTexture(1, 1, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
 
-		resultToColor(c, resultTex),
-		resultToShader(c, resultTex)
+		resultTex(c.resources.addStorageTexture(0, 0, HDRResultFormat))
 	{
-		renderers_.emplace_back(brightnessToColor, false);
-		renderers_.emplace_back(brightness, false);
-		renderers_.emplace_back(brightnessToShader, false);
-
-		renderers_.emplace_back(bloomX1ToColor, false);
-		renderers_.emplace_back(bloomX1, false);
-		renderers_.emplace_back(bloomX1ToShader, false);
-
-		renderers_.emplace_back(bloomY1ToColor, false);
-		renderers_.emplace_back(bloomY1, false);
-		renderers_.emplace_back(bloomY1ToShader, false);
-
-		renderers_.emplace_back(bloomX2ToColor, false);
-		renderers_.emplace_back(bloomX2, false);
-		renderers_.emplace_back(bloomX2ToShader, false);
+		inputH = importTexture("HDRInput", input);
+		const bool ownLuminance = (avgLuminance.image.image == VK_NULL_HANDLE);
+		const uint32_t avgLumH  = ownLuminance ? addTransientTexture("AvgLuminance", 1, 1, LuminosityFormat) : importTexture("AvgLuminance", avgLuminance);
+		const uint32_t patternH = importTexture("StreaksPattern", streaksPatternTex);
+		const uint32_t adapted1 = importTexture("AdaptedLuminance1", adaptedLuminanceTex1);
+		const uint32_t adapted2 = importTexture("AdaptedLuminance2", adaptedLuminanceTex2);
+		resultH = importTexture("HDRResult", resultTex);
+
+		for (int i = 0; i != BloomLevels; i++)
+			bloomH[i] = addScaledTransientTexture(("Bloom" + std::to_string(i)).c_str(), i + 1, LuminosityFormat);
+
+		// Compute bloom pyramid: the bright-pass is fused into the first downsample, then every level adds the tent-filtered smaller one
+		const BloomParams bloomParams;
+		const std::vector<uint8_t> bloomConstants((const uint8_t*)&bloomParams, (const uint8_t*)&bloomParams + sizeof(bloomParams));
+
+		for (int i = 0; i != BloomLevels; i++)
+		{
+			const uint32_t pass = addComputePass(("BloomDown" + std::to_string(i)).c_str(), { rgSampledCompute(i ? bloomH[i - 1] : inputH), rgStorageWrite(bloomH[i]) },
+				"data/shaders/chapter08/BloomDownsample.comp", 8, 8, SpecializationInfo().add(0, i == 0), bloomConstants);
+
+			if (i == 0)
+				brightPass = pass;
+		}
+
+		for (int i = BloomLevels - 2; i >= 0; i--)
+		{
+			// The sum of all levels is averaged in the last step
+			const float scale = i ? 1.0f : 1.0f / BloomLevels;
+			const std::vector<uint8_t> upConstants((const uint8_t*)&scale, (const uint8_t*)&scale + sizeof(scale));
+
+			addComputePass(("BloomUp" + std::to_string(i)).c_str(), { rgSampledCompute(bloomH[i + 1]), rgStorageReadWrite(bloomH[i]) },
+				"data/shaders/chapter08/BloomUpsample.comp", 8, 8, {}, upConstants);
+		}
+
+		if (ownLuminance)
+			luminancePass = addLuminanceReductionPass(*this, c, inputH, avgLumH, luminanceMode, LuminanceParams {});
+
+		// Light adaptation and composition ping-pong between the two adapted luminance textures
+		adaptationEven = addQuadPass("AdaptationEven", { avgLumH, adapted1 }, adapted2, "data/shaders/chapter08/VK03_LightAdaptation.frag", uniformBuffer);
+		adaptationOdd  = addQuadPass("AdaptationOdd",  { avgLumH, adapted2 }, adapted1, "data/shaders/chapter08/VK03_LightAdaptation.frag", uniformBuffer);
+
+		// The streaks are taken from the half-resolution bloom inside the composition, so the full-size scene is read once and the result written once
+		hasBloom = (postStages & (ePostStage_Bloom | ePostStage_Streaks)) != 0;
+		bloomEnabled = hasBloom;
+
+		BufferAttachment composerUniform = uniformBuffer;
+		composerUniform.dInfo.shaderStageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		const auto addComposer = [&](const char* name, uint32_t adaptedH, uint32_t stages) {
+			// Without bloom the scene stands in for the unused binding, so the pyramid is not consumed
+			const uint32_t glowH = (stages & (ePostStage_Bloom | ePostStage_Streaks)) ? bloomH[0] : inputH;
+
+			return addComputePass(name,
+				{ rgSampledCompute(inputH), rgSampledCompute(adaptedH), rgSampledCompute(glowH), rgSampledCompute(patternH), rgStorageWrite(resultH) },
+				"data/shaders/chapter08/PostComposite.comp", 8, 8,
+				SpecializationInfo()
+					.add(0, (stages & ePostStage_Bloom) != 0)
+					.add(1, (stages & ePostStage_Streaks) != 0)
+					.add(2, (stages & ePostStage_ToneMap) != 0),
+				{}, composerUniform);
+		};
+
+		if (hasBloom)
+		{
+			composerEven = addComposer("ComposerEven", adapted2, postStages);
+			composerOdd  = addComposer("ComposerOdd",  adapted1, postStages);
+		}
+
+		// Used while bloom is switched off at run time: the pyramid feeds no enabled pass and is skipped
+		plainComposerEven = addComposer("PlainComposerEven", adapted2, postStages & ePostStage_ToneMap);
+		plainComposerOdd  = addComposer("PlainComposerOdd",  adapted1, postStages & ePostStage_ToneMap);
+
+		updatePassStates();
+
+		markOutput(resultH);
+		markOutput(adapted1);
+		markOutput(adapted2);
+
+		if (keepIntermediates)
+		{
+			for (uint32_t h: bloomH)
+				markOutput(h);
+		}
+
+		compile();
 
-		renderers_.emplace_back(bloomY2ToColor, false);
-		renderers_.emplace_back(bloomY2, false);
-		renderers_.emplace_back(bloomY2ToShader, false);
-
-		renderers_.emplace_back(streaks1ToColor, false);
-		renderers_.emplace_back(streaks1, false);
-		renderers_.emplace_back(streaks1ToShader, false);
+		// Convert 32.0 to S5.10 fixed point format (half-float) manually for RGB channels, Set alpha to 1.0
+//		const uint16_t brightPixel[4] = { 0x5400, 0x5400, 0x5400, 0x3C00 }; // 64.0 as initial value
+		const uint16_t brightPixel[4] = { 0x5000, 0x5000, 0x5000, 0x3C00 }; // 32.0 as initial value
+		updateTextureImage(c.vkDev, adaptedLuminanceTex1.image.image, adaptedLuminanceTex1.image.imageMemory, 1, 1, LuminosityFormat, 1, &brightPixel, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		updateTextureImage(c.vkDev, adaptedLuminanceTex2.image.image, adaptedLuminanceTex2.image.imageMemory, 1, 1, LuminosityFormat, 1, &brightPixel, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
 
-		renderers_.emplace_back(streaks2ToColor, false);
-		renderers_.emplace_back(streaks2, false);
-		renderers_.emplace_back(streaks2ToShader, false);
+	/* The input was re-created for a new framebuffer size: the result texture and the intermediates follow it.
+	   Renderers sampling getResult() have to be updated afterwards */
+	void resize(VulkanTexture input)
+	{
+		ctx_.resources.destroyTexture(resultTex);
+		resultTex = ctx_.resources.addStorageTexture(0, 0, HDRResultFormat);
 
-		renderers_.emplace_back(adaptation2ToColor, false);  // 21
-		renderers_.emplace_back(adaptationEven, false);      // 22
-		renderers_.emplace_back(adaptation2ToShader, false); // 23
+		setImportedTexture(inputH, input);
+		setImportedTexture(resultH, resultTex);
 
-		renderers_.emplace_back(adaptation1ToColor, false);  // 24
-		renderers_.emplace_back(adaptationOdd, false);       // 25
-		renderers_.emplace_back(adaptation1ToShader, false); // 26
+		rebuild();
+	}
 
-		renderers_[21].enabled_ = false; // disable adaptationProcessor at the beginning
-		renderers_[22].enabled_ = false;
-		renderers_[23].enabled_ = false;
+	void setBloomParams(const BloomParams& params)
+	{
+		// The pyramid is culled without bloom and streaks
+		if (Renderer* r = getPassRenderer(brightPass))
+			static_cast<ComputeProcessor*>(r)->setPushConstants(&params, sizeof(params));
+	}
 
-		renderers_.emplace_back(resultToColor, false); // 27
-		renderers_.emplace_back(composerEven, false);  // 28
-		renderers_.emplace_back(composerOdd, false);   // 29
-		renderers_[29].enabled_ = false; // disable composerOdd at the beginning
+	/* Removes all bloom and streak work from the frame, including the pyramid; only if they were compiled in */
+	void setBloomEnabled(bool enabled)
+	{
+		bloomEnabled = enabled && hasBloom;
+		updatePassStates();
+	}
 
-		renderers_.emplace_back(resultToShader, false);
+	inline bool isBloomEnabled() const { return bloomEnabled; }
 
-		// Convert 32.0 to S5.10 fixed point format (half-float) manually for RGB channels, Set alpha to 1.0
-//		const uint16_t brightPixel[4] = { 0x5400, 0x5400, 0x5400, 0x3C00 }; // 64.0 as initial value
-		const uint16_t brightPixel[4] = { 0x5000, 0x5000, 0x5000, 0x3C00 }; // 32.0 as initial value
-		updateTextureImage(c.vkDev, adaptedLuminanceTex1.image.image, adaptedLuminanceTex1.image.imageMemory, 1, 1, LuminosityFormat, 1, &brightPixel, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		updateTextureImage(c.vkDev, adaptedLuminanceTex2.image.image, adaptedLuminanceTex2.image.imageMemory, 1, 1, LuminosityFormat, 1, &brightPixel, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	/* Only with the luminance reduction inside the graph (no avgLuminance texture) */
+	void setLuminanceParams(const LuminanceParams& params)
+	{
+		if (luminancePass != ~0u)
+			static_cast<ComputeProcessor*>(getPassRenderer(luminancePass))->setPushConstants(&params, sizeof(params));
 	}
 
+	// The adaptation ping-pong flips every frame, so the recorded commands cannot be reused
+	bool isStatic() const override { return false; }
+
 	void fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb1 = VK_NULL_HANDLE, VkRenderPass rp1 = VK_NULL_HANDLE) override
 	{
 		// Call base method
-		CompositeRenderer::fillCommandBuffer(cmdBuffer, currentImage, fb1, rp1);
+		RenderGraph::fillCommandBuffer(cmdBuffer, currentImage, fb1, rp1);
 		// Swap avgLuminance inputs for adaptation and composer
-		static const std::vector<int> switchIndices { 21, 22, 23, 24, 25, 26, 28, 29 };
-		for (auto i: switchIndices)
-			renderers_[i].enabled_ = !renderers_[i].enabled_;
+		evenFrame = !evenFrame;
+		updatePassStates();
 	}
 
-	inline VulkanTexture getBloom1() const { return bloomY1Tex; }
-	inline VulkanTexture getBloom2() const { return bloomY2Tex; }
-
-	inline VulkanTexture getBrightness() const { return brightnessTex; }
-
-	inline VulkanTexture getStreaks1() const { return streaks1Tex; }
-	inline VulkanTexture getStreaks2() const { return streaks2Tex; }
+	// Unless keepIntermediates was set, these textures alias each other and are only valid inside the graph
+	// Half resolution, the sum of all pyramid levels
+	inline VulkanTexture getBloom() const { return getTexture(bloomH[0]); }
+	// Before the upsampling the levels hold the bright-passed input at 1/2, 1/4 ... of the framebuffer size
+	inline VulkanTexture getBloomLevel(int level) const { return getTexture(bloomH[level]); }
 
 	inline VulkanTexture getAdaptatedLum1() const { return adaptedLuminanceTex1; }
 	inline VulkanTexture getAdaptatedLum2() const { return adaptedLuminanceTex2; }
@@ -162,69 +206,44 @@ private:
 	// Static texture with rotation pattern
 	VulkanTexture streaksPatternTex;
 
-	// Texture with values above 1.0
-	VulkanTexture brightnessTex;
-
 	// The ping-pong texture pair for adapted luminances
 	VulkanTexture adaptedLuminanceTex1, adaptedLuminanceTex2;
 
-	// First pass of blurring
-	VulkanTexture bloomX1Tex;
-	VulkanTexture bloomY1Tex;
-
-	// Second pass of blurring
-	VulkanTexture bloomX2Tex;
-	VulkanTexture bloomY2Tex;
-
-	VulkanTexture streaks1Tex;
-	VulkanTexture streaks2Tex;
-
 	// Composed Source + Brightness
 	VulkanTexture resultTex;
 
-	QuadProcessor brightness;
-
-	QuadProcessor bloomX1;
-	QuadProcessor bloomY1;
-	QuadProcessor bloomX2;
-	QuadProcessor bloomY2;
+	uint32_t inputH, resultH;
 
-	QuadProcessor streaks1;
-	QuadProcessor streaks2;
+	// Bloom pyramid (values above the threshold, blurred)
+	uint32_t bloomH[BloomLevels];
 
-	// Light Adaptation processing
-	QuadProcessor adaptationEven;
-	QuadProcessor adaptationOdd;
+	uint32_t brightPass;
 
-	ShaderOptimalToColorBarrier adaptation1ToColor;
-	ColorToShaderOptimalBarrier adaptation1ToShader;
+	uint32_t luminancePass = ~0u;
 
-	ShaderOptimalToColorBarrier adaptation2ToColor;
-	ColorToShaderOptimalBarrier adaptation2ToShader;
+	uint32_t adaptationEven, adaptationOdd;
+	// With bloom and streaks (only if compiled in) and without them
+	uint32_t composerEven = ~0u, composerOdd = ~0u;
+	uint32_t plainComposerEven, plainComposerOdd;
 
-	// Final composition
-	QuadProcessor composerEven;
-	QuadProcessor composerOdd;
+	bool hasBloom = false;
+	bool bloomEnabled = false;
 
-	// barriers
-	ShaderOptimalToColorBarrier bloomX1ToColor;
-	ColorToShaderOptimalBarrier bloomX1ToShader;
-	ShaderOptimalToColorBarrier bloomX2ToColor;
-	ColorToShaderOptimalBarrier bloomX2ToShader;
+	// AdaptationOdd and a composer 'Even' pass run in odd frames, starting with the first one
+	bool evenFrame = false;
 
-	ShaderOptimalToColorBarrier bloomY1ToColor;
-	ColorToShaderOptimalBarrier bloomY1ToShader;
-	ShaderOptimalToColorBarrier bloomY2ToColor;
-	ColorToShaderOptimalBarrier bloomY2ToShader;
-
-	ShaderOptimalToColorBarrier streaks1ToColor;
-	ColorToShaderOptimalBarrier streaks1ToShader;
-	ShaderOptimalToColorBarrier streaks2ToColor;
-	ColorToShaderOptimalBarrier streaks2ToShader;
+	void updatePassStates()
+	{
+		setPassEnabled(adaptationEven, evenFrame);
+		setPassEnabled(adaptationOdd, !evenFrame);
 
-	ShaderOptimalToColorBarrier brightnessToColor;
-	ColorToShaderOptimalBarrier brightnessToShader;
+		if (hasBloom)
+		{
+			setPassEnabled(composerEven, bloomEnabled && !evenFrame);
+			setPassEnabled(composerOdd,  bloomEnabled && evenFrame);
+		}
 
-	ShaderOptimalToColorBarrier resultToColor;
-	ColorToShaderOptimalBarrier resultToShader;
+		setPassEnabled(plainComposerEven, !bloomEnabled && !evenFrame);
+		setPassEnabled(plainComposerOdd,  !bloomEnabled && evenFrame);
+	}
 };
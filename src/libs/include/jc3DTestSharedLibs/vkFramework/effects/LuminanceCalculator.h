@@ -1,131 +1,82 @@
 #pragma once
-#include <jc3DTestSharedLibs/vkFramework/CompositeRenderer.h>
-#include <jc3DTestSharedLibs/vkFramework/VulkanShaderProcessor.h>
-#include <jc3DTestSharedLibs/vkFramework/Barriers.h>
+#include <jc3DTestSharedLibs/vkFramework/RenderGraph.h>
 
 const VkFormat LuminosityFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
 
+// Grid of samples laid over the source by the reduction
 const int LuminosityWidth  = 64;
 const int LuminosityHeight = 64;
 
-struct LuminanceCalculator: public CompositeRenderer
+enum LuminanceReduction: uint32_t
 {
-	LuminanceCalculator(VulkanRenderContext& c, VulkanTexture sourceTex, VulkanTexture lumTex): CompositeRenderer(c), source(sourceTex),
+	eLuminanceReduction_LogAverage = 0, // exp(mean(log(L)))
+	eLuminanceReduction_Histogram  = 1, // mean of a log2 histogram between two percentiles, small very dark or very bright areas are ignored
+};
+
+/* Push constants of LuminanceReduction.comp. The range and the percentiles are only used by the histogram */
+struct LuminanceParams
+{
+	float minLogLum = -10.0f;
+	float logLumRange = 22.0f;
+	float lowPercentile = 0.5f;
+	float highPercentile = 0.95f;
+};
+
+/* Single-dispatch reduction of 'source' into the 1x1 'result' (luminance in RGB); returns the pass.
+   Subgroup arithmetic is used where the device supports it in compute shaders, a shared memory tree otherwise */
+inline uint32_t addLuminanceReductionPass(RenderGraph& graph, VulkanRenderContext& ctx, uint32_t sourceH, uint32_t resultH, LuminanceReduction mode, const LuminanceParams& params)
+{
+	static_assert(LuminosityWidth == LuminosityHeight, "The reduction uses a square grid");
 
-		lumTex64(c.resources.addColorTexture(LuminosityWidth, LuminosityHeight, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex32(c.resources.addColorTexture(LuminosityWidth /  2, LuminosityHeight /  2, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex16(c.resources.addColorTexture(LuminosityWidth /  4, LuminosityHeight /  4, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex08(c.resources.addColorTexture(LuminosityWidth /  8, LuminosityHeight /  8, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex04(c.resources.addColorTexture(LuminosityWidth / 16, LuminosityHeight / 16, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex02(c.resources.addColorTexture(LuminosityWidth / 32, LuminosityHeight / 32, LuminosityFormat, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE)),
-		lumTex01(lumTex),
+	const std::vector<uint8_t> pushConstants((const uint8_t*)&params, (const uint8_t*)&params + sizeof(params));
 
-		src_To_64  (c, DescriptorSetInfo { .textures = { fsTextureAttachment(source)   } }, { lumTex64 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum64_To_32(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex64) } }, { lumTex32 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum32_To_16(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex32) } }, { lumTex16 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum16_To_08(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex16) } }, { lumTex08 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum08_To_04(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex08) } }, { lumTex04 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum04_To_02(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex04) } }, { lumTex02 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
-		lum02_To_01(c, DescriptorSetInfo { .textures = { fsTextureAttachment(lumTex02) } }, { lumTex01 }, "data/shaders/chapter08/VK03_downscale2x2.frag"),
+	// A define, not a specialization constant: the subgroup capabilities must not even be declared where they are unsupported
+	std::vector<std::string> defines;
+	if (isSubgroupArithmeticSupported(ctx.vkDev.physicalDevice))
+		defines.push_back("SUBGROUP_REDUCTION");
 
-		lum64ToColor(c,  lumTex64),
-		lum64ToShader(c, lumTex64),
+	// A 1x1 output and 256 invocations: a single workgroup
+	return graph.addComputePass("LuminanceReduction", { rgSampledCompute(sourceH), rgStorageWrite(resultH) },
+		"data/shaders/chapter08/LuminanceReduction.comp", 256, 1,
+		SpecializationInfo().add(0, mode == eLuminanceReduction_Histogram).add(1, (uint32_t)LuminosityWidth), pushConstants, BufferAttachment {}, defines);
+}
 
-		lum32ToColor(c,  lumTex32),
-		lum32ToShader(c, lumTex32),
+struct LuminanceCalculator: public RenderGraph
+{
+	LuminanceCalculator(VulkanRenderContext& c, VulkanTexture sourceTex, LuminanceReduction mode = eLuminanceReduction_LogAverage, const LuminanceParams& params = {}):
+		RenderGraph(c, "Luminance"), source(sourceTex)
+	{
+		sourceH = importTexture("LuminanceSource", source);
+		lum01H  = addTransientTexture("lum01", 1, 1, LuminosityFormat);
 
-		lum16ToColor(c,  lumTex16),
-		lum16ToShader(c, lumTex16),
+		reductionPass = addLuminanceReductionPass(*this, c, sourceH, lum01H, mode, params);
 
-		lum08ToColor(c,  lumTex08),
-		lum08ToShader(c, lumTex08),
+		markOutput(lum01H);
 
-		lum04ToColor(c,  lumTex04),
-		lum04ToShader(c, lumTex04),
+		compile();
+	}
 
-		lum02ToColor(c,  lumTex02),
-		lum02ToShader(c, lumTex02),
+	/* The source was re-created for a new framebuffer size */
+	void setSource(VulkanTexture sourceTex)
+	{
+		source = sourceTex;
+		setImportedTexture(sourceH, source);
+		rebuild();
+	}
 
-		lum01ToColor(c,  lumTex01),
-		lum01ToShader(c, lumTex01)
+	void setParams(const LuminanceParams& params)
 	{
-		setVkImageName(c.vkDev, lumTex64.image.image, "lum64");
-		setVkImageName(c.vkDev, lumTex32.image.image, "lum32");
-		setVkImageName(c.vkDev, lumTex16.image.image, "lum16");
-		setVkImageName(c.vkDev, lumTex08.image.image, "lum08");
-		setVkImageName(c.vkDev, lumTex04.image.image, "lum04");
-		setVkImageName(c.vkDev, lumTex02.image.image, "lum02");
-
-///	VulkanTexture addColorTexture(int texWidth = 0, int texHeight = 0, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM, VkFilter minFilter = VK_FILTER_LINEAR, VkFilter maxFilter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
-
-		renderers_.emplace_back(lum64ToColor,  false);
-		renderers_.emplace_back(src_To_64,   false);
-		renderers_.emplace_back(lum64ToShader,  false);
-
-		renderers_.emplace_back(lum32ToColor,  false);
-		renderers_.emplace_back(lum64_To_32,   false);
-		renderers_.emplace_back(lum32ToShader, false);
-
-		renderers_.emplace_back(lum16ToColor,  false);
-		renderers_.emplace_back(lum32_To_16,   false);
-		renderers_.emplace_back(lum16ToShader, false);
-
-		renderers_.emplace_back(lum08ToColor, false);
-		renderers_.emplace_back(lum16_To_08, false);
-		renderers_.emplace_back(lum08ToShader, false);
-
-		renderers_.emplace_back(lum04ToColor, false);
-		renderers_.emplace_back(lum08_To_04, false);
-		renderers_.emplace_back(lum04ToShader, false);
-
-		renderers_.emplace_back(lum02ToColor, false);
-		renderers_.emplace_back(lum04_To_02, false);
-		renderers_.emplace_back(lum02ToShader, false);
-
-		renderers_.emplace_back(lum01ToColor, false);
-		renderers_.emplace_back(lum02_To_01, false);
-		renderers_.emplace_back(lum01ToShader, false);
+		static_cast<ComputeProcessor*>(getPassRenderer(reductionPass))->setPushConstants(&params, sizeof(params));
 	}
 
-	inline VulkanTexture getResult64() const { return lumTex64; }
-	inline VulkanTexture getResult32() const { return lumTex32; }
-	inline VulkanTexture getResult16() const { return lumTex16; }
-	inline VulkanTexture getResult08() const { return lumTex08; }
-	inline VulkanTexture getResult04() const { return lumTex04; }
-	inline VulkanTexture getResult02() const { return lumTex02; }
-	inline VulkanTexture getResult01() const { return lumTex01; }
+	// 1x1 texture with the average luminance, owned by the graph
+	inline VulkanTexture getResult01() const { return getTexture(lum01H); }
 
 private:
 	VulkanTexture source;
 
-	VulkanTexture lumTex64;
-	VulkanTexture lumTex32;
-	VulkanTexture lumTex16;
-	VulkanTexture lumTex08;
-	VulkanTexture lumTex04;
-	VulkanTexture lumTex02;
-	VulkanTexture lumTex01;
-
-	QuadProcessor src_To_64;
-	QuadProcessor lum64_To_32;
-	QuadProcessor lum32_To_16;
-	QuadProcessor lum16_To_08;
-	QuadProcessor lum08_To_04;
-	QuadProcessor lum04_To_02;
-	QuadProcessor lum02_To_01;
-
-	ShaderOptimalToColorBarrier lum64ToColor;
-	ColorToShaderOptimalBarrier lum64ToShader;
-	ShaderOptimalToColorBarrier lum32ToColor;
-	ColorToShaderOptimalBarrier lum32ToShader;
-	ShaderOptimalToColorBarrier lum16ToColor;
-	ColorToShaderOptimalBarrier lum16ToShader;
-	ShaderOptimalToColorBarrier lum08ToColor;
-	ColorToShaderOptimalBarrier lum08ToShader;
-	ShaderOptimalToColorBarrier lum04ToColor;
-	ColorToShaderOptimalBarrier lum04ToShader;
-	ShaderOptimalToColorBarrier lum02ToColor;
-	ColorToShaderOptimalBarrier lum02ToShader;
-	ShaderOptimalToColorBarrier lum01ToColor;
-	ColorToShaderOptimalBarrier lum01ToShader;
+	uint32_t sourceH;
+	uint32_t lum01H;
+
+	uint32_t reductionPass;
 };
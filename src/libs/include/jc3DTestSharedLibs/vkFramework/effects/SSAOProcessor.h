@@ -1,71 +1,157 @@
 #pragma once
-#include <jc3DTestSharedLibs/vkFramework/CompositeRenderer.h>
-#include <jc3DTestSharedLibs/vkFramework/VulkanShaderProcessor.h>
+#include <jc3DTestSharedLibs/vkFramework/RenderGraph.h>
 
-#include <jc3DTestSharedLibs/vkFramework/Barriers.h>
+#include <glm/glm.hpp>
 
-const int SSAOWidth = 0; // smaller SSAO buffer can be used 512
-const int SSAOHeight = 0; // 512;
+#include <algorithm>
 
-struct SSAOProcessor: public CompositeRenderer
+// rgba8 rather than the swapchain-like BGRA default: the blur and the upsample write them as storage images
+const VkFormat SSAOFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+struct SSAOProcessor: public RenderGraph
 {
-	SSAOProcessor(VulkanRenderContext&ctx, VulkanTexture colorTex, VulkanTexture depthTex, VulkanTexture outputTex):
-		CompositeRenderer(ctx),
+	/* resolutionShift: 0 - full, 1 - half, 2 - quarter resolution. At reduced resolution the depth is downsampled first,
+	   the occlusion and the bilateral blur run on the small buffers and a joint bilateral upsample brings the result back.
+	   temporal: a few jittered samples per frame are accumulated in history buffers. Requires setCameraMatrices() every frame */
+	SSAOProcessor(VulkanRenderContext&ctx, VulkanTexture colorTex, VulkanTexture depthTex, VulkanTexture outputTex, uint32_t resolutionShift = 0, bool temporal = false):
+		RenderGraph(ctx, "SSAO"),
 
 		rotateTex(ctx.resources.loadTexture2D("data/rot_texture.bmp")),
-		SSAOTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight)),
-		SSAOBlurXTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight)),
-		SSAOBlurYTex(ctx.resources.addColorTexture(SSAOWidth, SSAOHeight)),
 
-		SSAOParamBuffer(mappedUniformBufferAttachment(ctx.resources, &params, VK_SHADER_STAGE_FRAGMENT_BIT)),
+		SSAOParamBuffer(mappedUniformBufferAttachment(ctx.resources, &params, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)),
+
+		shift(resolutionShift),
+		temporal(temporal)
+	{
+		setVkImageName(ctx_.vkDev, rotateTex.image.image, "rotateTex");
+
+		colorH  = importTexture("SSAOColor", colorTex);
+		depthH  = importTexture("SSAODepth", depthTex);
+		const uint32_t rotateH = importTexture("SSAORotation", rotateTex);
+		outputH = importTexture("SSAOOutput", outputTex);
+
+		SSAOH      = addScaledTransientTexture("SSAO",      shift, SSAOFormat);
+		SSAOBlurXH = addScaledTransientTexture("SSAOBlurX", shift, SSAOFormat);
+		SSAOBlurYH = addScaledTransientTexture("SSAOBlurY", shift, SSAOFormat);
+
+		// The depth the occlusion is computed from: the original one at full resolution
+		depthLowH = depthH;
+		upsampledH = SSAOBlurYH;
+
+		if (shift > 0)
+		{
+			depthLowH  = addScaledTransientTexture("SSAODepthLow", shift, VK_FORMAT_R32_SFLOAT, VK_FILTER_NEAREST);
+			upsampledH = addTransientTexture("SSAOUpsampled", 0, 0, SSAOFormat);
+
+			addComputePass("DepthDownsample", { rgSampledCompute(depthH), rgStorageWrite(depthLowH) },
+				"data/shaders/chapter08/DepthDownsample.comp", 8, 8, SpecializationInfo().add(0, 1 << shift));
+		}
+
+		addQuadPass("SSAO", { depthLowH, rotateH }, SSAOH,
+			temporal ? "data/shaders/chapter08/SSAOTemporal.frag" : "data/shaders/chapter08/VK02_SSAO.frag", SSAOParamBuffer);
+
+		// The blur input
+		uint32_t aoH = SSAOH;
+
+		if (temporal)
+		{
+			createHistory();
+
+			historyAOH    = importTexture("SSAOHistory",      historyAO);
+			historyDepthH = importTexture("SSAOHistoryDepth", historyDepth);
+			accumH = addScaledTransientTexture("SSAOAccum", shift, SSAOFormat);
+
+			addComputePass("Accumulate",
+				{ rgSampledCompute(SSAOH), rgSampledCompute(depthLowH), rgSampledCompute(historyAOH), rgSampledCompute(historyDepthH), rgStorageWrite(accumH) },
+				"data/shaders/chapter08/SSAOAccumulate.comp", 8, 8, {}, {}, SSAOParamBuffer);
+			addComputePass("History",
+				{ rgSampledCompute(accumH), rgSampledCompute(depthLowH), rgStorageWrite(historyAOH), rgStorageWrite(historyDepthH) },
+				"data/shaders/chapter08/SSAOHistory.comp", 8, 8, {}, {}, SSAOParamBuffer);
+
+			// Written for the next frame
+			markOutput(historyAOH);
+			markOutput(historyDepthH);
 
-		SSAO(ctx,  { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(depthTex), fsTextureAttachment(rotateTex) } },
-			{ SSAOTex }, "data/shaders/chapter08/VK02_SSAO.frag"),
-		BlurX(ctx, { .textures = { fsTextureAttachment(SSAOTex) } },
-			{ SSAOBlurXTex }, "data/shaders/chapter08/VK02_SSAOBlurX.frag"),
-		BlurY(ctx, { .textures = { fsTextureAttachment(SSAOBlurXTex) } },
-			{ SSAOBlurYTex }, "data/shaders/chapter08/VK02_SSAOBlurY.frag"),
-		SSAOFinal(ctx, { .buffers = { SSAOParamBuffer }, .textures = { fsTextureAttachment(colorTex), fsTextureAttachment(SSAOBlurYTex) } },
-			{ outputTex }, "data/shaders/chapter08/VK02_SSAOFinal.frag"),
+			aoH = accumH;
+		}
 
-		ssaoColorToShader(ctx_, SSAOTex),
-		ssaoShaderToColor(ctx_, SSAOTex),
+		addComputePass("BlurX", { rgSampledCompute(aoH), rgSampledCompute(depthLowH), rgStorageWrite(SSAOBlurXH) },
+			"data/shaders/chapter08/SSAOBlur.comp", 8, 8, SpecializationInfo().add(0, false), {}, SSAOParamBuffer);
+		addComputePass("BlurY", { rgSampledCompute(SSAOBlurXH), rgSampledCompute(depthLowH), rgStorageWrite(SSAOBlurYH) },
+			"data/shaders/chapter08/SSAOBlur.comp", 8, 8, SpecializationInfo().add(0, true), {}, SSAOParamBuffer);
 
-		blurXColorToShader(ctx_, SSAOBlurXTex),
-		blurXShaderToColor(ctx_, SSAOBlurXTex),
+		if (shift > 0)
+			addComputePass("Upsample", { rgSampledCompute(SSAOBlurYH), rgSampledCompute(depthLowH), rgSampledCompute(depthH), rgStorageWrite(upsampledH) },
+				"data/shaders/chapter08/SSAOUpsample.comp", 8, 8, {}, {}, SSAOParamBuffer);
 
-		blurYColorToShader(ctx_, SSAOBlurYTex),
-		blurYShaderToColor(ctx_, SSAOBlurYTex),
+		addQuadPass("SSAOFinal", { colorH, upsampledH }, outputH, "data/shaders/chapter08/VK02_SSAOFinal.frag", SSAOParamBuffer);
 
-		finalColorToShader(ctx_, outputTex),
-		finalShaderToColor(ctx_, outputTex)
+		markOutput(outputH);
+
+		compile();
+	}
+
+	/* The scene targets were re-created for a new framebuffer size */
+	void resize(VulkanTexture colorTex, VulkanTexture depthTex, VulkanTexture outputTex)
 	{
-		setVkImageName(ctx_.vkDev, rotateTex.image.image, "rotateTex");
-		setVkImageName(ctx_.vkDev, SSAOTex.image.image, "SSAO");
-		setVkImageName(ctx_.vkDev, SSAOBlurXTex.image.image, "SSAOBlurX");
-		setVkImageName(ctx_.vkDev, SSAOBlurYTex.image.image, "SSAOBlurY");
+		setImportedTexture(colorH, colorTex);
+		setImportedTexture(depthH, depthTex);
+		setImportedTexture(outputH, outputTex);
+
+		if (temporal)
+		{
+			ctx_.resources.destroyTexture(historyAO);
+			ctx_.resources.destroyTexture(historyDepth);
+			createHistory();
+			setImportedTexture(historyAOH, historyAO);
+			setImportedTexture(historyDepthH, historyDepth);
+		}
+
+		rebuild();
+	}
 
-		renderers_.emplace_back(ssaoShaderToColor, false);
-		renderers_.emplace_back(blurXShaderToColor, false);
-		renderers_.emplace_back(blurYShaderToColor, false);
-		renderers_.emplace_back(finalShaderToColor, false);
+	/* Camera of the frame which is about to be rendered; the history is reprojected with the motion since the previous frame.
+	   The history is only used in frames for which this was called, and called for the previous frame as well */
+	void setCameraMatrices(const glm::mat4& proj, const glm::mat4& view)
+	{
+		const glm::mat4 viewProj = proj * view;
 
-		renderers_.emplace_back(SSAO, false);
-		renderers_.emplace_back(ssaoColorToShader, false);
+		reprojectionValid = hasPrevViewProj;
+		params->reprojection = hasPrevViewProj ? prevViewProj * glm::inverse(viewProj) : glm::mat4(1.0f);
 
-		renderers_.emplace_back(BlurX, false);
-		renderers_.emplace_back(blurXColorToShader, false);
+		prevViewProj = viewProj;
+		hasPrevViewProj = true;
+		cameraSupplied = true;
+	}
 
-		renderers_.emplace_back(BlurY, false);
-		renderers_.emplace_back(blurYColorToShader, false);
+	/* Discard the accumulated occlusion, e.g., after a camera cut */
+	void resetHistory() { framesAccumulated = 0; }
 
-		renderers_.emplace_back(SSAOFinal, false);
-		renderers_.emplace_back(finalColorToShader, false);
+	void updateBuffers(size_t currentImage) override
+	{
+		// A frame without camera matrices breaks the chain of reprojections
+		if (!cameraSupplied)
+			hasPrevViewProj = false;
+
+		// The first frame only initializes the history
+		params->frameIndex++;
+		params->historyValid = (temporal && cameraSupplied && reprojectionValid && framesAccumulated++ > 0) ? 1 : 0;
+
+		cameraSupplied = false;
+
+		RenderGraph::updateBuffers(currentImage);
 	}
 
-	inline VulkanTexture getSSAO()   const { return SSAOTex; }
-	inline VulkanTexture getBlurX()  const { return SSAOBlurXTex; }
-	inline VulkanTexture getBlurY()  const { return SSAOBlurYTex; }
+	// Intermediate textures share memory and are only valid inside the graph
+	inline VulkanTexture getSSAO()   const { return getTexture(SSAOH); }
+	inline VulkanTexture getBlurX()  const { return getTexture(SSAOBlurXH); }
+	inline VulkanTexture getBlurY()  const { return getTexture(SSAOBlurYH); }
+	// At full resolution these are getBlurY() and the scene depth
+	inline VulkanTexture getUpsampled() const { return getTexture(upsampledH); }
+	inline VulkanTexture getDepthLow()  const { return getTexture(depthLowH); }
+
+	inline uint32_t getResolutionShift() const { return shift; }
+	inline bool isTemporal() const { return temporal; }
 
 	struct Params
 	{
@@ -76,25 +162,47 @@ struct SSAOProcessor: public CompositeRenderer
 		float radius = 0.2f;
 		float attScale = 1.0f;
 		float distScale = 0.5f;
+
+		// Temporal accumulation; the history is mixed with 'historyFeedback' unless the relative difference
+		// between its depth and the reprojected depth exceeds 'disocclusionThreshold'
+		uint32_t frameIndex = 0;
+		uint32_t samplesPerFrame = 4;
+		float historyFeedback = 0.9f;
+		float disocclusionThreshold = 0.05f;
+		uint32_t historyValid = 0;
+		glm::mat4 reprojection = glm::mat4(1.0f);
 	} *params;
 
 private:
 	VulkanTexture rotateTex;
-	VulkanTexture SSAOTex, SSAOBlurXTex, SSAOBlurYTex;
+	uint32_t colorH, depthH, outputH;
+	uint32_t SSAOH, SSAOBlurXH, SSAOBlurYH;
+	uint32_t depthLowH, upsampledH;
 
 	BufferAttachment SSAOParamBuffer;
 
-	QuadProcessor SSAO, BlurX, BlurY, SSAOFinal;
+	uint32_t shift;
+	bool temporal;
 
-	ColorToShaderOptimalBarrier ssaoColorToShader;
-	ShaderOptimalToColorBarrier ssaoShaderToColor;
+	// Persistent across frames, so they are owned by the processor rather than the graph
+	VulkanTexture historyAO;
+	VulkanTexture historyDepth;
+	uint32_t historyAOH = 0, historyDepthH = 0, accumH = 0;
 
-	ColorToShaderOptimalBarrier blurXColorToShader;
-	ShaderOptimalToColorBarrier blurXShaderToColor;
+	glm::mat4 prevViewProj = glm::mat4(1.0f);
+	bool hasPrevViewProj = false;
+	bool reprojectionValid = false;
+	bool cameraSupplied = false;
+	uint32_t framesAccumulated = 0;
 
-	ColorToShaderOptimalBarrier blurYColorToShader;
-	ShaderOptimalToColorBarrier blurYShaderToColor;
+	void createHistory()
+	{
+		const int w = (int)std::max(ctx_.vkDev.framebufferWidth  >> shift, 1u);
+		const int h = (int)std::max(ctx_.vkDev.framebufferHeight >> shift, 1u);
 
-	ColorToShaderOptimalBarrier finalColorToShader;
-	ShaderOptimalToColorBarrier finalShaderToColor;
+		historyAO    = ctx_.resources.addStorageTexture(w, h, SSAOFormat);
+		// Linear filtering of R32_SFLOAT is not a guaranteed format feature
+		historyDepth = ctx_.resources.addStorageTexture(w, h, VK_FORMAT_R32_SFLOAT, VK_FILTER_NEAREST);
+		framesAccumulated = 0;
+	}
 };
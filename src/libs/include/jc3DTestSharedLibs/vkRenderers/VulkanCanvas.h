@@ -37,12 +37,19 @@ private:
 
 	bool createDescriptorSet(VulkanRenderDevice& vkDev);
 
+	// (Re)create the persistently mapped storage buffer of one swapchain image and point its descriptor set at it
+	void createStorageBuffer(VulkanRenderDevice& vkDev, size_t image, VkDeviceSize size);
+	void destroyStorageBuffer(size_t image);
+	void updateStorageDescriptor(size_t image);
+
 	std::vector<VertexData> lines_;
 
-	// 7. Storage Buffer with index and vertex data
+	// 7. Storage Buffer with index and vertex data, grows (doubling) when the lines do not fit
 	std::vector<VkBuffer> storageBuffer_;
 	std::vector<VkDeviceMemory> storageBufferMemory_;
+	std::vector<void*> storageBufferPtr_;
+	std::vector<VkDeviceSize> storageBufferSize_;
 
-	static constexpr unsigned kMaxLinesCount = 65536;
-	static constexpr unsigned kMaxLinesDataSize = kMaxLinesCount * sizeof(VulkanCanvas::VertexData) * 2;
+	static constexpr unsigned kInitialLinesCount = 4096;
+	static constexpr unsigned kInitialLinesDataSize = kInitialLinesCount * sizeof(VulkanCanvas::VertexData) * 2;
 };
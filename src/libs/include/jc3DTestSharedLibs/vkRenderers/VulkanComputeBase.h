@@ -3,38 +3,66 @@
 #include <jc3DTestSharedLibs/Utils.h>
 #include <jc3DTestSharedLibs/UtilsVulkan.h>
 
+/* Buffer-to-buffer compute. When double-buffered, executeAsync() writes one slot while the host reads the result of the previous dispatch from the other */
 struct ComputeBase
 {
-	ComputeBase(VulkanRenderDevice& vkDev, const char* shaderName, uint32_t inputSize, uint32_t outputSize);
+	ComputeBase(VulkanRenderDevice& vkDev, const char* shaderName, uint32_t inputSize, uint32_t outputSize, bool doubleBuffered = false);
 
 	virtual ~ComputeBase();
 
+	// Writes the input of the next dispatch
 	inline void uploadInput(uint32_t offset, void* inData, uint32_t byteCount) {
-		uploadBufferData(vkDev, inBufferMemory, offset, inData, byteCount);
+		const uint32_t slot = getWriteSlot();
+		waitSlot(slot);
+		uploadBufferData(vkDev, inBufferMemory[slot], offset, inData, byteCount);
 	}
 
+	// Reads the previous dispatch when double-buffered, the latest one otherwise
 	inline void downloadOutput(uint32_t offset, void* outData, uint32_t byteCount) {
-		downloadBufferData(vkDev, outBufferMemory, offset, outData, byteCount);
+		const uint32_t slot = getReadSlot();
+		waitSlot(slot);
+		downloadBufferData(vkDev, outBufferMemory[slot], offset, outData, byteCount);
 	}
 
+	// Blocking dispatch
 	inline bool execute(uint32_t xsize, uint32_t ysize, uint32_t zsize) {
-		return executeComputeShader(vkDev, pipeline, pipelineLayout, descriptorSet, xsize, ysize, zsize);
+		if (!executeAsync(xsize, ysize, zsize))
+			return false;
+		waitSlot((uint32_t)((submitCount - 1) % numSlots));
+		return true;
 	}
 
+	// Submits without waiting for the dispatch to complete
+	bool executeAsync(uint32_t xsize, uint32_t ysize, uint32_t zsize);
+
+	inline uint32_t getWriteSlot() const { return (uint32_t)(submitCount % numSlots); }
+	inline uint32_t getReadSlot() const { return (uint32_t)(((submitCount >= numSlots) ? submitCount - numSlots : 0) % numSlots); }
+
 protected:
 	VulkanRenderDevice& vkDev;
 
-	VkBuffer inBuffer;
-	VkBuffer outBuffer;
-	VkDeviceMemory inBufferMemory;
-	VkDeviceMemory outBufferMemory;
+	const uint32_t numSlots;
+	uint64_t submitCount = 0;
+
+	// One input/output pair per slot
+	std::vector<VkBuffer> inBuffer;
+	std::vector<VkBuffer> outBuffer;
+	std::vector<VkDeviceMemory> inBufferMemory;
+	std::vector<VkDeviceMemory> outBufferMemory;
+
+	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<VkFence> fences;
 
 	VkDescriptorSetLayout dsLayout;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline pipeline;
 
 	VkDescriptorPool descriptorPool;
-	VkDescriptorSet descriptorSet;
+	std::vector<VkDescriptorSet> descriptorSets;
 
 	bool createComputeDescriptorSet(VkDevice device, VkDescriptorSetLayout descriptorSetLayout);
+
+	inline void waitSlot(uint32_t slot) {
+		vkWaitForFences(vkDev.device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+	}
 };
@@ -3,29 +3,55 @@
 #include <jc3DTestSharedLibs/Utils.h>
 #include <jc3DTestSharedLibs/UtilsVulkan.h>
 
+/* A dispatch on the compute queue. With two slots the outputs are double-buffered: dispatch N writes slot N % 2
+   while the graphics queue consumes the result of dispatch N - 1, so compute and graphics overlap */
 struct ComputedItem
 {
-	ComputedItem(VulkanRenderDevice& vkDev, uint32_t uniformBufferSize);
+	ComputedItem(VulkanRenderDevice& vkDev, uint32_t uniformBufferSize, uint32_t numSlots = 1);
 	virtual ~ComputedItem();
 
+	// Records the dispatch which writes getWriteSlot()
 	void fillComputeCommandBuffer(void* pushConstant = nullptr, uint32_t pushConstantSize = 0, uint32_t xsize = 1, uint32_t ysize = 1, uint32_t zsize = 1);
+
+	// Does not wait for the dispatch itself, only for the one which used the same slot 'numSlots' submissions ago
 	bool submit();
 
+	// Host-side wait for the latest submitted dispatch
 	void waitFence();
 
-	inline void uploadUniformBuffer(uint32_t size, void* data) {
-		uploadBufferData(vkDev, uniformBuffer.memory, 0, data, size);
-	}
+	// The next drawFrame() submission waits for the dispatch which wrote getReadSlot() (on the GPU with timeline semaphores, on the host otherwise)
+	void waitInFrame(VkPipelineStageFlags stage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+	inline uint32_t getNumSlots() const { return numSlots; }
+
+	inline uint32_t getWriteSlot() const { return (uint32_t)(submitCount % numSlots); }
+
+	// The previous dispatch when double-buffered, the latest one otherwise
+	inline uint32_t getReadSlot() const { return (uint32_t)(getReadDispatch() % numSlots); }
+
+	// Writes the uniform buffer of getWriteSlot(), i.e. the parameters of the next dispatch
+	void uploadUniformBuffer(uint32_t size, void* data);
 protected:
 	VulkanRenderDevice& vkDev;
 
-	VkFence fence;
+	const uint32_t numSlots;
 
-	VulkanBuffer uniformBuffer;
+	// Dispatch N signals value N + 1 on the timeline semaphore and fences[N % numSlots]
+	uint64_t submitCount = 0;
+
+	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<VkFence> fences;
+	VkSemaphore timeline = VK_NULL_HANDLE;
+
+	std::vector<VulkanBuffer> uniformBuffers; // one per slot, the dispatch of the other slot may still read its own
 
 	VkDescriptorSetLayout dsLayout;
 	VkDescriptorPool      descriptorPool;
-	VkDescriptorSet       descriptorSet;
+	std::vector<VkDescriptorSet> descriptorSets; // one per slot
 	VkPipelineLayout      pipelineLayout;
 	VkPipeline            pipeline;
+
+	inline uint64_t getReadDispatch() const { return (submitCount >= numSlots) ? submitCount - numSlots : 0; }
+
+	void waitSlot(uint32_t slot);
 };
@@ -10,16 +10,23 @@ struct ComputedVertexBuffer: public ComputedItem
 		uint32_t uniformBufferSize,
 		uint32_t vertexSize,
 		uint32_t vertexCount,
-		bool supportDownload = false);
+		bool supportDownload = false,
+		bool doubleBuffered = false);
 
-	virtual ~ComputedVertexBuffer() {}
+	virtual ~ComputedVertexBuffer();
 
+	// Indices are stored after the vertices in every slot
 	void uploadIndexData(uint32_t* indices);
 
+	// Waits for the latest dispatch and reads its vertices
 	void downloadVertices(void* vertexData);
 
-	VkBuffer computedBuffer;
-	VkDeviceMemory computedMemory;
+	// The buffer the graphics queue should bind this frame (see waitInFrame())
+	inline VkBuffer getComputedBuffer() const { return computedBuffers[getReadSlot()]; }
+
+	// One vertex+index buffer per slot, shared between the compute and graphics queue families
+	std::vector<VkBuffer> computedBuffers;
+	std::vector<VkDeviceMemory> computedMemory;
 
 	uint32_t computedVertexCount;
 
@@ -12,6 +12,10 @@ public:
 	virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, size_t currentImage) override;
 	void updateBuffers(VulkanRenderDevice& vkDev, uint32_t currentImage, const ImDrawData* imguiDrawData);
 
+	// Vertex and index bytes uploaded by the last updateBuffers() call
+	inline VkDeviceSize getBytesPerFrame() const { return bytesPerFrame_; }
+	inline VkDeviceSize getBufferCapacity(size_t image) const { return vtxBufferSize_[image] + idxBufferSize_[image]; }
+
 private:
 	const ImDrawData* drawData = nullptr;
 
@@ -20,12 +24,22 @@ private:
 	/* Descriptor set with multiple textures (for offscreen buffer display etc.) */
 	bool createMultiDescriptorSet(VulkanRenderDevice& vkDev);
 
+	// (Re)create the persistently mapped storage buffer of one swapchain image, descriptor sets are written separately
+	void createStorageBuffer(VulkanRenderDevice& vkDev, size_t image, VkDeviceSize vtxSize, VkDeviceSize idxSize);
+	void destroyStorageBuffer(size_t image);
+	void updateStorageDescriptors(size_t image);
+
 	std::vector<VulkanTexture> extTextures_;
 
-	// storage buffer with index and vertex data
-	VkDeviceSize bufferSize_;
+	// storage buffer with vertex data followed by index data (at an aligned offset), grows (doubling) when a frame does not fit
 	std::vector<VkBuffer> storageBuffer_;
 	std::vector<VkDeviceMemory> storageBufferMemory_;
+	std::vector<void*> storageBufferPtr_;
+	std::vector<VkDeviceSize> vtxBufferSize_;
+	std::vector<VkDeviceSize> idxBufferSize_;
+	VkDeviceSize storageAlignment_ = 1;
+
+	VkDeviceSize bytesPerFrame_ = 0;
 
 	VkSampler fontSampler_;
 	VulkanImage font_;
@@ -15,7 +15,9 @@ public:
 			const char* texNormalFile,
 			const char* texEnvMapFile,
 			const char* texIrrMapFile,
-			VulkanImage depthTexture);
+			VulkanImage depthTexture,
+			bool depthPrepass = false,
+			bool overdrawView = false);
 
 	virtual ~PBRModelRenderer();
 
@@ -24,6 +26,13 @@ public:
 	void updateUniformBuffer(VulkanRenderDevice& vkDev, uint32_t currentImage, const void* data, const size_t dataSize);
 
 private:
+	// Depth-only pipeline (vertex stage only); the main pipeline then tests with LESS_OR_EQUAL and does not write depth
+	bool depthPrepass_ = false;
+	VkPipeline prepassPipeline_ = nullptr;
+
+	// Additive count of the shaded fragments instead of the PBR shading
+	bool overdrawView_ = false;
+
 	size_t vertexBufferSize_;
 	size_t indexBufferSize_;
 
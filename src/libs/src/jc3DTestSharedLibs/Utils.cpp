@@ -2,9 +2,12 @@
 #	define _CRT_SECURE_NO_WARNINGS 1
 #endif // _CRT_SECURE_NO_WARNINGS
 
-#include <malloc.h>
 #include <string.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include <jc3DTestSharedLibs/Utils.h>
 
@@ -37,50 +40,189 @@ int endsWith(const char* s, const char* part)
 	return (strstr( s, part ) - s) == (strlen( s ) - strlen( part ));
 }
 
-std::string readShaderFile(const char* fileName)
+/*
+	Shader sources are parsed once and kept in memory: the text is split into chunks separated by #include directives.
+	The file time stamp is checked on each access, so edited files are reloaded (hot-reload friendly).
+*/
+struct ShaderSourceFile
+{
+	std::filesystem::file_time_type timeStamp;
+
+	// chunks.size() == includes.size() + 1; chunk i is followed by includes[i]
+	std::vector<std::string> chunks;
+	std::vector<std::string> includes;
+
+	// 1-based line number of the first line of each chunk (for #line directives)
+	std::vector<int> chunkFirstLine;
+};
+
+static std::mutex shaderFileCacheMutex;
+static std::unordered_map<std::string, std::shared_ptr<const ShaderSourceFile>> shaderFileCache;
+
+static bool parseIncludeDirective(const std::string& line, std::string& includeName)
+{
+	size_t pos = line.find_first_not_of(" \t");
+
+	if (pos == line.npos || line.compare(pos, 8, "#include") != 0)
+		return false;
+
+	pos = line.find_first_of("<\"", pos + 8);
+	if (pos == line.npos)
+		return false;
+
+	const char closing = (line[pos] == '<') ? '>' : '"';
+	const size_t end = line.find(closing, pos + 1);
+	if (end == line.npos || end == pos + 1)
+		return false;
+
+	// Normalize, so that different spellings of the same path are recognized as one file
+	includeName = std::filesystem::path(line.substr(pos + 1, end - pos - 1)).lexically_normal().generic_string();
+	return true;
+}
+
+static std::shared_ptr<const ShaderSourceFile> loadShaderSourceFile(const std::string& fileName)
 {
-	FILE* file = fopen(fileName, "r");
+	std::error_code ec;
+	const auto timeStamp = std::filesystem::last_write_time(fileName, ec);
+
+	{
+		std::lock_guard lock(shaderFileCacheMutex);
+		auto i = shaderFileCache.find(fileName);
+		if (i != shaderFileCache.end() && !ec && i->second->timeStamp == timeStamp)
+			return i->second;
+	}
+
+	FILE* file = fopen(fileName.c_str(), "rb");
 
 	if (!file)
 	{
-		printf("I/O error. Cannot open shader file '%s'\n", fileName);
-		return std::string();
+		printf("I/O error. Cannot open shader file '%s'\n", fileName.c_str());
+		return nullptr;
 	}
 
 	fseek(file, 0L, SEEK_END);
-	const auto bytesinfile = ftell(file);
+	const long bytesinfile = ftell(file);
 	fseek(file, 0L, SEEK_SET);
 
-	char* buffer = (char*)alloca(bytesinfile + 1);
-	const size_t bytesread = fread(buffer, 1, bytesinfile, file);
+	std::string code(bytesinfile > 0 ? bytesinfile : 0, 0);
+	code.resize(fread(code.data(), 1, code.size(), file));
 	fclose(file);
 
-	buffer[bytesread] = 0;
-
 	static constexpr unsigned char BOM[] = { 0xEF, 0xBB, 0xBF };
 
-	if (bytesread > 3)
+	if (code.size() >= 3 && !memcmp(code.data(), BOM, 3))
+		code.erase(0, 3);
+
+	auto result = std::make_shared<ShaderSourceFile>();
+	result->timeStamp = timeStamp;
+	result->chunks.emplace_back();
+	result->chunkFirstLine.push_back(1);
+
+	int lineNumber = 1;
+
+	for (size_t pos = 0; pos < code.size(); lineNumber++)
 	{
-		if (!memcmp(buffer, BOM, 3))
-			memset(buffer, ' ', 3);
+		size_t eol = code.find('\n', pos);
+		eol = (eol == code.npos) ? code.size() : eol + 1;
+
+		const std::string line = code.substr(pos, eol - pos);
+		std::string includeName;
+
+		if (parseIncludeDirective(line, includeName))
+		{
+			result->includes.push_back(includeName);
+			result->chunks.emplace_back();
+			result->chunkFirstLine.push_back(lineNumber + 1);
+		}
+		else
+		{
+			result->chunks.back() += line;
+		}
+
+		pos = eol;
 	}
 
-	std::string code(buffer);
+	std::lock_guard lock(shaderFileCacheMutex);
+	shaderFileCache[fileName] = result;
+
+	return result;
+}
+
+struct ShaderPreprocessorState
+{
+	// Index in this list is the GLSL source string number used in #line directives
+	std::vector<std::string> files;
+	// Files currently being expanded (for cycle detection)
+	std::vector<std::string> stack;
+};
+
+static bool expandShaderFile(const std::string& fileName, ShaderPreprocessorState& state, std::string& code)
+{
+	const int fileIndex = addUnique(state.files, fileName);
+
+	auto source = loadShaderSourceFile(fileName);
+	if (!source)
+		return false;
+
+	state.stack.push_back(fileName);
+
+	code += source->chunks[0];
 
-	while (code.find("#include ") != code.npos)
+	for (size_t i = 0; i != source->includes.size(); i++)
 	{
-		const auto pos = code.find("#include ");
-		const auto p1 = code.find('<', pos);
-		const auto p2 = code.find('>', pos);
-		if (p1 == code.npos || p2 == code.npos || p2 <= p1)
+		const std::string& include = source->includes[i];
+
+		if (std::find(state.stack.begin(), state.stack.end(), include) != state.stack.end())
+		{
+			printf("Circular #include of '%s' in shader file '%s'\n", include.c_str(), fileName.c_str());
+			return false;
+		}
+
+		// Every file is included only once, repeated #include directives are dropped
+		if (std::find(state.files.begin(), state.files.end(), include) == state.files.end())
 		{
-			printf("Error while loading shader program: %s\n", code.c_str());
-			return std::string();
+			if (!code.empty() && code.back() != '\n')
+				code += '\n';
+
+			code += "#line 1 " + std::to_string(state.files.size()) + "\n";
+
+			if (!expandShaderFile(include, state, code))
+				return false;
 		}
-		const std::string name = code.substr(p1 + 1, p2 - p1 - 1);
-		const std::string include = readShaderFile(name.c_str());
-		code.replace(pos, p2-pos+1, include.c_str());
+
+		if (!code.empty() && code.back() != '\n')
+			code += '\n';
+
+		code += "#line " + std::to_string(source->chunkFirstLine[i + 1]) + " " + std::to_string(fileIndex) + "\n";
+		code += source->chunks[i + 1];
 	}
 
+	state.stack.pop_back();
+
+	return true;
+}
+
+std::string readShaderFile(const char* fileName, std::vector<std::string>* dependencies)
+{
+	ShaderPreprocessorState state;
+	std::string code;
+
+	if (!expandShaderFile(fileName, state, code))
+		return std::string();
+
+	if (dependencies)
+		*dependencies = state.files;
+
 	return code;
 }
+
+std::string readShaderFile(const char* fileName)
+{
+	return readShaderFile(fileName, nullptr);
+}
+
+void clearShaderFileCache()
+{
+	std::lock_guard lock(shaderFileCacheMutex);
+	shaderFileCache.clear();
+}
@@ -0,0 +1,192 @@
+#if !defined(_CRT_SECURE_NO_WARNINGS)
+#	define _CRT_SECURE_NO_WARNINGS 1
+#endif // _CRT_SECURE_NO_WARNINGS
+
+#include <jc3DTestSharedLibs/UtilsSPIRVCache.h>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+#if defined(_WIN32)
+#	include <process.h>
+#else
+#	include <unistd.h>
+#endif
+
+// Without the version the cache would keep returning SPIR-V compiled by an older glslang after an upgrade
+#if __has_include(<glslang/build_info.h>)
+#	include <glslang/build_info.h>
+#else
+#	error "glslang/build_info.h not found: add glslang's generated include directory (${CMAKE_BINARY_DIR}/include) to the include path"
+#endif
+
+#define GLSLANG_VERSION_STRING_(major, minor, patch) #major "." #minor "." #patch
+#define GLSLANG_VERSION_STRING(major, minor, patch) GLSLANG_VERSION_STRING_(major, minor, patch)
+static constexpr const char* kGlslangVersion = GLSLANG_VERSION_STRING(GLSLANG_VERSION_MAJOR, GLSLANG_VERSION_MINOR, GLSLANG_VERSION_PATCH) GLSLANG_VERSION_FLAVOR;
+
+// Bump this if compileShader() input parameters (target environment, resource limits etc.) change
+static constexpr uint32_t kSPIRVCacheFormatVersion = 1;
+
+static constexpr uint32_t kSPIRVMagic = 0x07230203;
+
+static std::string cacheFolder = kDefaultSPIRVCacheFolder;
+static std::atomic<bool> cacheEnabled = true;
+
+void setSPIRVCacheFolder(const char* folder)
+{
+	cacheFolder = folder;
+
+	if (!cacheFolder.empty() && cacheFolder.back() != '/' && cacheFolder.back() != '\\')
+		cacheFolder += '/';
+}
+
+const std::string& getSPIRVCacheFolder()
+{
+	return cacheFolder;
+}
+
+void setSPIRVCacheEnabled(bool enabled)
+{
+	cacheEnabled = enabled;
+}
+
+bool isSPIRVCacheEnabled()
+{
+	return cacheEnabled;
+}
+
+/* 64-bit FNV-1a: stable across compilers and runs, unlike std::hash */
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+
+	for (size_t i = 0; i != size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static uint64_t fnv1a(const std::string& s, uint64_t hash)
+{
+	// include the terminator so that adjacent strings cannot be confused
+	return fnv1a(s.c_str(), s.size() + 1, hash);
+}
+
+uint64_t getSPIRVCacheKey(const std::string& preprocessedSource, uint32_t stage, const std::vector<std::string>& defines)
+{
+	uint64_t hash = fnv1a(&kSPIRVCacheFormatVersion, sizeof(kSPIRVCacheFormatVersion));
+	hash = fnv1a(std::string(kGlslangVersion), hash);
+	hash = fnv1a(&stage, sizeof(stage), hash);
+
+	for (const auto& d: defines)
+		hash = fnv1a(d, hash);
+
+	return fnv1a(preprocessedSource, hash);
+}
+
+static std::string getCacheFileName(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.spv", (unsigned long long)key);
+	return cacheFolder + name;
+}
+
+bool loadSPIRVFromCache(uint64_t key, std::vector<unsigned int>& SPIRV)
+{
+	if (!cacheEnabled)
+		return false;
+
+	FILE* f = fopen(getCacheFileName(key).c_str(), "rb");
+
+	if (!f)
+		return false;
+
+	fseek(f, 0, SEEK_END);
+	const long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	bool result = false;
+
+	if (size > 0 && (size % sizeof(unsigned int)) == 0)
+	{
+		SPIRV.resize(size / sizeof(unsigned int));
+		result = (fread(SPIRV.data(), 1, size, f) == (size_t)size) && (SPIRV[0] == kSPIRVMagic);
+	}
+
+	fclose(f);
+
+	if (!result)
+		SPIRV.clear();
+
+	return result;
+}
+
+bool saveSPIRVToCache(uint64_t key, const std::vector<unsigned int>& SPIRV)
+{
+	if (!cacheEnabled || SPIRV.empty())
+		return false;
+
+	std::error_code ec;
+	std::filesystem::create_directories(cacheFolder, ec);
+
+	const std::string fileName = getCacheFileName(key);
+
+	// Write to a temporary file unique per process and thread first, so that concurrent writers and readers never see a partial binary
+#if defined(_WIN32)
+	const int pid = _getpid();
+#else
+	const int pid = (int)getpid();
+#endif
+	const std::string tmpFileName = fileName + "." + std::to_string(pid) + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+	FILE* f = fopen(tmpFileName.c_str(), "wb");
+
+	if (!f)
+		return false;
+
+	const size_t bytes = SPIRV.size() * sizeof(unsigned int);
+	const bool written = (fwrite(SPIRV.data(), 1, bytes, f) == bytes);
+	fclose(f);
+
+	if (written)
+		std::filesystem::rename(tmpFileName, fileName, ec);
+
+	if (!written || ec)
+	{
+		std::filesystem::remove(tmpFileName, ec);
+		return false;
+	}
+
+	return true;
+}
+
+std::string insertShaderDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+	if (defines.empty())
+		return source;
+
+	std::string lines;
+
+	for (const auto& d: defines)
+	{
+		const auto eq = d.find('=');
+		lines += "#define " + ((eq == d.npos) ? d : d.substr(0, eq) + " " + d.substr(eq + 1)) + "\n";
+	}
+
+	// #version must remain the first directive
+	const auto versionPos = source.find("#version");
+	if (versionPos == source.npos)
+		return lines + source;
+
+	const auto eol = source.find('\n', versionPos);
+	if (eol == source.npos)
+		return source + "\n" + lines;
+
+	return source.substr(0, eol + 1) + lines + source.substr(eol + 1);
+}
@@ -3,10 +3,17 @@
 #include <jc3DTestSharedLibs/UtilsVulkan.h>
 #include <jc3DTestSharedLibs/Bitmap.h>
 #include <jc3DTestSharedLibs/UtilsCubemap.h>
+#include <jc3DTestSharedLibs/UtilsSPIRVCache.h>
 #include <jc3DTestSharedLibs/EasyProfilerWrapper.h>
 
 #include <glslang/Include/ResourceLimits.h>
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+
 #define VK_NO_PROTOTYPES
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -342,17 +349,32 @@ static size_t compileShader(glslang_stage_t stage, const char* shaderSource, Sha
 	return shaderModule.SPIRV.size();
 }
 
-size_t compileShaderFile(const char* file, ShaderModule& shaderModule)
+size_t compileShaderFile(const char* file, ShaderModule& shaderModule, const std::vector<std::string>& defines)
 {
-	if (auto shaderSource = readShaderFile(file); !shaderSource.empty())
-		return compileShader(glslangShaderStageFromFileName(file), shaderSource.c_str(), shaderModule);
+	const std::string fileSource = readShaderFile(file);
 
-	return 0;
+	if (fileSource.empty())
+		return 0;
+
+	const std::string shaderSource = insertShaderDefines(fileSource, defines);
+
+	const glslang_stage_t stage = glslangShaderStageFromFileName(file);
+	const uint64_t cacheKey = getSPIRVCacheKey(shaderSource, (uint32_t)stage, defines);
+
+	if (loadSPIRVFromCache(cacheKey, shaderModule.SPIRV))
+		return shaderModule.SPIRV.size();
+
+	const size_t size = compileShader(stage, shaderSource.c_str(), shaderModule);
+
+	if (size > 0)
+		saveSPIRVToCache(cacheKey, shaderModule.SPIRV);
+
+	return size;
 }
 
-VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* fileName)
+VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* fileName, const std::vector<std::string>& defines)
 {
-	if (compileShaderFile(fileName, *shader) < 1)
+	if (compileShaderFile(fileName, *shader, defines) < 1)
 		return VK_NOT_READY;
 
 	const VkShaderModuleCreateInfo createInfo =
@@ -365,15 +387,34 @@ VkResult createShaderModule(VkDevice device, ShaderModule* shader, const char* f
 	return vkCreateShaderModule(device, &createInfo, nullptr, &shader->shaderModule);
 }
 
-void createInstance(VkInstance* instance)
+static bool isInstanceLayerAvailable(const char* layerName)
+{
+	uint32_t layerCount = 0;
+	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+	std::vector<VkLayerProperties> layers(layerCount);
+	vkEnumerateInstanceLayerProperties(&layerCount, layers.data());
+
+	for (const auto& l: layers)
+		if (!strcmp(l.layerName, layerName))
+			return true;
+
+	return false;
+}
+
+void createInstance(VkInstance* instance, bool headless)
 {
 	// https://vulkan.lunarg.com/doc/view/1.1.108.0/windows/validation_layers.html
-	const std::vector<const char*> ValidationLayers =
+	std::vector<const char*> ValidationLayers =
 	{
 		"VK_LAYER_KHRONOS_validation"
 	};
 
-	const std::vector<const char*> exts =
+	// CI machines usually have no SDK installed
+	if (headless && !isInstanceLayerAvailable(ValidationLayers[0]))
+		ValidationLayers.clear();
+
+	const std::vector<const char*> surfaceExts =
 	{
 		"VK_KHR_surface",
 #if defined (_WIN32)
@@ -385,12 +426,19 @@ void createInstance(VkInstance* instance)
 #if defined (__linux__)
 		"VK_KHR_xcb_surface"
 #endif
-		, VK_EXT_DEBUG_UTILS_EXTENSION_NAME
+	};
+
+	std::vector<const char*> exts =
+	{
+		VK_EXT_DEBUG_UTILS_EXTENSION_NAME
 		, VK_EXT_DEBUG_REPORT_EXTENSION_NAME
 		/* for indexed textures */
 		, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
 	};
 
+	if (!headless)
+		exts.insert(exts.begin(), surfaceExts.begin(), surfaceExts.end());
+
 	const VkApplicationInfo appinfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
@@ -409,7 +457,7 @@ void createInstance(VkInstance* instance)
 		.flags = 0,
 		.pApplicationInfo = &appinfo,
 		.enabledLayerCount = static_cast<uint32_t>(ValidationLayers.size()),
-		.ppEnabledLayerNames = ValidationLayers.data(),
+		.ppEnabledLayerNames = ValidationLayers.empty() ? nullptr : ValidationLayers.data(),
 		.enabledExtensionCount = static_cast<uint32_t>(exts.size()),
 		.ppEnabledExtensionNames = exts.data()
 	};
@@ -548,7 +596,7 @@ VkResult createDevice2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures
 
 VkResult createDevice2WithCompute(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures2 deviceFeatures2, uint32_t graphicsFamily, uint32_t computeFamily, VkDevice* device)
 {
-	const std::vector<const char*> extensions =
+	std::vector<const char*> extensions =
 	{
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 		VK_KHR_MAINTENANCE3_EXTENSION_NAME,
@@ -557,8 +605,18 @@ VkResult createDevice2WithCompute(VkPhysicalDevice physicalDevice, VkPhysicalDev
 		VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME
 	};
 
-	if (graphicsFamily == computeFamily)
-		return createDevice2(physicalDevice, deviceFeatures2, graphicsFamily, device);
+	// Optional: async compute results are waited for on the GPU (see ComputedItem)
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+		.pNext = deviceFeatures2.pNext,
+		.timelineSemaphore = VK_TRUE
+	};
+
+	if (isTimelineSemaphoreSupported(physicalDevice))
+	{
+		extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		deviceFeatures2.pNext = &timelineFeatures;
+	}
 
 	const float queuePriorities[2] = { 0.f, 0.f };
 	const VkDeviceQueueCreateInfo qciGfx =
@@ -588,7 +646,7 @@ VkResult createDevice2WithCompute(VkPhysicalDevice physicalDevice, VkPhysicalDev
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 		.pNext = &deviceFeatures2,
 		.flags = 0,
-		.queueCreateInfoCount = 2,
+		.queueCreateInfoCount = (graphicsFamily == computeFamily) ? 1u : 2u, // a single queue family gets a single queue
 		.pQueueCreateInfos = qci,
 		.enabledLayerCount = 0,
 		.ppEnabledLayerNames = nullptr,
@@ -600,18 +658,22 @@ VkResult createDevice2WithCompute(VkPhysicalDevice physicalDevice, VkPhysicalDev
 	return vkCreateDevice(physicalDevice, &ci, nullptr, device);
 }
 
-VkResult createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t graphicsFamily, uint32_t width, uint32_t height, VkSwapchainKHR* swapchain, bool supportScreenshots)
+VkResult createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t graphicsFamily, uint32_t width, uint32_t height, VkSwapchainKHR* swapchain, bool supportScreenshots,
+	VkPresentModeKHR preferredPresentMode, uint32_t desiredImageCount, VkPresentModeKHR* outPresentMode, VkSwapchainKHR oldSwapchain)
 {
 	auto swapchainSupport = querySwapchainSupport(physicalDevice, surface);
 	auto surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
-	auto presentMode = chooseSwapPresentMode(swapchainSupport.presentModes);
+	auto presentMode = chooseSwapPresentMode(swapchainSupport.presentModes, preferredPresentMode);
+
+	if (outPresentMode)
+		*outPresentMode = presentMode;
 
 	const VkSwapchainCreateInfoKHR ci =
 	{
 		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 		.flags = 0,
 		.surface = surface,
-		.minImageCount = chooseSwapImageCount(swapchainSupport.capabilities),
+		.minImageCount = chooseSwapImageCount(swapchainSupport.capabilities, desiredImageCount),
 		.imageFormat = surfaceFormat.format,
 		.imageColorSpace = surfaceFormat.colorSpace,
 		.imageExtent = {.width = width, .height = height },
@@ -624,7 +686,7 @@ VkResult createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSur
 		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 		.presentMode = presentMode,
 		.clipped = VK_TRUE,
-		.oldSwapchain = VK_NULL_HANDLE
+		.oldSwapchain = oldSwapchain
 	};
 
 	return vkCreateSwapchainKHR(device, &ci, nullptr, swapchain);
@@ -650,6 +712,81 @@ size_t createSwapchainImages(
 	return static_cast<size_t>(imageCount);
 }
 
+size_t createHeadlessSwapchainImages(VulkanRenderDevice& vkDev, uint32_t width, uint32_t height, uint32_t imageCount)
+{
+	vkDev.swapchainImages.resize(imageCount);
+	vkDev.swapchainImageViews.resize(imageCount);
+	vkDev.headlessImageMemory.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		if (!createImage(vkDev.device, vkDev.physicalDevice, width, height, VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkDev.swapchainImages[i], vkDev.headlessImageMemory[i]))
+			exit(EXIT_FAILURE);
+
+		if (!createImageView(vkDev.device, vkDev.swapchainImages[i], VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, &vkDev.swapchainImageViews[i]))
+			exit(EXIT_FAILURE);
+	}
+
+	vkDev.headlessImageIndex = 0;
+
+	return static_cast<size_t>(imageCount);
+}
+
+void recreateSwapchain(VulkanInstance& vk, VulkanRenderDevice& vkDev, uint32_t width, uint32_t height)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkDev.device));
+
+	const size_t oldImageCount = vkDev.swapchainImages.size();
+
+	for (auto view: vkDev.swapchainImageViews)
+		vkDestroyImageView(vkDev.device, view, nullptr);
+
+	if (vkDev.headless)
+	{
+		for (size_t i = 0; i < vkDev.swapchainImages.size(); i++)
+		{
+			vkDestroyImage(vkDev.device, vkDev.swapchainImages[i], nullptr);
+			vkFreeMemory(vkDev.device, vkDev.headlessImageMemory[i], nullptr);
+		}
+
+		createHeadlessSwapchainImages(vkDev, width, height, static_cast<uint32_t>(oldImageCount));
+	}
+	else
+	{
+		const VkSurfaceCapabilitiesKHR caps = querySwapchainSupport(vkDev.physicalDevice, vk.surface).capabilities;
+
+		// Some platforms dictate the extent, others accept anything within the limits
+		if (caps.currentExtent.width != std::numeric_limits<uint32_t>::max())
+		{
+			width = caps.currentExtent.width;
+			height = caps.currentExtent.height;
+		}
+
+		width  = std::clamp(width,  caps.minImageExtent.width,  caps.maxImageExtent.width);
+		height = std::clamp(height, caps.minImageExtent.height, caps.maxImageExtent.height);
+
+		// The same requested image count as in initVulkanRenderDevice2WithCompute() gives the same number of images
+		const VkSwapchainKHR oldSwapchain = vkDev.swapchain;
+		VK_CHECK(createSwapchain(vkDev.device, vkDev.physicalDevice, vk.surface, vkDev.graphicsFamily, width, height, &vkDev.swapchain, vkDev.supportScreenshots,
+			vkDev.requestedPresentMode, vkDev.requestedImageCount, &vkDev.presentMode, oldSwapchain));
+		vkDestroySwapchainKHR(vkDev.device, oldSwapchain, nullptr);
+
+		createSwapchainImages(vkDev.device, vkDev.swapchain, vkDev.swapchainImages, vkDev.swapchainImageViews);
+	}
+
+	if (vkDev.swapchainImages.size() != oldImageCount)
+	{
+		printf("recreateSwapchain(): the number of swapchain images changed from %u to %u\n", (uint32_t)oldImageCount, (uint32_t)vkDev.swapchainImages.size());
+		exit(EXIT_FAILURE);
+	}
+
+	vkDev.framebufferWidth = width;
+	vkDev.framebufferHeight = height;
+	vkDev.swapchainOutOfDate = false;
+}
+
 VkResult createSemaphore(VkDevice device, VkSemaphore* outSemaphore)
 {
 	const VkSemaphoreCreateInfo ci =
@@ -704,6 +841,9 @@ bool initVulkanRenderDevice(VulkanInstance& vk, VulkanRenderDevice& vkDev, uint3
 	};
 
 	VK_CHECK(vkAllocateCommandBuffers(vkDev.device, &ai, &vkDev.commandBuffers[0]));
+
+	createPipelineCache(vkDev);
+
 	return true;
 }
 /*
@@ -822,6 +962,8 @@ bool initVulkanRenderDeviceWithCompute(VulkanInstance& vk, VulkanRenderDevice& v
 
 	vkDev.useCompute = true;
 
+	createPipelineCache(vkDev);
+
 	return true;
 }
 
@@ -869,6 +1011,9 @@ bool initVulkanRenderDevice2(VulkanInstance& vk, VulkanRenderDevice& vkDev, uint
 	};
 
 	VK_CHECK(vkAllocateCommandBuffers(vkDev.device, &ai, &vkDev.commandBuffers[0]));
+
+	createPipelineCache(vkDev);
+
 	return true;
 }
 
@@ -883,6 +1028,12 @@ bool initVulkanRenderDevice2WithCompute(VulkanInstance& vk, VulkanRenderDevice&
 //	VK_CHECK(vkGetBestComputeQueue(vkDev.physicalDevice, &vkDev.computeFamily));
 	vkDev.computeFamily = findQueueFamilies(vkDev.physicalDevice, VK_QUEUE_COMPUTE_BIT);
 	VK_CHECK(createDevice2WithCompute(vkDev.physicalDevice, deviceFeatures2, vkDev.graphicsFamily, vkDev.computeFamily, &vkDev.device));
+	vkDev.timelineSemaphores = isTimelineSemaphoreSupported(vkDev.physicalDevice);
+
+	// Buffers written by async compute and read by graphics are shared between the families (see createSharedBuffer())
+	vkDev.deviceQueueIndices.push_back(vkDev.graphicsFamily);
+	if (vkDev.graphicsFamily != vkDev.computeFamily)
+		vkDev.deviceQueueIndices.push_back(vkDev.computeFamily);
 
 	vkGetDeviceQueue(vkDev.device, vkDev.graphicsFamily, 0, &vkDev.graphicsQueue);
 	if (vkDev.graphicsQueue == nullptr)
@@ -892,13 +1043,27 @@ bool initVulkanRenderDevice2WithCompute(VulkanInstance& vk, VulkanRenderDevice&
 	if (vkDev.computeQueue == nullptr)
 		exit(EXIT_FAILURE);
 
-	VkBool32 presentSupported = 0;
-	vkGetPhysicalDeviceSurfaceSupportKHR(vkDev.physicalDevice, vkDev.graphicsFamily, vk.surface, &presentSupported);
-	if (!presentSupported)
-		exit(EXIT_FAILURE);
+	size_t imageCount = 0;
+
+	vkDev.supportScreenshots = supportScreenshots || vkDev.headless;
+
+	if (vkDev.headless)
+	{
+		vkDev.swapchain = VK_NULL_HANDLE;
+		imageCount = createHeadlessSwapchainImages(vkDev, width, height, vkDev.requestedImageCount > 0 ? vkDev.requestedImageCount : kHeadlessImageCount);
+	}
+	else
+	{
+		VkBool32 presentSupported = 0;
+		vkGetPhysicalDeviceSurfaceSupportKHR(vkDev.physicalDevice, vkDev.graphicsFamily, vk.surface, &presentSupported);
+		if (!presentSupported)
+			exit(EXIT_FAILURE);
+
+		VK_CHECK(createSwapchain(vkDev.device, vkDev.physicalDevice, vk.surface, vkDev.graphicsFamily, width, height, &vkDev.swapchain, supportScreenshots,
+			vkDev.requestedPresentMode, vkDev.requestedImageCount, &vkDev.presentMode));
+		imageCount = createSwapchainImages(vkDev.device, vkDev.swapchain, vkDev.swapchainImages, vkDev.swapchainImageViews);
+	}
 
-	VK_CHECK(createSwapchain(vkDev.device, vkDev.physicalDevice, vk.surface, vkDev.graphicsFamily, width, height, &vkDev.swapchain, supportScreenshots));
-	const size_t imageCount = createSwapchainImages(vkDev.device, vkDev.swapchain, vkDev.swapchainImages, vkDev.swapchainImageViews);
 	vkDev.commandBuffers.resize(imageCount);
 
 	VK_CHECK(createSemaphore(vkDev.device, &vkDev.semaphore));
@@ -907,7 +1072,7 @@ bool initVulkanRenderDevice2WithCompute(VulkanInstance& vk, VulkanRenderDevice&
 	const VkCommandPoolCreateInfo cpi =
 	{
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.flags = 0,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, /* Per-image command buffers are re-recorded individually */
 		.queueFamilyIndex = vkDev.graphicsFamily
 	};
 
@@ -949,6 +1114,8 @@ bool initVulkanRenderDevice2WithCompute(VulkanInstance& vk, VulkanRenderDevice&
 
 	vkDev.useCompute = true;
 
+	createPipelineCache(vkDev);
+
 	return true;
 }
 
@@ -985,15 +1152,34 @@ bool initVulkanRenderDevice3(VulkanInstance& vk, VulkanRenderDevice& vkDev, uint
 		.features = deviceFeatures  /*  */
 	};
 
-	return initVulkanRenderDevice2WithCompute(vk, vkDev, width, height, isDeviceSuitable, deviceFeatures2, ctxFeatures.supportScreenshots_);
+	vkDev.headless = ctxFeatures.headless_;
+	vkDev.requestedPresentMode = ctxFeatures.presentMode_;
+	vkDev.requestedImageCount = ctxFeatures.swapchainImageCount_;
+
+	return initVulkanRenderDevice2WithCompute(vk, vkDev, width, height, ctxFeatures.headless_ ? isDeviceSuitableHeadless : isDeviceSuitable, deviceFeatures2, ctxFeatures.supportScreenshots_);
 }
 
 void destroyVulkanRenderDevice(VulkanRenderDevice& vkDev)
 {
+	if (vkDev.pipelineCache != VK_NULL_HANDLE)
+	{
+		savePipelineCache(vkDev);
+		vkDestroyPipelineCache(vkDev.device, vkDev.pipelineCache, nullptr);
+	}
+
 	for (size_t i = 0; i < vkDev.swapchainImages.size(); i++)
 		vkDestroyImageView(vkDev.device, vkDev.swapchainImageViews[i], nullptr);
 
-	vkDestroySwapchainKHR(vkDev.device, vkDev.swapchain, nullptr);
+	if (vkDev.headless)
+	{
+		for (size_t i = 0; i < vkDev.swapchainImages.size(); i++)
+		{
+			vkDestroyImage(vkDev.device, vkDev.swapchainImages[i], nullptr);
+			vkFreeMemory(vkDev.device, vkDev.headlessImageMemory[i], nullptr);
+		}
+	}
+	else
+		vkDestroySwapchainKHR(vkDev.device, vkDev.swapchain, nullptr);
 
 	vkDestroyCommandPool(vkDev.device, vkDev.commandPool, nullptr);
 
@@ -1010,7 +1196,8 @@ void destroyVulkanRenderDevice(VulkanRenderDevice& vkDev)
 
 void destroyVulkanInstance(VulkanInstance& vk)
 {
-	vkDestroySurfaceKHR(vk.instance, vk.surface, nullptr);
+	if (vk.surface != VK_NULL_HANDLE)
+		vkDestroySurfaceKHR(vk.instance, vk.surface, nullptr);
 
 	vkDestroyDebugReportCallbackEXT(vk.instance, vk.reportCallback, nullptr);
 	vkDestroyDebugUtilsMessengerEXT(vk.instance, vk.messenger, nullptr);
@@ -1018,7 +1205,7 @@ void destroyVulkanInstance(VulkanInstance& vk)
 	vkDestroyInstance(vk.instance, nullptr);
 }
 
-bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode)
+bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilter, VkFilter maxFilter, VkSamplerAddressMode addressMode, float maxLod)
 {
 	const VkSamplerCreateInfo samplerInfo = {
 		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -1036,7 +1223,7 @@ bool createTextureSampler(VkDevice device, VkSampler* sampler, VkFilter minFilte
 		.compareEnable = VK_FALSE,
 		.compareOp = VK_COMPARE_OP_ALWAYS,
 		.minLod = 0.0f,
-		.maxLod = 0.0f,
+		.maxLod = maxLod,
 		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 		.unnormalizedCoordinates = VK_FALSE
 	};
@@ -1086,6 +1273,63 @@ bool isDeviceSuitable(VkPhysicalDevice device)
 	return isGPU && deviceFeatures.geometryShader;
 }
 
+bool isDeviceSuitableHeadless(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceFeatures deviceFeatures;
+	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+
+	return deviceFeatures.geometryShader;
+}
+
+bool isTimelineSemaphoreSupported(VkPhysicalDevice device)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	const bool hasExtension = std::any_of(extensions.begin(), extensions.end(),
+		[](const VkExtensionProperties& e) { return !strcmp(e.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME); });
+
+	if (!hasExtension)
+		return false;
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+		.pNext = nullptr
+	};
+
+	VkPhysicalDeviceFeatures2 features2 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &timelineFeatures
+	};
+
+	vkGetPhysicalDeviceFeatures2(device, &features2);
+
+	return timelineFeatures.timelineSemaphore == VK_TRUE;
+}
+
+bool isSubgroupArithmeticSupported(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceSubgroupProperties subgroupProperties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+		.pNext = nullptr
+	};
+
+	VkPhysicalDeviceProperties2 properties2 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &subgroupProperties
+	};
+
+	vkGetPhysicalDeviceProperties2(device, &properties2);
+
+	const VkSubgroupFeatureFlags required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+
+	return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+		(subgroupProperties.supportedOperations & required) == required;
+}
+
 SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface)
 {
 	SwapchainSupportDetails details;
@@ -1117,19 +1361,19 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>
 	return { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
 }
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, VkPresentModeKHR preferredMode)
 {
 	for (const auto mode : availablePresentModes)
-		if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+		if (mode == preferredMode)
 			return mode;
 
 	// FIFO will always be supported
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
-uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities)
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities, uint32_t desiredImageCount)
 {
-	const uint32_t imageCount = capabilities.minImageCount + 1;
+	const uint32_t imageCount = (desiredImageCount > 0) ? std::max(desiredImageCount, capabilities.minImageCount) : capabilities.minImageCount + 1;
 
 	const bool imageCountExceeded = capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount;
 
@@ -1229,7 +1473,11 @@ bool createGraphicsPipeline(
 	bool dynamicScissorState,
 	int32_t customWidth,
 	int32_t customHeight,
-	uint32_t numPatchControlPoints)
+	uint32_t numPatchControlPoints,
+	VkCompareOp depthCompareOp,
+	bool depthWrite,
+	bool colorWrite,
+	bool additiveBlending)
 {
 	std::vector<ShaderModule> shaderModules;
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
@@ -1297,13 +1545,13 @@ bool createGraphicsPipeline(
 
 	const VkPipelineColorBlendAttachmentState colorBlendAttachment = {
 		.blendEnable = VK_TRUE,
-		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.srcColorBlendFactor = additiveBlending ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = additiveBlending ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
 		.colorBlendOp = VK_BLEND_OP_ADD,
 		.srcAlphaBlendFactor = useBlending ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE,
 		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
 		.alphaBlendOp = VK_BLEND_OP_ADD,
-		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+		.colorWriteMask = colorWrite ? (VkColorComponentFlags)(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT) : 0u
 	};
 
 	const VkPipelineColorBlendStateCreateInfo colorBlending = {
@@ -1318,8 +1566,8 @@ bool createGraphicsPipeline(
 	const VkPipelineDepthStencilStateCreateInfo depthStencil = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
 		.depthTestEnable = static_cast<VkBool32>(useDepth ? VK_TRUE : VK_FALSE),
-		.depthWriteEnable = static_cast<VkBool32>(useDepth ? VK_TRUE : VK_FALSE),
-		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthWriteEnable = static_cast<VkBool32>((useDepth && depthWrite) ? VK_TRUE : VK_FALSE),
+		.depthCompareOp = depthCompareOp,
 		.depthBoundsTestEnable = VK_FALSE,
 		.minDepthBounds = 0.0f,
 		.maxDepthBounds = 1.0f
@@ -1362,7 +1610,7 @@ bool createGraphicsPipeline(
 		.basePipelineIndex = -1
 	};
 
-	VK_CHECK(vkCreateGraphicsPipelines(vkDev.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline));
+	VK_CHECK(createGraphicsPipelineWithCache(vkDev, pipelineInfo, pipeline));
 
 	for (auto m: shaderModules)
 		vkDestroyShaderModule(vkDev.device, m.shaderModule, nullptr);
@@ -1588,7 +1836,8 @@ bool createColorAndDepthRenderPass(VulkanRenderDevice& vkDev, bool useDepth, VkR
 		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		.initialLayout = first ? VK_IMAGE_LAYOUT_UNDEFINED : (offscreenInt ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
-		.finalLayout = last ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		// Headless frames are not presented, but are ready to be copied out
+		.finalLayout = last ? (vkDev.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	};
 
 	const VkAttachmentReference colorAttachmentRef = {
@@ -2769,6 +3018,162 @@ VkResult createComputePipeline(VkDevice device, VkShaderModule computeShader, Vk
 	return vkCreateComputePipelines(device, 0, 1, &computePipelineCreateInfo, nullptr, pipeline);
 }
 
+/* Pipelines may be created from several threads (see VulkanResources::addPipelineAsync()) */
+static std::mutex pipelineStatsMutex;
+
+static void addPipelineCreationStats(VulkanRenderDevice& vkDev, double ms)
+{
+	std::lock_guard lock(pipelineStatsMutex);
+
+	vkDev.pipelineCreationMs += ms;
+	vkDev.pipelinesCreated++;
+}
+
+VkResult createComputePipeline(VulkanRenderDevice& vkDev, VkShaderModule computeShader, VkPipelineLayout pipelineLayout, VkPipeline* pipeline,
+	const VkSpecializationInfo* specializationInfo)
+{
+	const VkComputePipelineCreateInfo computePipelineCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = computeShader,
+			.pName = "main",
+			.pSpecializationInfo = specializationInfo
+		},
+		.layout = pipelineLayout,
+		.basePipelineHandle = 0,
+		.basePipelineIndex  = 0
+	};
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const VkResult result = vkCreateComputePipelines(vkDev.device, vkDev.pipelineCache, 1, &computePipelineCreateInfo, nullptr, pipeline);
+
+	addPipelineCreationStats(vkDev, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+	return result;
+}
+
+VkResult createGraphicsPipelineWithCache(VulkanRenderDevice& vkDev, const VkGraphicsPipelineCreateInfo& pipelineInfo, VkPipeline* pipeline)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const VkResult result = vkCreateGraphicsPipelines(vkDev.device, vkDev.pipelineCache, 1, &pipelineInfo, nullptr, pipeline);
+
+	addPipelineCreationStats(vkDev, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+	return result;
+}
+
+bool createPipelineCache(VulkanRenderDevice& vkDev, const char* fileName)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(vkDev.physicalDevice, &props);
+
+	std::vector<uint8_t> data;
+
+	if (FILE* f = fopen(fileName, "rb"))
+	{
+		fseek(f, 0, SEEK_END);
+		const long size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+
+		if (size > 0)
+		{
+			data.resize(size);
+			if (fread(data.data(), 1, data.size(), f) != data.size())
+				data.clear();
+		}
+
+		fclose(f);
+	}
+
+	/* The data is only valid for the same driver and device: check VkPipelineCacheHeaderVersionOne fields */
+	const size_t kHeaderSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+	if (!data.empty())
+	{
+		uint32_t header[4];
+		bool valid = data.size() >= kHeaderSize;
+
+		if (valid)
+		{
+			memcpy(header, data.data(), sizeof(header));
+			valid = (header[0] >= kHeaderSize) &&
+				(header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+				(header[2] == props.vendorID) &&
+				(header[3] == props.deviceID) &&
+				(memcmp(data.data() + sizeof(header), props.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+		}
+
+		if (!valid)
+		{
+			printf("Pipeline cache %s was created by a different device or driver, ignoring it\n", fileName);
+			data.clear();
+		}
+	}
+
+	const VkPipelineCacheCreateInfo ci = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.initialDataSize = data.size(),
+		.pInitialData = data.empty() ? nullptr : data.data()
+	};
+
+	VkResult result = vkCreatePipelineCache(vkDev.device, &ci, nullptr, &vkDev.pipelineCache);
+
+	if (result != VK_SUCCESS && !data.empty())
+	{
+		// The driver rejected the data, start from scratch
+		const VkPipelineCacheCreateInfo emptyCI = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+		data.clear();
+		result = vkCreatePipelineCache(vkDev.device, &emptyCI, nullptr, &vkDev.pipelineCache);
+	}
+
+	vkDev.pipelineCacheWarm = !data.empty();
+
+	return (result == VK_SUCCESS);
+}
+
+bool savePipelineCache(const VulkanRenderDevice& vkDev, const char* fileName)
+{
+	size_t size = 0;
+	if (vkGetPipelineCacheData(vkDev.device, vkDev.pipelineCache, &size, nullptr) != VK_SUCCESS || !size)
+		return false;
+
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(vkDev.device, vkDev.pipelineCache, &size, data.data()) != VK_SUCCESS)
+		return false;
+
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(fileName).parent_path(), ec);
+
+	FILE* f = fopen(fileName, "wb");
+	if (!f)
+	{
+		printf("Unable to save pipeline cache to %s\n", fileName);
+		return false;
+	}
+
+	const bool ok = (fwrite(data.data(), 1, size, f) == size);
+	fclose(f);
+
+	return ok;
+}
+
+void printPipelineCacheStats(const VulkanRenderDevice& vkDev)
+{
+	std::lock_guard lock(pipelineStatsMutex);
+
+	printf("Pipelines: %u created in %.2f ms (%s pipeline cache)\n", vkDev.pipelinesCreated, vkDev.pipelineCreationMs, vkDev.pipelineCacheWarm ? "warm" : "cold");
+}
+
 /* Default DS layout for In/Out buffer pair */
 bool createComputeDescriptorSetLayout(VkDevice device, VkDescriptorSetLayout* descriptorSetLayout)
 {
@@ -2879,12 +3284,14 @@ VulkanContextCreator::VulkanContextCreator(VulkanInstance& vk, VulkanRenderDevic
 	instance(vk),
 	vkDev(dev)
 {
-	createInstance(&vk.instance);
+	createInstance(&vk.instance, ctxFeatures.headless_);
 
 	if (!setupDebugCallbacks(vk.instance, &vk.messenger, &vk.reportCallback))
 		exit(0);
 
-	if (glfwCreateWindowSurface(vk.instance, (GLFWwindow *)window, nullptr, &vk.surface))
+	vk.surface = VK_NULL_HANDLE;
+
+	if (!ctxFeatures.headless_ && glfwCreateWindowSurface(vk.instance, (GLFWwindow *)window, nullptr, &vk.surface))
 		exit(0);
 
 	if (!initVulkanRenderDevice3(vk, dev, screenWidth, screenHeight, ctxFeatures))
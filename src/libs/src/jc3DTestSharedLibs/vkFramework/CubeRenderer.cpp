@@ -16,31 +16,21 @@ CubemapRenderer::CubemapRenderer(VulkanRenderContext& ctx,
 {
 	const PipelineInfo pInfo = initRenderPass(PipelineInfo{}, outputs, screenRenderPass, ctx.screenRenderPass);
 
-	const size_t imgCount = ctx.vkDev.swapchainImages.size();
-	descriptorSets_.resize(imgCount);
-	uniforms_.resize(imgCount);
-
-	DescriptorSetInfo dsInfo = {
-		.buffers = { uniformBufferAttachment(VulkanBuffer {}, 0, sizeof(UniformBuffer), VK_SHADER_STAGE_VERTEX_BIT) },
+	const DescriptorSetInfo dsInfo = {
+		.buffers = { ctx.frameUniforms.attachment(sizeof(UniformBuffer), VK_SHADER_STAGE_VERTEX_BIT) },
 		.textures = { fsTextureAttachment(texture) }
 	};
 
 	descriptorSetLayout_ = ctx_.resources.addDescriptorSetLayout(dsInfo);
-	descriptorPool_ = ctx_.resources.addDescriptorPool(dsInfo, imgCount);
-
-	for (size_t i = 0 ; i != imgCount ; i++)
-	{
-		uniforms_[i] = ctx.resources.addUniformBuffer(sizeof(UniformBuffer));
-		dsInfo.buffers[0].buffer = uniforms_[i];
 
-		descriptorSets_[i] = ctx.resources.addDescriptorSet(descriptorPool_, descriptorSetLayout_);
-		ctx.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
-	}
+	const VkDescriptorSet ds = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
+	ctx.resources.updateDescriptorSet(ds, dsInfo);
+	descriptorSets_.assign(ctx.vkDev.swapchainImages.size(), ds);
 
 	initPipeline({ "data/shaders/chapter08/VK03_CubeMap.vert", "data/shaders/chapter08/VK03_CubeMap.frag" }, pInfo);
 }
 
 void CubemapRenderer::updateBuffers(size_t currentImage)
 {
-	updateUniformBuffer(currentImage, 0, sizeof(UniformBuffer), &ubo);
+	dynamicOffsets_ = { ctx_.frameUniforms.upload(ubo) };
 }
@@ -0,0 +1,293 @@
+#if !defined(_CRT_SECURE_NO_WARNINGS)
+#	define _CRT_SECURE_NO_WARNINGS 1
+#endif // _CRT_SECURE_NO_WARNINGS
+
+#include <jc3DTestSharedLibs/vkFramework/FrameReadback.h>
+#include <jc3DTestSharedLibs/Utils.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <glm/gtc/packing.hpp>
+
+// Apps may have their own copy of stb_image_write, so keep ours private to this file
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+static void encodeImage(std::vector<uint8_t> pixels, uint32_t w, uint32_t h, VkFormat format, const std::string& fileName)
+{
+	int result = 0;
+
+	switch (format)
+	{
+	case VK_FORMAT_B8G8R8A8_UNORM:
+		for (size_t i = 0 ; i < pixels.size() ; i += 4)
+			std::swap(pixels[i], pixels[i + 2]);
+		result = stbi_write_png(fileName.c_str(), (int)w, (int)h, 4, pixels.data(), (int)w * 4);
+		break;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		result = stbi_write_png(fileName.c_str(), (int)w, (int)h, 4, pixels.data(), (int)w * 4);
+		break;
+	case VK_FORMAT_R8_UNORM:
+		result = stbi_write_png(fileName.c_str(), (int)w, (int)h, 1, pixels.data(), (int)w);
+		break;
+	case VK_FORMAT_R16_SFLOAT:
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	{
+		const int comp = (format == VK_FORMAT_R16_SFLOAT) ? 1 : 4;
+		const uint16_t* src = (const uint16_t*)pixels.data();
+		std::vector<float> floats((size_t)w * h * comp);
+		for (size_t i = 0 ; i != floats.size() ; i++)
+			floats[i] = glm::unpackHalf1x16(src[i]);
+		result = stbi_write_hdr(fileName.c_str(), (int)w, (int)h, comp, floats.data());
+		break;
+	}
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		result = stbi_write_hdr(fileName.c_str(), (int)w, (int)h, 4, (const float*)pixels.data());
+		break;
+	default:
+		printf("FrameReadback: unsupported format %d for %s\n", (int)format, fileName.c_str());
+		return;
+	}
+
+	if (!result)
+		printf("FrameReadback: cannot write %s\n", fileName.c_str());
+}
+
+FrameReadback::FrameReadback(VulkanRenderDevice& vkDev)
+: vkDev_(vkDev)
+{
+}
+
+FrameReadback::~FrameReadback()
+{
+	flush();
+
+	for (auto& s: slots_)
+		for (auto& b: s.buffers)
+			destroyBuffer(b);
+}
+
+void FrameReadback::captureScreen(const char* fileName)
+{
+	if (!vkDev_.headless && !vkDev_.supportScreenshots)
+	{
+		printf("FrameReadback: swapchain images cannot be copied, enable VulkanContextFeatures::supportScreenshots_\n");
+		return;
+	}
+
+	pendingRequests_.push_back(Request {
+		.format = VK_FORMAT_B8G8R8A8_UNORM,
+		.width = vkDev_.framebufferWidth,
+		.height = vkDev_.framebufferHeight,
+		.layout = vkDev_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		.fileName = fileName
+	});
+}
+
+void FrameReadback::startFrameDump(const char* prefix, uint32_t frameCount)
+{
+	dumpPrefix_ = prefix;
+	dumpRemaining_ = frameCount;
+	dumpFrame_ = 0;
+}
+
+void FrameReadback::captureTexture(const VulkanTexture& tex, const char* fileName, VkImageLayout layout)
+{
+	pendingRequests_.push_back(Request {
+		.image = tex.image.image,
+		.format = tex.format,
+		.width = tex.width,
+		.height = tex.height,
+		.layout = layout,
+		.fileName = fileName
+	});
+}
+
+void FrameReadback::destroyBuffer(StagingBuffer& b)
+{
+	if (b.buffer == VK_NULL_HANDLE)
+		return;
+
+	vkUnmapMemory(vkDev_.device, b.memory);
+	vkDestroyBuffer(vkDev_.device, b.buffer, nullptr);
+	vkFreeMemory(vkDev_.device, b.memory, nullptr);
+
+	b = StagingBuffer {};
+}
+
+void FrameReadback::collect(Slot& slot)
+{
+	for (size_t i = 0 ; i != slot.requests.size() ; i++)
+	{
+		const Request& r = slot.requests[i];
+		const uint8_t* src = (const uint8_t*)slot.buffers[i].ptr;
+
+		// Only the copy happens here, PNG compression is far too slow for the render thread
+		std::vector<uint8_t> pixels(src, src + (size_t)r.width * r.height * bytesPerTexFormat(r.format));
+
+		encodes_.push_back(std::async(std::launch::async, [pixels = std::move(pixels), r]() mutable {
+			encodeImage(std::move(pixels), r.width, r.height, r.format, r.fileName);
+		}));
+	}
+
+	slot.requests.clear();
+
+	// Drop finished encodes
+	encodes_.erase(std::remove_if(encodes_.begin(), encodes_.end(), [](const std::future<void>& f) {
+		return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), encodes_.end());
+}
+
+void FrameReadback::beginFrame(uint32_t imageIndex)
+{
+	if (slots_.size() != vkDev_.swapchainImages.size())
+	{
+		flush();
+		for (auto& s: slots_)
+			for (auto& b: s.buffers)
+				destroyBuffer(b);
+		slots_.clear();
+		slots_.resize(vkDev_.swapchainImages.size());
+	}
+
+	Slot& slot = slots_[imageIndex];
+
+	// The previous submission of this image's command buffer is complete by now
+	collect(slot);
+
+	if (dumpRemaining_ > 0)
+	{
+		char fileName[1024];
+		snprintf(fileName, sizeof(fileName), "%s%05u.png", dumpPrefix_.c_str(), dumpFrame_++);
+		dumpRemaining_--;
+		captureScreen(fileName);
+	}
+
+	slot.requests.swap(pendingRequests_);
+
+	if (slot.buffers.size() < slot.requests.size())
+		slot.buffers.resize(slot.requests.size());
+
+	for (size_t i = 0 ; i != slot.requests.size() ; i++)
+	{
+		const Request& r = slot.requests[i];
+		const VkDeviceSize size = (VkDeviceSize)r.width * r.height * bytesPerTexFormat(r.format);
+
+		StagingBuffer& b = slot.buffers[i];
+
+		if (b.size >= size)
+			continue;
+
+		destroyBuffer(b);
+
+		if (!createBuffer(vkDev_.device, vkDev_.physicalDevice, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, b.buffer, b.memory))
+		{
+			printf("FrameReadback: cannot allocate readback buffer\n");
+			exit(EXIT_FAILURE);
+		}
+
+		b.size = size;
+		VK_CHECK(vkMapMemory(vkDev_.device, b.memory, 0, VK_WHOLE_SIZE, 0, &b.ptr));
+	}
+}
+
+void FrameReadback::recordCopies(VkCommandBuffer cmdBuffer, uint32_t imageIndex)
+{
+	if (slots_.empty())
+		return;
+
+	const Slot& slot = slots_[imageIndex];
+
+	for (size_t i = 0 ; i != slot.requests.size() ; i++)
+	{
+		const Request& r = slot.requests[i];
+		const VkImage image = (r.image != VK_NULL_HANDLE) ? r.image : vkDev_.swapchainImages[imageIndex];
+
+		VkImageMemoryBarrier barrier = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			.oldLayout = r.layout,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+		};
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		const VkBufferImageCopy region = {
+			.bufferOffset = 0,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+			.imageOffset = { 0, 0, 0 },
+			.imageExtent = { r.width, r.height, 1 }
+		};
+
+		vkCmdCopyImageToBuffer(cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffers[i].buffer, 1, &region);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = r.layout;
+
+		const VkBufferMemoryBarrier hostBarrier = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = slot.buffers[i].buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE
+		};
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+			0, nullptr, 1, &hostBarrier, 1, &barrier);
+	}
+}
+
+size_t FrameReadback::commandSignature(uint32_t imageIndex) const
+{
+	if (slots_.empty())
+		return 0;
+
+	const Slot& slot = slots_[imageIndex];
+
+	size_t signature = slot.requests.size();
+	for (size_t i = 0 ; i != slot.requests.size() ; i++)
+	{
+		signature = hashCombine(signature, reinterpret_cast<size_t>(slot.requests[i].image));
+		signature = hashCombine(signature, reinterpret_cast<size_t>(slot.buffers[i].buffer));
+		signature = hashCombine(signature, (size_t)slot.requests[i].layout);
+	}
+
+	return signature;
+}
+
+void FrameReadback::flush()
+{
+	bool hasCopies = false;
+	for (const auto& s: slots_)
+		hasCopies = hasCopies || !s.requests.empty();
+
+	if (hasCopies)
+	{
+		VK_CHECK(vkDeviceWaitIdle(vkDev_.device));
+
+		for (auto& s: slots_)
+			collect(s);
+	}
+
+	for (auto& f: encodes_)
+		f.wait();
+
+	encodes_.clear();
+}
@@ -0,0 +1,48 @@
+#include <jc3DTestSharedLibs/vkFramework/FrameUniformAllocator.h>
+
+static uint32_t alignUp(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+FrameUniformAllocator::FrameUniformAllocator(VulkanResources& resources, VulkanRenderDevice& vkDev, uint32_t bytesPerFrame)
+{
+	VkPhysicalDeviceProperties devProps;
+	vkGetPhysicalDeviceProperties(vkDev.physicalDevice, &devProps);
+
+	alignment_ = std::max(1u, static_cast<uint32_t>(devProps.limits.minUniformBufferOffsetAlignment));
+	bytesPerFrame_ = alignUp(bytesPerFrame, alignment_);
+
+	const uint32_t numFrames = std::max(1u, static_cast<uint32_t>(vkDev.swapchainImages.size()));
+
+	buffer_ = resources.addUniformBuffer(static_cast<VkDeviceSize>(bytesPerFrame_) * numFrames, true);
+
+	if (!buffer_.ptr)
+	{
+		printf("Cannot map frame uniform buffer\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void FrameUniformAllocator::beginFrame(uint32_t imageIndex)
+{
+	frameBase_ = imageIndex * bytesPerFrame_;
+	offset_ = frameBase_;
+}
+
+uint32_t FrameUniformAllocator::upload(const void* data, uint32_t size)
+{
+	const uint32_t offset = offset_;
+
+	if (offset + size > frameBase_ + bytesPerFrame_)
+	{
+		printf("Frame uniform buffer overflow (%u bytes per frame)\n", bytesPerFrame_);
+		exit(EXIT_FAILURE);
+	}
+
+	memcpy((uint8_t*)buffer_.ptr + offset, data, size);
+
+	offset_ = alignUp(offset + size, alignment_);
+
+	return offset;
+}
@@ -1,8 +1,9 @@
 #include <jc3DTestSharedLibs/vkFramework/GuiRenderer.h>
 #include <jc3DTestSharedLibs/scene/Scene.h>
 
-static constexpr uint32_t ImGuiVtxBufferSize = 512 * 1024 * sizeof(ImDrawVert);
-static constexpr uint32_t ImGuiIdxBufferSize = 512 * 1024 * sizeof(uint32_t);
+// Initial sizes only, the buffers grow when a frame does not fit
+static constexpr VkDeviceSize ImGuiInitialVtxBufferSize = 16 * 1024 * sizeof(ImDrawVert);
+static constexpr VkDeviceSize ImGuiInitialIdxBufferSize = 32 * 1024 * sizeof(uint32_t);
 
 static void addImGuiItem(uint32_t width, uint32_t height, VkCommandBuffer commandBuffer, const ImDrawCmd* pcmd, ImVec2 clipOff, ImVec2 clipScale, int idxOffset, int vtxOffset,
 	VkPipelineLayout pipelineLayout)
@@ -73,28 +74,64 @@ void GuiRenderer::updateBuffers(size_t currentImage)
 	const mat4 inMtx = glm::ortho(L, R, T, B);
 	updateUniformBuffer(currentImage, 0, sizeof(mat4), glm::value_ptr(inMtx));
 
-	void* data = nullptr;
-	vkMapMemory(ctx_.vkDev.device, storages_[currentImage].memory, 0, storages_[currentImage].size, 0, &data);
+	const VkDeviceSize vtxSize = drawData->TotalVtxCount * sizeof(ImDrawVert);
+	const VkDeviceSize idxSize = drawData->TotalIdxCount * sizeof(uint32_t);
 
-	ImDrawVert* vtx = (ImDrawVert*)data;
-	for (int n = 0; n < drawData->CmdListsCount; n++)
+	if (vtxSize > vtxSizes_[currentImage] || idxSize > idxSizes_[currentImage])
 	{
-		const ImDrawList* cmdList = drawData->CmdLists[n];
-		memcpy(vtx, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
-		vtx += cmdList->VtxBuffer.Size;
+		VkDeviceSize newVtxSize = vtxSizes_[currentImage];
+		while (newVtxSize < vtxSize)
+			newVtxSize *= 2;
+
+		VkDeviceSize newIdxSize = idxSizes_[currentImage];
+		while (newIdxSize < idxSize)
+			newIdxSize *= 2;
+
+		// drawFrame() waits for the device after every frame, so no submitted work uses the old buffer
+		ctx_.resources.destroyBuffer(storages_[currentImage]);
+		allocateStorage(currentImage, newVtxSize, newIdxSize);
+		// This frame binds the set already, so the write cannot wait for the next VulkanRenderContext::updateBuffers()
+		ctx_.resources.flushDescriptorUpdates();
 	}
 
-	uint32_t* idx = (uint32_t*)((uint8_t*)data + ImGuiVtxBufferSize);
+	// Persistently mapped: a single pass over the draw lists writes only the used ranges, 16-bit indices are widened for the shader
+	ImDrawVert* vtx = (ImDrawVert*)storages_[currentImage].ptr;
+	uint32_t* idx = (uint32_t*)((uint8_t*)storages_[currentImage].ptr + vtxSizes_[currentImage]);
+
 	for (int n = 0; n < drawData->CmdListsCount; n++)
 	{
 		const ImDrawList* cmdList = drawData->CmdLists[n];
-		const uint16_t* src = (const uint16_t*)cmdList->IdxBuffer.Data;
 
+		memcpy(vtx, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
+		vtx += cmdList->VtxBuffer.Size;
+
+		const uint16_t* src = (const uint16_t*)cmdList->IdxBuffer.Data;
 		for (int j = 0; j < cmdList->IdxBuffer.Size; j++)
 			*idx++ = (uint32_t)*src++;
 	}
 
-	vkUnmapMemory(ctx_.vkDev.device, storages_[currentImage].memory);
+	bytesPerFrame_ = vtxSize + idxSize;
+}
+
+void GuiRenderer::allocateStorage(size_t image, VkDeviceSize vtxSize, VkDeviceSize idxSize)
+{
+	// The index data starts right after the vertex data, at a valid storage buffer offset
+	vtxSize = (vtxSize + storageAlignment_ - 1) / storageAlignment_ * storageAlignment_;
+
+	storages_[image] = ctx_.resources.addStorageBuffer(vtxSize + idxSize, true);
+	vtxSizes_[image] = vtxSize;
+	idxSizes_[image] = idxSize;
+
+	const DescriptorSetInfo dsInfo = {
+		.buffers = {
+			uniformBufferAttachment(uniforms_[image],                  0,      sizeof(mat4), VK_SHADER_STAGE_VERTEX_BIT),
+			storageBufferAttachment(storages_[image],                  0, (uint32_t)vtxSize, VK_SHADER_STAGE_VERTEX_BIT),
+			storageBufferAttachment(storages_[image], (uint32_t)vtxSize, (uint32_t)idxSize, VK_SHADER_STAGE_VERTEX_BIT)
+		},
+		.textureArrays = { fsTextureArrayAttachment(allTextures) }
+	};
+
+	ctx_.resources.updateDescriptorSet(descriptorSets_[image], dsInfo);
 }
 
 GuiRenderer::GuiRenderer(VulkanRenderContext& ctx, const std::vector<VulkanTexture>& textures, RenderPass renderPass):
@@ -113,30 +150,28 @@ GuiRenderer::GuiRenderer(VulkanRenderContext& ctx, const std::vector<VulkanTextu
 	storages_.resize(imgCount);
 	uniforms_.resize(imgCount);
 
-	VkDeviceSize bufferSize = ImGuiVtxBufferSize + ImGuiIdxBufferSize;
+	vtxSizes_.resize(imgCount);
+	idxSizes_.resize(imgCount);
+
+	storageAlignment_ = std::max<VkDeviceSize>(1, getVulkanBufferAlignment(ctx.vkDev));
 
-	DescriptorSetInfo dsInfo = {
+	// Buffer sizes and offsets are per set, see allocateStorage()
+	const DescriptorSetInfo dsInfo = {
 		.buffers = {
-			uniformBufferAttachment(VulkanBuffer{},                  0,       sizeof(mat4), VK_SHADER_STAGE_VERTEX_BIT),
-			storageBufferAttachment(VulkanBuffer{},                  0, ImGuiVtxBufferSize, VK_SHADER_STAGE_VERTEX_BIT),
-			storageBufferAttachment(VulkanBuffer{}, ImGuiVtxBufferSize, ImGuiIdxBufferSize, VK_SHADER_STAGE_VERTEX_BIT)
+			uniformBufferAttachment(VulkanBuffer{}, 0, 0, VK_SHADER_STAGE_VERTEX_BIT),
+			storageBufferAttachment(VulkanBuffer{}, 0, 0, VK_SHADER_STAGE_VERTEX_BIT),
+			storageBufferAttachment(VulkanBuffer{}, 0, 0, VK_SHADER_STAGE_VERTEX_BIT)
 		},
 		.textureArrays = { fsTextureArrayAttachment(allTextures) }
 	};
 	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
-	descriptorPool_ = ctx.resources.addDescriptorPool(dsInfo, imgCount);
 
 	for(size_t i = 0 ; i < imgCount ; i++)
 	{
-		uniforms_[i] = ctx.resources.addUniformBuffer(sizeof(mat4));
-		storages_[i] = ctx.resources.addStorageBuffer(bufferSize);
+		uniforms_[i] = ctx.resources.addUniformBuffer(sizeof(mat4), true);
+		descriptorSets_[i] = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
 
-		dsInfo.buffers[0].buffer = uniforms_[i];
-		dsInfo.buffers[1].buffer = storages_[i];
-		dsInfo.buffers[2].buffer = storages_[i];
-
-		descriptorSets_[i] = ctx.resources.addDescriptorSet(descriptorPool_, descriptorSetLayout_);
-		ctx.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
+		allocateStorage(i, ImGuiInitialVtxBufferSize, ImGuiInitialIdxBufferSize);
 	}
 
 	const PipelineInfo pInfo = initRenderPass(PipelineInfo { .useDepth = false, .dynamicScissorState = true },
@@ -162,6 +197,15 @@ void imguiTextureWindow(const char* Title, uint32_t texId)
 	ImGui::End();
 }
 
+void imguiUploadStats(const GuiRenderer& gui)
+{
+	ImGui::Begin("ImGui upload", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+		ImGui::Text("%.1f KB/frame", (double)gui.getBytesPerFrame() / 1024.0);
+
+	ImGui::End();
+}
+
 int renderSceneTree(const Scene& scene, int node)
 {
 	int selected = -1;
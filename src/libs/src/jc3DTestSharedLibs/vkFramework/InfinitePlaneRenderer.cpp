@@ -10,8 +10,8 @@ void InfinitePlaneRenderer::fillCommandBuffer(VkCommandBuffer commandBuffer, siz
 
 void InfinitePlaneRenderer::updateBuffers(size_t currentImage)
 {
-	const UniformBuffer ubo = { proj_, view_, model_, (float)glfwGetTime() };
-	uploadBufferData(ctx_.vkDev, uniforms_[currentImage].memory, 0, &ubo, sizeof(ubo));
+	const UniformBuffer ubo = { proj_, view_, model_, (float)ctx_.time_ };
+	dynamicOffsets_ = { ctx_.frameUniforms.upload(ubo) };
 }
 
 InfinitePlaneRenderer::InfinitePlaneRenderer(VulkanRenderContext& ctx,
@@ -21,27 +21,18 @@ InfinitePlaneRenderer::InfinitePlaneRenderer(VulkanRenderContext& ctx,
 {
 	const PipelineInfo pInfo = initRenderPass(PipelineInfo{}, outputs, screenRenderPass, ctx.screenRenderPass_NoDepth);
 
-	const size_t imgCount = ctx.vkDev.swapchainImages.size();
-	descriptorSets_.resize(imgCount);
-	uniforms_.resize(imgCount);
-
-	DescriptorSetInfo dsInfo = {
+	// A single descriptor set for all swapchain images, the uniforms live in the per-frame allocator
+	const DescriptorSetInfo dsInfo = {
 		.buffers = {
-			uniformBufferAttachment(VulkanBuffer {}, 0, sizeof(UniformBuffer), VK_SHADER_STAGE_VERTEX_BIT)
+			ctx.frameUniforms.attachment(sizeof(UniformBuffer), VK_SHADER_STAGE_VERTEX_BIT)
 		}
 	};
 
 	descriptorSetLayout_ = ctx_.resources.addDescriptorSetLayout(dsInfo);
-	descriptorPool_ = ctx_.resources.addDescriptorPool(dsInfo, imgCount);
-
-	for (size_t i = 0 ; i != imgCount ; i++)
-	{
-		uniforms_[i] = ctx.resources.addUniformBuffer(sizeof(UniformBuffer));
-		dsInfo.buffers[0].buffer = uniforms_[i];
 
-		descriptorSets_[i] = ctx.resources.addDescriptorSet(descriptorPool_, descriptorSetLayout_);
-		ctx.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
-	}
+	const VkDescriptorSet ds = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
+	ctx.resources.updateDescriptorSet(ds, dsInfo);
+	descriptorSets_.assign(ctx.vkDev.swapchainImages.size(), ds);
 
 	initPipeline({ "data/shaders/chapter07/VK03_InfinitePlane.vert", "data/shaders/chapter07/VK03_InfinitePlane.frag" }, pInfo);
 }
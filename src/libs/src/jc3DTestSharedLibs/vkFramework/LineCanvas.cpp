@@ -15,62 +15,138 @@ LineCanvas::LineCanvas(VulkanRenderContext& ctx,
 			.useBlending = false
 		}, outputs, screenRenderPass, ctx.screenRenderPass);
 
+	storageAlignment_ = std::max<VkDeviceSize>(1, getVulkanBufferAlignment(ctx.vkDev));
+
 	const size_t imgCount = ctx.vkDev.swapchainImages.size();
 
 	descriptorSets_.resize(imgCount);
-	storages_.resize(imgCount);
 	uniforms_.resize(imgCount);
 
-	DescriptorSetInfo dsInfo = {
+	const DescriptorSetInfo dsInfo = {
 		.buffers = {
 			uniformBufferAttachment(VulkanBuffer {}, 0, sizeof(UniformBuffer), VK_SHADER_STAGE_VERTEX_BIT),
-			storageBufferAttachment(VulkanBuffer {}, 0, kMaxLinesDataSize,     VK_SHADER_STAGE_VERTEX_BIT)
+			storageBufferAttachment(VulkanBuffer {}, 0, 0, VK_SHADER_STAGE_VERTEX_BIT),
+			storageBufferAttachment(VulkanBuffer {}, 0, 0, VK_SHADER_STAGE_VERTEX_BIT)
 		}
 	};
 
 	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
-	descriptorPool_ = ctx.resources.addDescriptorPool(dsInfo, (uint32_t)imgCount);
 
 	for(size_t i = 0 ; i < imgCount ; i++)
 	{
-		uniforms_[i] = ctx.resources.addUniformBuffer(sizeof(UniformBuffer));
-		storages_[i] = ctx.resources.addStorageBuffer(kMaxLinesDataSize);
-
-		dsInfo.buffers[0].buffer = uniforms_[i];
-		dsInfo.buffers[1].buffer = storages_[i];
-
-		descriptorSets_[i] = ctx.resources.addDescriptorSet(descriptorPool_, descriptorSetLayout_);
-		ctx.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
+		uniforms_[i] = ctx.resources.addUniformBuffer(sizeof(UniformBuffer), true);
+		descriptorSets_[i] = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
 	}
 
+	reserve(lineRing_, kInitialRegionSize);
+	reserve(boxRing_, kInitialRegionSize);
+	updateDescriptorSets();
+
 	initPipeline({ "data/shaders/chapter04/Lines.vert", "data/shaders/chapter04/Lines.frag" }, pInfo);
+
+	// Same layout and render pass, so the descriptor set bound for the lines is used by the boxes as well
+	pendingBoxPipeline_ = ctx.resources.addPipelineAsync(renderPass_.handle, pipelineLayout_,
+		{ "data/shaders/chapter04/LinesInstanced.vert", "data/shaders/chapter04/Lines.frag" }, pInfo);
+}
+
+bool LineCanvas::reserve(FrameRing& ring, VkDeviceSize bytes)
+{
+	if (bytes <= ring.regionSize)
+		return false;
+
+	VkDeviceSize regionSize = std::max(ring.regionSize, kInitialRegionSize);
+	while (regionSize < bytes)
+		regionSize *= 2;
+
+	// Regions start at multiples of the region size
+	regionSize = (regionSize + storageAlignment_ - 1) / storageAlignment_ * storageAlignment_;
+
+	// drawFrame() waits for the device after every frame, so no submitted work uses the old buffer
+	if (ring.buffer.buffer != VK_NULL_HANDLE)
+		ctx_.resources.destroyBuffer(ring.buffer);
+
+	ring.buffer = ctx_.resources.addStorageBuffer(regionSize * ctx_.vkDev.swapchainImages.size(), true);
+	ring.regionSize = regionSize;
+
+	return true;
+}
+
+void LineCanvas::updateDescriptorSets()
+{
+	for (size_t i = 0 ; i < descriptorSets_.size() ; i++)
+	{
+		const DescriptorSetInfo dsInfo = {
+			.buffers = {
+				uniformBufferAttachment(uniforms_[i], 0, sizeof(UniformBuffer), VK_SHADER_STAGE_VERTEX_BIT),
+				storageBufferAttachment(lineRing_.buffer, (uint32_t)(i * lineRing_.regionSize), (uint32_t)lineRing_.regionSize, VK_SHADER_STAGE_VERTEX_BIT),
+				storageBufferAttachment(boxRing_.buffer,  (uint32_t)(i * boxRing_.regionSize),  (uint32_t)boxRing_.regionSize,  VK_SHADER_STAGE_VERTEX_BIT)
+			}
+		};
+
+		ctx_.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
+	}
 }
 
 void LineCanvas::updateBuffers(size_t currentImage)
 {
-	if (lines_.empty())
+	if (lines_.empty() && boxes_.empty())
 		return;
 
-	const VkDeviceSize bufferSize = lines_.size() * sizeof(VertexData);
+	const VkDeviceSize linesSize = lines_.size() * sizeof(VertexData);
+	const VkDeviceSize boxesSize = boxes_.size() * sizeof(BoxInstance);
+
+	// Not '||': both rings have to be checked
+	if (reserve(lineRing_, linesSize) | reserve(boxRing_, boxesSize))
+	{
+		updateDescriptorSets();
+		// This frame binds the sets already, so the writes cannot wait for the next VulkanRenderContext::updateBuffers()
+		ctx_.resources.flushDescriptorUpdates();
+	}
 
-	uploadBufferData(ctx_.vkDev, storages_[currentImage].memory, 0, lines_.data(), bufferSize);
+	// Only the used part of the frame region is written
+	memcpy((uint8_t*)lineRing_.buffer.ptr + currentImage * lineRing_.regionSize, lines_.data(), linesSize);
+	memcpy((uint8_t*)boxRing_.buffer.ptr  + currentImage * boxRing_.regionSize,  boxes_.data(), boxesSize);
 
 	const UniformBuffer ubo = {
 		.mvp = mvp_,
-		.time = (float)glfwGetTime()
+		.time = (float)ctx_.time_
 	};
 
 	updateUniformBuffer(currentImage, 0, sizeof(UniformBuffer), &ubo);
 }
 
+size_t LineCanvas::commandSignature() const
+{
+	size_t signature = hashCombine(Renderer::commandSignature(), lines_.size());
+	signature = hashCombine(signature, boxes_.size());
+	// Re-allocated rings are bound through rewritten descriptor sets
+	signature = hashCombine(signature, reinterpret_cast<size_t>(lineRing_.buffer.buffer));
+	return hashCombine(signature, reinterpret_cast<size_t>(boxRing_.buffer.buffer));
+}
+
 void LineCanvas::fillCommandBuffer(VkCommandBuffer commandBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
 {
-	if (lines_.empty())
+	if (lines_.empty() && boxes_.empty())
 		return;
 
 	beginRenderPass((rp != VK_NULL_HANDLE) ? rp : renderPass_.handle, (fb != VK_NULL_HANDLE) ? fb : framebuffer_, commandBuffer, currentImage);
 
-	vkCmdDraw( commandBuffer, static_cast<uint32_t>(lines_.size()), 1, 0, 0 );
+	if (!lines_.empty())
+		vkCmdDraw( commandBuffer, static_cast<uint32_t>(lines_.size()), 1, 0, 0 );
+
+	if (!boxes_.empty())
+	{
+		if (pendingBoxPipeline_.valid())
+		{
+			boxPipeline_ = VulkanResources::waitPipeline(pendingBoxPipeline_);
+			pendingBoxPipeline_ = {};
+		}
+
+		// 12 edges per instance
+		vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boxPipeline_ );
+		vkCmdDraw( commandBuffer, 24, static_cast<uint32_t>(boxes_.size()), 0, 0 );
+	}
+
 	vkCmdEndRenderPass( commandBuffer );
 }
 
@@ -80,6 +156,11 @@ void LineCanvas::line(const vec3& p1, const vec3& p2, const vec4& c)
 	lines_.push_back( { .position = p2, .color = c } );
 }
 
+void LineCanvas::box(const glm::mat4& m, const vec4& color)
+{
+	boxes_.push_back( { .model = m, .color = color } );
+}
+
 void LineCanvas::plane3d(const vec3& o, const vec3& v1, const vec3& v2, int n1, int n2, float s1, float s2, const vec4& color, const vec4& outlineColor)
 {
 	line(o - s1 / 2.0f * v1 - s2 / 2.0f * v2, o - s1 / 2.0f * v1 + s2 / 2.0f * v2, outlineColor);
@@ -103,41 +184,9 @@ void LineCanvas::plane3d(const vec3& o, const vec3& v1, const vec3& v2, int n1,
 	}
 }
 
-static void drawBox3d_internal(LineCanvas& canvas, const glm::mat4& m, const glm::vec3& size, const glm::vec4& c)
-{
-	std::array<vec3, 8> pts = {
-		vec3(+size.x, +size.y, +size.z),
-		vec3(+size.x, +size.y, -size.z),
-		vec3(+size.x, -size.y, +size.z),
-		vec3(+size.x, -size.y, -size.z),
-		vec3(-size.x, +size.y, +size.z),
-		vec3(-size.x, +size.y, -size.z),
-		vec3(-size.x, -size.y, +size.z),
-		vec3(-size.x, -size.y, -size.z),
-	};
-
-	for (auto& p: pts)
-		p = vec3(m * vec4(p, 1.f));
-
-	canvas.line(pts[0], pts[1], c);
-	canvas.line(pts[2], pts[3], c);
-	canvas.line(pts[4], pts[5], c);
-	canvas.line(pts[6], pts[7], c);
-
-	canvas.line(pts[0], pts[2], c);
-	canvas.line(pts[1], pts[3], c);
-	canvas.line(pts[4], pts[6], c);
-	canvas.line(pts[5], pts[7], c);
-
-	canvas.line(pts[0], pts[4], c);
-	canvas.line(pts[1], pts[5], c);
-	canvas.line(pts[2], pts[6], c);
-	canvas.line(pts[3], pts[7], c);
-}
-
 void drawBox3d(LineCanvas& canvas, const glm::mat4& m, const BoundingBox& box, const glm::vec4& color)
 {
-	drawBox3d_internal(canvas, m * glm::translate(glm::mat4(1.f), .5f * (box.min_ + box.max_)), 0.5f * vec3(box.max_ - box.min_), color);
+	canvas.box(m * glm::translate(glm::mat4(1.f), .5f * (box.min_ + box.max_)) * glm::scale(glm::mat4(1.f), 0.5f * vec3(box.max_ - box.min_)), color);
 }
 
 void renderCameraFrustum(LineCanvas& C, const mat4& camView, const mat4& camProj, const vec4& camColor)
@@ -147,8 +147,11 @@ MultiRenderer::MultiRenderer(
 	const std::vector<TextureAttachment>& auxTextures)
 : Renderer(ctx)
 , sceneData_(sceneData)
+, vertShaderFile_(vertShaderFile)
+, fragShaderFile_(fragShaderFile)
 {
 	const PipelineInfo pInfo = initRenderPass(PipelineInfo {}, outputs, screenRenderPass, ctx.screenRenderPass);
+	pInfo_ = pInfo;
 
 	const uint32_t indirectDataSize = (uint32_t)sceneData_.shapes_.size() * sizeof(VkDrawIndirectCommand);
 
@@ -156,6 +159,10 @@ MultiRenderer::MultiRenderer(
 	uniforms_.resize(imgCount);
 	shape_.resize(imgCount);
 	indirect_.resize(imgCount);
+	splitIndirect_.resize(imgCount);
+
+	for (uint32_t i = 0; i != (uint32_t)sceneData_.shapes_.size(); i++)
+		hasAlphaTested_ = hasAlphaTested_ || isAlphaTested(i);
 
 	descriptorSets_.resize(imgCount);
 
@@ -190,12 +197,12 @@ MultiRenderer::MultiRenderer(
 		dsInfo.buffers.push_back(b);
 
 	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
-	descriptorPool_ = ctx.resources.addDescriptorPool(dsInfo, (uint32_t)imgCount);
 
 	for (size_t i = 0; i != imgCount; i++)
 	{
 		uniforms_[i] = ctx.resources.addUniformBuffer(uniformBufferSize);
 		indirect_[i] = ctx.resources.addIndirectBuffer(indirectDataSize);
+		splitIndirect_[i] = ctx.resources.addIndirectBuffer(2 * indirectDataSize);
 		updateIndirectBuffers(i);
 
 		shape_[i] = ctx.resources.addStorageBuffer(shapesSize);
@@ -204,21 +211,130 @@ MultiRenderer::MultiRenderer(
 		dsInfo.buffers[0].buffer = uniforms_[i];
 		dsInfo.buffers[3].buffer = shape_[i];
 
-		descriptorSets_[i] = ctx.resources.addDescriptorSet(descriptorPool_, descriptorSetLayout_);
+		descriptorSets_[i] = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
 		ctx.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
 	}
 
 	initPipeline({ vertShaderFile, fragShaderFile }, pInfo);
 }
 
+std::shared_future<VkPipeline> MultiRenderer::requestShadingPipeline(uint32_t index)
+{
+	if (index == 0 || shadingPipelines_[index].valid())
+		return shadingPipelines_[index];
+
+	PipelineInfo pInfo = pInfo_;
+
+	// The prepass already wrote the final depth. Not EQUAL: positions from separately compiled pipelines are not guaranteed to be bit-identical
+	if (index & 1)
+	{
+		pInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		pInfo.depthWrite = false;
+	}
+
+	if (index & 2)
+		pInfo.additiveBlending = true;
+
+	shadingPipelines_[index] = ctx_.resources.addPipelineAsync(renderPass_.handle, pipelineLayout_,
+		{ vertShaderFile_.c_str(), (index & 2) ? OverdrawFragmentShader : fragShaderFile_.c_str() }, pInfo);
+
+	return shadingPipelines_[index];
+}
+
+void MultiRenderer::setDepthPrepass(bool enabled)
+{
+	if (enabled == depthPrepass_)
+		return;
+
+	depthPrepass_ = enabled;
+
+	if (depthPrepass_ && !prepassPipeline_.valid())
+	{
+		// Vertex stage only: the same vertex shader gives the same positions, there is nothing to shade
+		PipelineInfo pInfo = pInfo_;
+		pInfo.colorWrite = false;
+
+		prepassPipeline_ = ctx_.resources.addPipelineAsync(renderPass_.handle, pipelineLayout_, { vertShaderFile_.c_str() }, pInfo);
+	}
+
+	// Alpha-tested shapes are drawn with the default depth state after the opaque ones
+	if (depthPrepass_ && hasAlphaTested_)
+		requestShadingPipeline(overdrawView_ ? 2 : 0);
+
+	requestShadingPipeline((depthPrepass_ ? 1 : 0) | (overdrawView_ ? 2 : 0));
+	invalidateCommands();
+}
+
+void MultiRenderer::setOverdrawView(bool enabled)
+{
+	if (enabled == overdrawView_)
+		return;
+
+	overdrawView_ = enabled;
+
+	requestShadingPipeline((depthPrepass_ ? 1 : 0) | (overdrawView_ ? 2 : 0));
+	if (depthPrepass_ && hasAlphaTested_)
+		requestShadingPipeline(overdrawView_ ? 2 : 0);
+	invalidateCommands();
+}
+
 void MultiRenderer::fillCommandBuffer(VkCommandBuffer commandBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
 {
 	beginRenderPass((rp != VK_NULL_HANDLE) ? rp : renderPass_.handle, (fb != VK_NULL_HANDLE) ? fb : framebuffer_, commandBuffer, currentImage);
 
-	/* For CountKHR (Vulkan 1.1) we may use indirect rendering with GPU-based object counter */
-	/// vkCmdDrawIndirectCountKHR(commandBuffer, indirectBuffers_[currentImage], 0, countBuffers_[currentImage], 0, shapes.size(), sizeof(VkDrawIndirectCommand));
-	/* For Vulkan 1.0 vkCmdDrawIndirect is enough */
-	vkCmdDrawIndirect(commandBuffer, indirect_[currentImage].buffer, 0, (uint32_t)sceneData_.shapes_.size(), sizeof(VkDrawIndirectCommand));
+	const uint32_t numShapes = (uint32_t)sceneData_.shapes_.size();
+
+	// Fragments are counted from zero
+	if (overdrawView_)
+	{
+		const VkClearAttachment clearAttachment = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.colorAttachment = 0,
+			.clearValue = { .color = { 0.0f, 0.0f, 0.0f, 1.0f } }
+		};
+
+		const VkClearRect clearRect = {
+			.rect = getRenderRect(),
+			.baseArrayLayer = 0,
+			.layerCount = 1
+		};
+
+		vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, 1, &clearRect);
+	}
+
+	// The descriptor set stays bound, all pipelines share the layout
+	const uint32_t shadingIndex = (depthPrepass_ ? 1 : 0) | (overdrawView_ ? 2 : 0);
+
+	if (depthPrepass_)
+	{
+		const VkBuffer split = splitIndirect_[currentImage].buffer;
+		const VkDeviceSize alphaTestedOffset = numShapes * sizeof(VkDrawIndirectCommand);
+
+		// Same render pass: the depth written here is visible to the depth test of the next draws without barriers
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VulkanResources::waitPipeline(prepassPipeline_));
+		vkCmdDrawIndirect(commandBuffer, split, 0, numShapes, sizeof(VkDrawIndirectCommand));
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VulkanResources::waitPipeline(requestShadingPipeline(shadingIndex)));
+		vkCmdDrawIndirect(commandBuffer, split, 0, numShapes, sizeof(VkDrawIndirectCommand));
+
+		if (hasAlphaTested_)
+		{
+			const uint32_t alphaTestedIndex = overdrawView_ ? 2 : 0;
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				alphaTestedIndex ? VulkanResources::waitPipeline(requestShadingPipeline(alphaTestedIndex)) : getPipeline());
+			vkCmdDrawIndirect(commandBuffer, split, alphaTestedOffset, numShapes, sizeof(VkDrawIndirectCommand));
+		}
+	}
+	else
+	{
+		if (shadingIndex != 0)
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VulkanResources::waitPipeline(requestShadingPipeline(shadingIndex)));
+
+		/* For CountKHR (Vulkan 1.1) we may use indirect rendering with GPU-based object counter */
+		/// vkCmdDrawIndirectCountKHR(commandBuffer, indirectBuffers_[currentImage], 0, countBuffers_[currentImage], 0, shapes.size(), sizeof(VkDrawIndirectCommand));
+		/* For Vulkan 1.0 vkCmdDrawIndirect is enough */
+		vkCmdDrawIndirect(commandBuffer, indirect_[currentImage].buffer, 0, numShapes, sizeof(VkDrawIndirectCommand));
+	}
 
 	vkCmdEndRenderPass(commandBuffer);
 }
@@ -229,9 +345,21 @@ void MultiRenderer::updateBuffers(size_t imageIndex)
 }
 
 void MultiRenderer::updateIndirectBuffers(size_t currentImage, bool* visibility)
+{
+	fillIndirectBuffer(indirect_[currentImage], visibility, false);
+	fillIndirectBuffer(splitIndirect_[currentImage], visibility, true);
+}
+
+bool MultiRenderer::isAlphaTested(uint32_t shapeIndex) const
+{
+	const uint32_t materialIndex = sceneData_.shapes_[shapeIndex].materialIndex;
+	return materialIndex < sceneData_.materials_.size() && sceneData_.materials_[materialIndex].alphaTest_ > 0.0f;
+}
+
+void MultiRenderer::fillIndirectBuffer(VulkanBuffer& buffer, bool* visibility, bool split)
 {
 	VkDrawIndirectCommand* data = nullptr;
-	vkMapMemory(ctx_.vkDev.device, indirect_[currentImage].memory, 0, sizeof(VkDrawIndirectCommand), 0, (void**)&data);
+	vkMapMemory(ctx_.vkDev.device, buffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&data);
 
 	const uint32_t size = (uint32_t)sceneData_.shapes_.size();
 
@@ -246,8 +374,16 @@ void MultiRenderer::updateIndirectBuffers(size_t currentImage, bool* visibility)
 			.firstVertex = 0,
 			.firstInstance = i
 		};
+
+		// The same draw in the half it belongs to, an empty one in the other
+		if (split)
+		{
+			const bool alphaTested = isAlphaTested(i);
+			data[size + i] = data[i];
+			data[alphaTested ? i : size + i].instanceCount = 0;
+		}
 	}
-	vkUnmapMemory(ctx_.vkDev.device, indirect_[currentImage].memory);
+	vkUnmapMemory(ctx_.vkDev.device, buffer.memory);
 }
 
 bool MultiRenderer::checkLoadedTextures()
@@ -0,0 +1,41 @@
+#include <jc3DTestSharedLibs/vkFramework/PipelinePermutations.h>
+
+PipelinePermutations::PipelinePermutations(VulkanResources& resources, VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+	const std::vector<const char*>& shaderFiles, const PipelineInfo& pInfo, uint32_t numFeatures, uint32_t firstConstantID)
+: resources_(resources)
+, renderPass_(renderPass)
+, pipelineLayout_(pipelineLayout)
+, shaderFiles_(shaderFiles.begin(), shaderFiles.end())
+, pInfo_(pInfo)
+, numFeatures_(numFeatures)
+, firstConstantID_(firstConstantID)
+{
+	if (numFeatures > 32)
+	{
+		printf("Too many pipeline features (%u), 32 at most\n", numFeatures);
+		exit(EXIT_FAILURE);
+	}
+}
+
+std::shared_future<VkPipeline> PipelinePermutations::request(uint32_t features)
+{
+	if (numFeatures_ < 32)
+		features &= (1u << numFeatures_) - 1;
+
+	auto i = variants_.find(features);
+
+	if (i != variants_.end())
+		return i->second;
+
+	// Base specialization constants (if any) are kept, feature constants follow them
+	PipelineInfo pInfo = pInfo_;
+
+	for (uint32_t f = 0 ; f != numFeatures_ ; f++)
+		pInfo.specialization.add(firstConstantID_ + f, (features & (1u << f)) != 0);
+
+	std::vector<const char*> files;
+	for (const auto& f: shaderFiles_)
+		files.push_back(f.c_str());
+
+	return variants_[features] = resources_.addPipelineAsync(renderPass_, pipelineLayout_, files, pInfo);
+}
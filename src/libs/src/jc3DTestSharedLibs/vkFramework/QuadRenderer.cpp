@@ -52,13 +52,12 @@ QuadRenderer::QuadRenderer(VulkanRenderContext& ctx,
 	};
 
 	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
-	descriptorPool_ = ctx.resources.addDescriptorPool(dsInfo, imgCount);
 
 	for (size_t i = 0 ; i < imgCount ; i++)
 	{
 		storages_[i] = ctx.resources.addStorageBuffer(vertexBufferSize);
 		dsInfo.buffers[0].buffer = storages_[i];
-		descriptorSets_[i] = ctx.resources.addDescriptorSet(descriptorPool_, descriptorSetLayout_);
+		descriptorSets_[i] = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
 		ctx.resources.updateDescriptorSet(descriptorSets_[i], dsInfo);
 	}
 
@@ -0,0 +1,779 @@
+#include <jc3DTestSharedLibs/vkFramework/RenderGraph.h>
+
+#include <algorithm>
+
+struct RenderGraphAccessInfo
+{
+	VkImageLayout layout;
+	VkPipelineStageFlags stage;
+	VkAccessFlags access;
+	bool write;
+	// Depends on the previous contents. A color attachment is not: graphics passes overwrite their whole output
+	bool read;
+	VkImageUsageFlags usage;
+};
+
+static const RenderGraphAccessInfo kAccessInfo[] =
+{
+	/* eRenderGraphAccess_ColorAttachment */ { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true, false, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT },
+	/* eRenderGraphAccess_SampledFragment */ { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT, false, true, VK_IMAGE_USAGE_SAMPLED_BIT },
+	/* eRenderGraphAccess_SampledCompute  */ { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT, false, true, VK_IMAGE_USAGE_SAMPLED_BIT },
+	/* eRenderGraphAccess_StorageRead     */ { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT, false, true, VK_IMAGE_USAGE_STORAGE_BIT },
+	/* eRenderGraphAccess_StorageWrite    */ { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, true, false, VK_IMAGE_USAGE_STORAGE_BIT },
+	/* eRenderGraphAccess_StorageReadWrite */ { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true, true, VK_IMAGE_USAGE_STORAGE_BIT },
+};
+
+static constexpr VkAccessFlags kWriteAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+// Imported textures and outputs are sampled by renderers outside of the graph
+static constexpr VkPipelineStageFlags kExternalReadStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+RenderGraph::RenderGraph(VulkanRenderContext& c, const char* name)
+: Renderer(c)
+, name_(name)
+{}
+
+RenderGraph::~RenderGraph()
+{
+	destroyTransients();
+
+	if (timestampPool_ != VK_NULL_HANDLE)
+		vkDestroyQueryPool(ctx_.vkDev.device, timestampPool_, nullptr);
+}
+
+void RenderGraph::destroyTransients()
+{
+	for (auto& t: textures_)
+	{
+		if (!t.transient || !t.texture.image.image)
+			continue;
+
+		vkDestroySampler(ctx_.vkDev.device, t.texture.sampler, nullptr);
+		vkDestroyImageView(ctx_.vkDev.device, t.texture.image.imageView, nullptr);
+		vkDestroyImage(ctx_.vkDev.device, t.texture.image.image, nullptr);
+
+		t.texture.image = VulkanImage {};
+		t.texture.sampler = VK_NULL_HANDLE;
+		t.slot = -1;
+	}
+
+	for (auto& s: slots_)
+		vkFreeMemory(ctx_.vkDev.device, s.memory, nullptr);
+
+	slots_.clear();
+
+	transientBytes_ = 0;
+	aliasedBytes_ = 0;
+}
+
+uint32_t RenderGraph::importTexture(const char* name, VulkanTexture tex, VkImageLayout layout)
+{
+	Texture t;
+	t.name = name;
+	t.texture = tex;
+	t.externalLayout = layout;
+
+	textures_.push_back(t);
+	return (uint32_t)textures_.size() - 1;
+}
+
+uint32_t RenderGraph::addTransientTexture(const char* name, int width, int height, VkFormat format, VkFilter filter, VkSamplerAddressMode addressMode)
+{
+	Texture t;
+	t.name = name;
+	t.transient = true;
+	t.filter = filter;
+	t.addressMode = addressMode;
+	t.requestedWidth = width;
+	t.requestedHeight = height;
+	t.texture = VulkanTexture {
+		.depth = 1,
+		.format = format
+	};
+	updateTransientSize(t);
+
+	textures_.push_back(t);
+	return (uint32_t)textures_.size() - 1;
+}
+
+uint32_t RenderGraph::addScaledTransientTexture(const char* name, uint32_t downscale, VkFormat format, VkFilter filter, VkSamplerAddressMode addressMode)
+{
+	const uint32_t tex = addTransientTexture(name, 0, 0, format, filter, addressMode);
+
+	textures_[tex].downscale = downscale;
+	updateTransientSize(textures_[tex]);
+
+	return tex;
+}
+
+void RenderGraph::updateTransientSize(Texture& t) const
+{
+	t.texture.width  = (t.requestedWidth  > 0) ? (uint32_t)t.requestedWidth  : std::max(ctx_.vkDev.framebufferWidth  >> t.downscale, 1u);
+	t.texture.height = (t.requestedHeight > 0) ? (uint32_t)t.requestedHeight : std::max(ctx_.vkDev.framebufferHeight >> t.downscale, 1u);
+}
+
+uint32_t RenderGraph::addPass(const char* name, const std::vector<RenderGraphUse>& uses, const PassFactory& factory, const PassUpdater& updater)
+{
+	for (const auto& u: uses)
+		if (u.texture >= textures_.size())
+		{
+			printf("RenderGraph '%s': pass '%s' uses an unknown texture %u\n", name_.c_str(), name, u.texture);
+			exit(EXIT_FAILURE);
+		}
+
+	Pass p;
+	p.name = name;
+	p.uses = uses;
+	p.factory = factory;
+	p.updater = updater;
+
+	passes_.push_back(std::move(p));
+	return (uint32_t)passes_.size() - 1;
+}
+
+void RenderGraph::markOutput(uint32_t tex)
+{
+	textures_[tex].output = true;
+}
+
+VulkanTexture RenderGraph::getTexture(uint32_t tex) const
+{
+	return textures_[tex].texture;
+}
+
+void RenderGraph::compile()
+{
+	if (compiled_)
+	{
+		printf("RenderGraph '%s' is already compiled\n", name_.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	cullPasses();
+	updateLiveness();
+	computeLifetimes();
+	allocateTransients();
+
+	for (auto& p: passes_)
+	{
+		if (p.culled)
+			continue;
+
+		p.renderer = p.factory();
+
+		if (!p.renderer)
+		{
+			printf("RenderGraph '%s': cannot create pass '%s'\n", name_.c_str(), p.name.c_str());
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	compiled_ = true;
+
+	// Dry run to collect barrier statistics for the initial set of enabled passes
+	record(VK_NULL_HANDLE, 0);
+	printStats();
+}
+
+void RenderGraph::setImportedTexture(uint32_t tex, VulkanTexture texture)
+{
+	if (textures_[tex].transient)
+	{
+		printf("RenderGraph '%s': '%s' is not an imported texture\n", name_.c_str(), textures_[tex].name.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	textures_[tex].texture = texture;
+}
+
+void RenderGraph::rebuild()
+{
+	if (!compiled_)
+	{
+		printf("RenderGraph '%s' is rebuilt before compile()\n", name_.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	bool sizeChanged = false;
+
+	for (auto& t: textures_)
+	{
+		if (!t.transient)
+			continue;
+
+		const uint32_t w = t.texture.width;
+		const uint32_t h = t.texture.height;
+
+		updateTransientSize(t);
+
+		sizeChanged |= (w != t.texture.width || h != t.texture.height);
+	}
+
+	// Lifetimes and usage do not depend on the size, so only the images and their memory blocks are re-created
+	if (sizeChanged)
+	{
+		destroyTransients();
+		allocateTransients();
+	}
+
+	// Passes are updated in recording order, i.e. producers before consumers
+	for (auto& p: passes_)
+	{
+		if (!p.renderer)
+			continue;
+
+		if (p.updater)
+			p.updater(*p.renderer);
+		else
+			p.renderer = p.factory();
+	}
+
+	invalidateCommands();
+}
+
+void RenderGraph::cullPasses()
+{
+	std::vector<bool> needed(textures_.size());
+
+	for (size_t i = 0; i != textures_.size(); i++)
+		needed[i] = textures_[i].output;
+
+	// Walk backwards: a pass is alive if it writes something that is needed, and then everything it reads becomes needed.
+	// Writes never clear the 'needed' flag because passes can be disabled at run time (ping-pong pairs); reads
+	// of previous contents (StorageReadWrite) are declared explicitly, so this does not hide missing dependencies
+	for (auto p = passes_.rbegin(); p != passes_.rend(); p++)
+	{
+		p->culled = true;
+
+		for (const auto& u: p->uses)
+			if (kAccessInfo[u.access].write && needed[u.texture])
+				p->culled = false;
+
+		if (p->culled)
+			continue;
+
+		for (const auto& u: p->uses)
+			if (kAccessInfo[u.access].read)
+				needed[u.texture] = true;
+	}
+}
+
+void RenderGraph::updateLiveness()
+{
+	std::vector<bool> needed(textures_.size());
+
+	for (size_t i = 0; i != textures_.size(); i++)
+		needed[i] = textures_[i].output;
+
+	// The same walk as in cullPasses(), restricted to the enabled passes
+	for (auto p = passes_.rbegin(); p != passes_.rend(); p++)
+	{
+		p->live = false;
+
+		if (p->culled || !p->enabled)
+			continue;
+
+		for (const auto& u: p->uses)
+			if (kAccessInfo[u.access].write && needed[u.texture])
+				p->live = true;
+
+		if (!p->live)
+			continue;
+
+		for (const auto& u: p->uses)
+			if (kAccessInfo[u.access].read)
+				needed[u.texture] = true;
+	}
+}
+
+void RenderGraph::computeLifetimes()
+{
+	for (int i = 0; i != (int)passes_.size(); i++)
+	{
+		if (passes_[i].culled)
+			continue;
+
+		for (const auto& u: passes_[i].uses)
+		{
+			Texture& t = textures_[u.texture];
+			const auto& a = kAccessInfo[u.access];
+
+			if (t.firstUse < 0 && t.transient && a.read)
+				printf("RenderGraph '%s': pass '%s' reads '%s' before it is written\n", name_.c_str(), passes_[i].name.c_str(), t.name.c_str());
+
+			if (t.firstUse < 0)
+				t.firstUse = i;
+			t.lastUse = i;
+
+			t.usage |= a.usage;
+			t.stages |= a.stage;
+			if (a.write)
+				t.writeAccess |= (a.access & kWriteAccessMask);
+		}
+	}
+
+	for (auto& t: textures_)
+		if (t.output && t.firstUse >= 0)
+		{
+			t.lastUse = (int)passes_.size();
+			t.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+			t.stages |= kExternalReadStages;
+		}
+}
+
+void RenderGraph::allocateTransients()
+{
+	VulkanRenderDevice& vkDev = ctx_.vkDev;
+
+	std::vector<uint32_t> order;
+	std::vector<VkMemoryRequirements> requirements(textures_.size());
+
+	for (uint32_t i = 0; i != textures_.size(); i++)
+	{
+		Texture& t = textures_[i];
+
+		if (!t.transient || t.firstUse < 0)
+			continue;
+
+		const VkImageCreateInfo imageInfo = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = t.texture.format,
+			.extent = VkExtent3D {.width = t.texture.width, .height = t.texture.height, .depth = 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = t.usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = nullptr,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+		};
+
+		VK_CHECK(vkCreateImage(vkDev.device, &imageInfo, nullptr, &t.texture.image.image));
+		vkGetImageMemoryRequirements(vkDev.device, t.texture.image.image, &requirements[i]);
+
+		t.size = requirements[i].size;
+		transientBytes_ += t.size;
+
+		order.push_back(i);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return textures_[a].firstUse < textures_[b].firstUse; });
+
+	// Greedy interval assignment: reuse the free slot with the closest size, outputs always get a slot of their own
+	for (uint32_t i: order)
+	{
+		Texture& t = textures_[i];
+		const VkMemoryRequirements& req = requirements[i];
+
+		int best = -1;
+
+		if (!t.output)
+			for (int s = 0; s != (int)slots_.size(); s++)
+			{
+				const MemorySlot& slot = slots_[s];
+
+				if (slot.lastUse >= t.firstUse || !(slot.memoryTypeBits & req.memoryTypeBits))
+					continue;
+
+				const auto cost = [&req](const MemorySlot& m) { return (m.size > req.size) ? m.size - req.size : 2 * (req.size - m.size); };
+
+				if (best < 0 || cost(slot) < cost(slots_[best]))
+					best = s;
+			}
+
+		if (best < 0)
+		{
+			slots_.emplace_back();
+			best = (int)slots_.size() - 1;
+		}
+
+		MemorySlot& slot = slots_[best];
+		slot.size = std::max(slot.size, req.size);
+		slot.memoryTypeBits &= req.memoryTypeBits;
+		slot.lastUse = t.lastUse;
+		slot.stages |= t.stages;
+		slot.writeAccess |= t.writeAccess;
+
+		t.slot = best;
+	}
+
+	for (auto& s: slots_)
+	{
+		const VkMemoryAllocateInfo allocInfo = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.allocationSize = s.size,
+			.memoryTypeIndex = findMemoryType(vkDev.physicalDevice, s.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+		};
+
+		if (allocInfo.memoryTypeIndex == 0xFFFFFFFF)
+		{
+			printf("RenderGraph '%s': no memory type for transient textures\n", name_.c_str());
+			exit(EXIT_FAILURE);
+		}
+
+		VK_CHECK(vkAllocateMemory(vkDev.device, &allocInfo, nullptr, &s.memory));
+
+		aliasedBytes_ += s.size;
+	}
+
+	for (uint32_t i: order)
+	{
+		Texture& t = textures_[i];
+
+		t.texture.image.imageMemory = slots_[t.slot].memory;
+		VK_CHECK(vkBindImageMemory(vkDev.device, t.texture.image.image, t.texture.image.imageMemory, 0));
+
+		createImageView(vkDev.device, t.texture.image.image, t.texture.format, VK_IMAGE_ASPECT_COLOR_BIT, &t.texture.image.imageView);
+		createTextureSampler(vkDev.device, &t.texture.sampler, t.filter, t.filter, t.addressMode);
+
+		setVkImageName(vkDev, t.texture.image.image, t.name.c_str());
+	}
+}
+
+void RenderGraph::addBarrier(BarrierBatch& batch, const Texture& tex, ImageState& state,
+	VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, bool write,
+	std::vector<ImageState>& slotStates)
+{
+	const VkImageLayout oldLayout = state.layout;
+	const bool layoutChange = (oldLayout != newLayout);
+
+	VkPipelineStageFlags srcStages = 0;
+	VkAccessFlags srcAccess = 0;
+
+	if (tex.transient && oldLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+	{
+		// First use in this frame: contents are discarded, but the memory may still be accessed by the previous occupant of the slot
+		ImageState& slot = slotStates[tex.slot];
+		srcStages = slot.writeStages | slot.readStages;
+		srcAccess = slot.writeAccess;
+		slot = ImageState {};
+	}
+	else if (write)
+	{
+		// WAW and WAR hazards
+		srcStages = state.writeStages | state.readStages | state.visibleStages;
+		srcAccess = state.writeAccess;
+	}
+	else
+	{
+		const bool visible = !state.writeAccess || ((state.visibleStages & dstStage) == dstStage);
+
+		if (!layoutChange && visible)
+		{
+			state.readStages |= dstStage;
+			return;
+		}
+
+		// RAW hazard; a layout transition also has to wait for the preceding readers
+		srcStages = state.writeStages | state.visibleStages | (layoutChange ? state.readStages : 0);
+		srcAccess = state.writeAccess;
+	}
+
+	batch.srcStages |= srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	batch.dstStages |= dstStage;
+	batch.barriers.push_back(VkImageMemoryBarrier {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = srcAccess,
+		.dstAccessMask = dstAccess,
+		.oldLayout = oldLayout,
+		.newLayout = newLayout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = tex.texture.image.image,
+		.subresourceRange = VkImageSubresourceRange {
+			.aspectMask = (VkImageAspectFlags)(isDepthFormat(tex.texture.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT),
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1
+		}
+	});
+
+	if (write)
+	{
+		state = ImageState {
+			.layout = newLayout,
+			.writeStages = dstStage,
+			.writeAccess = dstAccess & kWriteAccessMask
+		};
+	}
+	else
+	{
+		state.layout = newLayout;
+		state.readStages = layoutChange ? dstStage : (state.readStages | dstStage);
+		state.visibleStages = layoutChange ? dstStage : (state.visibleStages | dstStage);
+	}
+}
+
+void RenderGraph::flushBarriers(VkCommandBuffer cmdBuffer, BarrierBatch& batch)
+{
+	if (batch.barriers.empty())
+		return;
+
+	barrierBatches_++;
+	imageBarriers_ += (uint32_t)batch.barriers.size();
+
+	if (cmdBuffer != VK_NULL_HANDLE)
+		vkCmdPipelineBarrier(cmdBuffer, batch.srcStages, batch.dstStages, 0,
+			0, nullptr,
+			0, nullptr,
+			(uint32_t)batch.barriers.size(), batch.barriers.data());
+
+	batch = BarrierBatch {};
+}
+
+void RenderGraph::record(VkCommandBuffer cmdBuffer, size_t currentImage)
+{
+	std::vector<ImageState> states(textures_.size());
+	std::vector<ImageState> slotStates(slots_.size());
+
+	for (size_t i = 0; i != textures_.size(); i++)
+		if (!textures_[i].transient)
+			states[i] = ImageState { .layout = textures_[i].externalLayout, .readStages = kExternalReadStages };
+
+	// The previous frame could have touched the slot with any of its occupants
+	for (size_t i = 0; i != slots_.size(); i++)
+		slotStates[i] = ImageState { .writeAccess = slots_[i].writeAccess, .readStages = slots_[i].stages };
+
+	barrierBatches_ = 0;
+	imageBarriers_ = 0;
+
+	BarrierBatch batch;
+
+	const uint32_t numQueries = (uint32_t)passes_.size() + 1;
+	const uint32_t firstQuery = (uint32_t)currentImage * numQueries;
+
+	if (cmdBuffer != VK_NULL_HANDLE && timestampPool_ != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(cmdBuffer, timestampPool_, firstQuery, numQueries);
+		vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_, firstQuery);
+	}
+
+	for (size_t i = 0; i != passes_.size(); i++)
+	{
+		Pass& p = passes_[i];
+
+		if (!p.live)
+			continue;
+
+		for (const auto& u: p.uses)
+		{
+			const auto& a = kAccessInfo[u.access];
+			addBarrier(batch, textures_[u.texture], states[u.texture], a.layout, a.stage, a.access, a.write, slotStates);
+
+			if (textures_[u.texture].transient)
+			{
+				ImageState& slot = slotStates[textures_[u.texture].slot];
+				slot.readStages |= a.stage;
+				if (a.write)
+					slot.writeAccess |= (a.access & kWriteAccessMask);
+			}
+		}
+
+		flushBarriers(cmdBuffer, batch);
+
+		if (cmdBuffer == VK_NULL_HANDLE)
+			continue;
+
+		const VkRenderPass rp = p.renderer->renderPass_.handle;
+		const VkFramebuffer fb = p.renderer->framebuffer_;
+
+		p.renderer->fillCommandBuffer(cmdBuffer, currentImage, fb, rp);
+
+		// The time of a pass includes the barriers in front of it
+		if (timestampPool_ != VK_NULL_HANDLE)
+			vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool_, firstQuery + 1 + (uint32_t)i);
+	}
+
+	// Return imported textures and outputs in the layout expected by the rest of the frame
+	for (size_t i = 0; i != textures_.size(); i++)
+	{
+		const Texture& t = textures_[i];
+
+		if (t.firstUse < 0 || (t.transient && !t.output))
+			continue;
+
+		addBarrier(batch, t, states[i], t.externalLayout, kExternalReadStages, VK_ACCESS_SHADER_READ_BIT, false, slotStates);
+	}
+
+	flushBarriers(cmdBuffer, batch);
+}
+
+void RenderGraph::fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
+{
+	if (!compiled_)
+	{
+		printf("RenderGraph '%s' is used before compile()\n", name_.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	record(cmdBuffer, currentImage);
+}
+
+void RenderGraph::updateBuffers(size_t currentImage)
+{
+	readTimestamps(currentImage);
+
+	for (auto& p: passes_)
+		if (p.renderer)
+			p.renderer->updateBuffers(currentImage);
+}
+
+void RenderGraph::setTimestampsEnabled(bool enabled)
+{
+	if (enabled == isTimestampsEnabled())
+		return;
+
+	if (!enabled)
+	{
+		vkDestroyQueryPool(ctx_.vkDev.device, timestampPool_, nullptr);
+		timestampPool_ = VK_NULL_HANDLE;
+		invalidateCommands();
+		return;
+	}
+
+	VkPhysicalDeviceProperties devProps;
+	vkGetPhysicalDeviceProperties(ctx_.vkDev.physicalDevice, &devProps);
+
+	if (!devProps.limits.timestampComputeAndGraphics)
+	{
+		printf("RenderGraph '%s': timestamp queries are not supported\n", name_.c_str());
+		return;
+	}
+
+	timestampPeriodNs_ = devProps.limits.timestampPeriod;
+
+	const VkQueryPoolCreateInfo ci = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = (uint32_t)((passes_.size() + 1) * ctx_.vkDev.swapchainImages.size()),
+		.pipelineStatistics = 0
+	};
+
+	VK_CHECK(vkCreateQueryPool(ctx_.vkDev.device, &ci, nullptr, &timestampPool_));
+
+	// The queries are reset by the recorded commands, so they have to be re-recorded
+	invalidateCommands();
+}
+
+void RenderGraph::readTimestamps(size_t currentImage)
+{
+	if (timestampPool_ == VK_NULL_HANDLE)
+		return;
+
+	const uint32_t numQueries = (uint32_t)passes_.size() + 1;
+
+	// (value, availability) pairs; queries of skipped passes and of a not yet submitted image are unavailable
+	std::vector<uint64_t> results(2 * numQueries);
+
+	const VkResult res = vkGetQueryPoolResults(ctx_.vkDev.device, timestampPool_, (uint32_t)currentImage * numQueries, numQueries,
+		results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	if (res != VK_SUCCESS && res != VK_NOT_READY)
+		return;
+
+	uint64_t prev = results[0];
+	bool prevValid = (results[1] != 0);
+
+	for (size_t i = 0; i != passes_.size(); i++)
+	{
+		const uint64_t t = results[2 * (i + 1)];
+		const bool valid = (results[2 * (i + 1) + 1] != 0);
+
+		passes_[i].gpuTimeMs = (valid && prevValid) ? (float)((double)(t - prev) * timestampPeriodNs_ * 1e-6) : 0.0f;
+
+		if (valid)
+		{
+			prev = t;
+			prevValid = true;
+		}
+	}
+}
+
+float RenderGraph::getTotalTimeMs() const
+{
+	float total = 0.0f;
+
+	for (const auto& p: passes_)
+		total += p.gpuTimeMs;
+
+	return total;
+}
+
+void RenderGraph::printTimings() const
+{
+	printf("RenderGraph '%s': %.3f ms GPU\n", name_.c_str(), getTotalTimeMs());
+
+	for (const auto& p: passes_)
+		if (p.live)
+			printf("    %-20s %.3f ms\n", p.name.c_str(), p.gpuTimeMs);
+
+	fflush(stdout);
+}
+
+bool RenderGraph::isStatic() const
+{
+	for (const auto& p: passes_)
+		if (p.live && !p.renderer->isStatic())
+			return false;
+
+	return true;
+}
+
+size_t RenderGraph::commandSignature() const
+{
+	size_t signature = Renderer::commandSignature();
+
+	for (const auto& p: passes_)
+	{
+		if (!p.renderer)
+			continue;
+
+		signature = hashCombine(signature, p.live ? 1 : 0);
+		if (p.live)
+			signature = hashCombine(signature, p.renderer->commandSignature());
+	}
+
+	return signature;
+}
+
+void RenderGraph::printStats() const
+{
+	uint32_t numCulled = 0;
+	uint32_t numEnabled = 0;
+	uint32_t numTransients = 0;
+
+	for (const auto& p: passes_)
+	{
+		numCulled += p.culled ? 1 : 0;
+		numEnabled += p.live ? 1 : 0;
+	}
+
+	for (const auto& t: textures_)
+		numTransients += (t.transient && t.firstUse >= 0) ? 1 : 0;
+
+	const double MB = 1024.0 * 1024.0;
+
+	printf("RenderGraph '%s': %u passes (%u culled), %u transient textures in %u memory blocks\n",
+		name_.c_str(), (uint32_t)passes_.size(), numCulled, numTransients, (uint32_t)slots_.size());
+	printf("    Transient memory: %.2f MB (%.2f MB without aliasing)\n", (double)aliasedBytes_ / MB, (double)transientBytes_ / MB);
+	// Hand-chained passes used a ShaderOptimalToColor/ColorToShaderOptimal pair around every pass
+	printf("    Barriers per frame: %u vkCmdPipelineBarrier() calls with %u image barriers (%u with barrier renderers)\n",
+		barrierBatches_, imageBarriers_, 2 * numEnabled);
+	fflush(stdout);
+}
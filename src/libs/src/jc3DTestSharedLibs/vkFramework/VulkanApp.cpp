@@ -1,5 +1,8 @@
 #include <jc3DTestSharedLibs/vkFramework/VulkanApp.h>
 #include <jc3DTestSharedLibs/vkFramework/Renderer.h>
+#include <jc3DTestSharedLibs/EasyProfilerWrapper.h>
+
+#include <algorithm>
 
 Resolution detectResolution(int width, int height)
 {
@@ -33,7 +36,7 @@ GLFWwindow* initVulkanApp(int width, int height, Resolution* resolution)
 		exit(EXIT_FAILURE);
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
 
 	if (resolution)
 	{
@@ -52,49 +55,143 @@ GLFWwindow* initVulkanApp(int width, int height, Resolution* resolution)
 	return result;
 }
 
-bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc)
+GLFWwindow* initVulkanAppHeadless(int width, int height, Resolution* resolution)
+{
+	glslang_initialize_process();
+
+	volkInitialize();
+
+	if (resolution)
+	{
+		resolution->width  = width  > 0 ? width  : (uint32_t)(1920 * width  / -100);
+		resolution->height = height > 0 ? height : (uint32_t)(1080 * height / -100);
+	}
+
+	return nullptr;
+}
+
+VulkanContextFeatures applyHeadlessOverride(const VulkanContextFeatures& ctxFeatures)
+{
+	VulkanContextFeatures result = ctxFeatures;
+
+	if (const char* frames = getenv("JC3D_HEADLESS"))
+	{
+		result.headless_ = true;
+		result.headlessFrameCount_ = (uint32_t)atoi(frames);
+	}
+
+	return result;
+}
+
+bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& updateBuffersFunc, const std::function<void(VkCommandBuffer, uint32_t)>& composeFrameFunc,
+	const std::function<bool(uint32_t)>& isCommandBufferValidFunc)
 {
 	uint32_t imageIndex = 0;
-	VkResult result = vkAcquireNextImageKHR(vkDev.device, vkDev.swapchain, 0, vkDev.semaphore, VK_NULL_HANDLE, &imageIndex);
-	VK_CHECK(vkResetCommandPool(vkDev.device, vkDev.commandPool, 0));
+	VkResult result = VK_SUCCESS;
+
+	if (vkDev.headless)
+	{
+		// The previous frame is complete (see vkDeviceWaitIdle() below), so the next offscreen image is always available
+		imageIndex = vkDev.headlessImageIndex;
+		vkDev.headlessImageIndex = (imageIndex + 1) % static_cast<uint32_t>(vkDev.swapchainImages.size());
+	}
+	else
+		result = vkAcquireNextImageKHR(vkDev.device, vkDev.swapchain, 0, vkDev.semaphore, VK_NULL_HANDLE, &imageIndex);
+
+	// Cached command buffers must survive, so they are reset one by one in vkBeginCommandBuffer()
+	if (!isCommandBufferValidFunc)
+		VK_CHECK(vkResetCommandPool(vkDev.device, vkDev.commandPool, 0));
 
-	if (result != VK_SUCCESS) return false;
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		vkDev.swapchainOutOfDate = true;
+		return false;
+	}
+
+	// A suboptimal image has been acquired and its semaphore will be signaled, so the frame still has to be presented
+	if (result == VK_SUBOPTIMAL_KHR)
+		vkDev.swapchainOutOfDate = true;
+	else if (result != VK_SUCCESS)
+		return false;
 
 	updateBuffersFunc(imageIndex);
 
 	VkCommandBuffer commandBuffer = vkDev.commandBuffers[imageIndex];
 
-	const VkCommandBufferBeginInfo bi =
+	if (!isCommandBufferValidFunc || !isCommandBufferValidFunc(imageIndex))
 	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.pNext = nullptr,
-		.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-		.pInheritanceInfo = nullptr
-	};
+		EASY_BLOCK("RecordCommandBuffer");
 
-	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &bi));
+		const VkCommandBufferBeginInfo bi =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = nullptr,
+			.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+			.pInheritanceInfo = nullptr
+		};
+
+		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &bi));
+
+		composeFrameFunc(commandBuffer, imageIndex);
 
-	composeFrameFunc(commandBuffer, imageIndex);
+		VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+		EASY_END_BLOCK;
+	}
+
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<VkPipelineStageFlags> waitStages;
+	std::vector<uint64_t> waitValues;
+
+	if (!vkDev.headless)
+	{
+		waitSemaphores.push_back(vkDev.semaphore);
+		waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT); // or even VERTEX_SHADER_STAGE
+		waitValues.push_back(0);
+	}
 
-	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+	// Results of async compute queued during updateBuffersFunc()
+	const bool hasFrameWaits = !vkDev.frameWaitSemaphores.empty();
 
-	const VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }; // or even VERTEX_SHADER_STAGE
+	waitSemaphores.insert(waitSemaphores.end(), vkDev.frameWaitSemaphores.begin(), vkDev.frameWaitSemaphores.end());
+	waitStages.insert(waitStages.end(), vkDev.frameWaitStages.begin(), vkDev.frameWaitStages.end());
+	waitValues.insert(waitValues.end(), vkDev.frameWaitValues.begin(), vkDev.frameWaitValues.end());
+
+	vkDev.frameWaitSemaphores.clear();
+	vkDev.frameWaitStages.clear();
+	vkDev.frameWaitValues.clear();
+
+	const VkTimelineSemaphoreSubmitInfoKHR timelineInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+		.pNext = nullptr,
+		.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size()),
+		.pWaitSemaphoreValues = waitValues.data(),
+		.signalSemaphoreValueCount = 0,
+		.pSignalSemaphoreValues = nullptr
+	};
 
 	const VkSubmitInfo si =
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = nullptr,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &vkDev.semaphore,
-		.pWaitDstStageMask = waitStages,
+		.pNext = (hasFrameWaits && vkDev.timelineSemaphores) ? &timelineInfo : nullptr,
+		.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+		.pWaitSemaphores = waitSemaphores.data(),
+		.pWaitDstStageMask = waitStages.data(),
 		.commandBufferCount = 1,
 		.pCommandBuffers = &vkDev.commandBuffers[imageIndex],
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &vkDev.renderSemaphore
+		.signalSemaphoreCount = vkDev.headless ? 0u : 1u,
+		.pSignalSemaphores = vkDev.headless ? nullptr : &vkDev.renderSemaphore
 	};
 
 	VK_CHECK(vkQueueSubmit(vkDev.graphicsQueue, 1, &si, nullptr));
 
+	if (vkDev.headless)
+	{
+		VK_CHECK(vkDeviceWaitIdle(vkDev.device));
+		return true;
+	}
+
 	const VkPresentInfoKHR pi =
 	{
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -106,19 +203,187 @@ bool drawFrame(VulkanRenderDevice& vkDev, const std::function<void(uint32_t)>& u
 		.pImageIndices = &imageIndex
 	};
 
-	VK_CHECK(vkQueuePresentKHR(vkDev.graphicsQueue, &pi));
+	result = vkQueuePresentKHR(vkDev.graphicsQueue, &pi);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		vkDev.swapchainOutOfDate = true;
+	else
+		VK_CHECK(result);
+
 	VK_CHECK(vkDeviceWaitIdle(vkDev.device));
 
 	return true;
 }
 
+void cullRenderItems(std::vector<RenderItem>& items)
+{
+	std::vector<VkImage> needed;
+
+	// Walk backwards like RenderGraph::cullPasses(): 'needed' is never cleared, so every earlier writer of a needed image stays
+	for (auto r = items.rbegin(); r != items.rend(); r++)
+	{
+		r->culled_ = false;
+
+		if (!r->enabled_)
+			continue;
+
+		if (!r->outputs_.empty())
+			r->culled_ = std::none_of(r->outputs_.begin(), r->outputs_.end(),
+				[&needed](VkImage img) { return std::find(needed.begin(), needed.end(), img) != needed.end(); });
+
+		if (r->culled_)
+			continue;
+
+		for (VkImage img: r->inputs_)
+			if (std::find(needed.begin(), needed.end(), img) == needed.end())
+				needed.push_back(img);
+	}
+}
+
+VulkanRenderContext::~VulkanRenderContext()
+{
+	if (frameTimestamps_ != VK_NULL_HANDLE)
+		vkDestroyQueryPool(vkDev.device, frameTimestamps_, nullptr);
+}
+
+void VulkanRenderContext::enableGpuFrameTimer()
+{
+	if (frameTimestamps_ != VK_NULL_HANDLE)
+		return;
+
+	VkPhysicalDeviceProperties devProps;
+	vkGetPhysicalDeviceProperties(vkDev.physicalDevice, &devProps);
+
+	if (!devProps.limits.timestampComputeAndGraphics)
+	{
+		printf("GPU frame timer: timestamp queries are not supported\n");
+		return;
+	}
+
+	timestampPeriodNs_ = devProps.limits.timestampPeriod;
+
+	const VkQueryPoolCreateInfo ci = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = 2 * (uint32_t)vkDev.swapchainImages.size(),
+		.pipelineStatistics = 0
+	};
+
+	VK_CHECK(vkCreateQueryPool(vkDev.device, &ci, nullptr, &frameTimestamps_));
+
+	// The timestamps are written by the recorded command buffers
+	recordedSignatures_.assign(recordedSignatures_.size(), std::nullopt);
+}
+
+void VulkanRenderContext::setRenderScale(float scale)
+{
+	renderScale_ = std::clamp(scale, 0.01f, 1.0f);
+}
+
+VkExtent2D VulkanRenderContext::getRenderExtent(uint32_t width, uint32_t height) const
+{
+	return VkExtent2D {
+		.width  = std::max((uint32_t)((float)width  * renderScale_ + 0.5f), 1u),
+		.height = std::max((uint32_t)((float)height * renderScale_ + 0.5f), 1u)
+	};
+}
+
 void VulkanRenderContext::updateBuffers(uint32_t imageIndex)
 {
+	// Submit all descriptor writes queued since the last frame at once. Sets bound by cached command buffers might have changed
+	if (resources.flushDescriptorUpdates() > 0)
+		recordedSignatures_.assign(recordedSignatures_.size(), std::nullopt);
+
+	frameUniforms.beginFrame(imageIndex);
+	readback.beginFrame(imageIndex);
+
+	if (frameTimestamps_ != VK_NULL_HANDLE)
+	{
+		// (value, availability) pairs of the previous frame rendered with this image
+		uint64_t results[4] = {};
+
+		const VkResult res = vkGetQueryPoolResults(vkDev.device, frameTimestamps_, 2 * imageIndex, 2, sizeof(results), results, 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if ((res == VK_SUCCESS || res == VK_NOT_READY) && results[1] && results[3])
+			gpuFrameTimeMs_ = (float)((double)(results[2] - results[0]) * timestampPeriodNs_ * 1e-6);
+	}
+
+	cullRenderItems(onScreenRenderers_);
+
 	for (auto& r : onScreenRenderers_)
-		if (r.enabled_)
+		if (r.isActive())
 			r.renderer_.updateBuffers(imageIndex);
 }
 
+bool VulkanRenderContext::isCommandBufferValid(uint32_t imageIndex)
+{
+	if (recordedSignatures_.size() != vkDev.commandBuffers.size())
+		recordedSignatures_.assign(vkDev.commandBuffers.size(), std::nullopt);
+
+	std::optional<size_t>& recorded = recordedSignatures_[imageIndex];
+
+	bool canReuse = reuseCommandBuffers_;
+	size_t signature = onScreenRenderers_.size();
+
+	for (const auto& r : onScreenRenderers_)
+	{
+		if (r.isActive() && !r.renderer_.isStatic())
+			canReuse = false;
+
+		signature = hashCombine(signature, reinterpret_cast<size_t>(&r.renderer_));
+		signature = hashCombine(signature, (r.isActive() ? 1 : 0) | (r.useDepth_ ? 2 : 0));
+		if (r.isActive())
+			signature = hashCombine(signature, r.renderer_.commandSignature());
+	}
+
+	signature = hashCombine(signature, readback.commandSignature(imageIndex));
+
+	if (canReuse && recorded.has_value() && *recorded == signature)
+		return true;
+
+	// The command buffer is going to be re-recorded
+	recorded = canReuse ? std::optional<size_t>(signature) : std::nullopt;
+
+	return false;
+}
+
+void VulkanRenderContext::resize(uint32_t width, uint32_t height)
+{
+	// Waits for the device to become idle, so everything below can be destroyed right away
+	recreateSwapchain(vk, vkDev, width, height);
+
+	resources.destroyTexture(depthTexture);
+	for (auto fb: swapchainFramebuffers)
+		resources.destroyFramebuffer(fb);
+	for (auto fb: swapchainFramebuffers_NoDepth)
+		resources.destroyFramebuffer(fb);
+
+	// The render passes only depend on the formats and are kept
+	depthTexture = resources.addDepthTexture(vkDev.framebufferWidth, vkDev.framebufferHeight, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	swapchainFramebuffers = resources.addFramebuffers(screenRenderPass.handle, depthTexture.image.imageView);
+	swapchainFramebuffers_NoDepth = resources.addFramebuffers(screenRenderPass_NoDepth.handle);
+
+	for (auto& handler: resizeHandlers_)
+		handler(vkDev.framebufferWidth, vkDev.framebufferHeight);
+
+	// Recorded command buffers reference the old framebuffers. Descriptor writes queued by the handlers are flushed in updateBuffers()
+	recordedSignatures_.assign(recordedSignatures_.size(), std::nullopt);
+
+	printf("Swapchain resized to %ux%u\n", vkDev.framebufferWidth, vkDev.framebufferHeight);
+}
+
+void VulkanRenderContext::setPresentMode(VkPresentModeKHR presentMode)
+{
+	if (vkDev.headless || presentMode == vkDev.requestedPresentMode)
+		return;
+
+	vkDev.requestedPresentMode = presentMode;
+	vkDev.swapchainOutOfDate = true;
+}
+
 void VulkanRenderContext::composeFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
 	const VkRect2D defaultScreenRect {
@@ -132,11 +397,17 @@ void VulkanRenderContext::composeFrame(VkCommandBuffer commandBuffer, uint32_t i
 		VkClearValue { .depthStencil = { 1.0f, 0 } }
 	};
 
+	if (frameTimestamps_ != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, frameTimestamps_, 2 * imageIndex, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameTimestamps_, 2 * imageIndex);
+	}
+
 	beginRenderPass(commandBuffer, clearRenderPass.handle, imageIndex, defaultScreenRect, VK_NULL_HANDLE, 2u, defaultClearValues);
 	vkCmdEndRenderPass( commandBuffer );
 
 	for (auto& r : onScreenRenderers_)
-		if (r.enabled_)
+		if (r.isActive())
 		{
 			RenderPass rp = r.useDepth_ ? screenRenderPass : screenRenderPass_NoDepth;
 			VkFramebuffer fb = (r.useDepth_ ? swapchainFramebuffers : swapchainFramebuffers_NoDepth)[imageIndex];
@@ -151,6 +422,11 @@ void VulkanRenderContext::composeFrame(VkCommandBuffer commandBuffer, uint32_t i
 
 	beginRenderPass(commandBuffer, finalRenderPass.handle, imageIndex, defaultScreenRect);
 	vkCmdEndRenderPass( commandBuffer );
+
+	if (frameTimestamps_ != VK_NULL_HANDLE)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameTimestamps_, 2 * imageIndex + 1);
+
+	readback.recordCopies(commandBuffer, imageIndex);
 }
 
 void VulkanApp::assignCallbacks()
@@ -195,6 +471,39 @@ void VulkanApp::assignCallbacks()
 				reinterpret_cast<VulkanApp*>(ptr)->handleKey(key, pressed);
 		}
 	);
+
+	glfwSetFramebufferSizeCallback(
+		window_,
+		[](GLFWwindow* window, int width, int height)
+		{
+			void* ptr = glfwGetWindowUserPointer(window);
+			reinterpret_cast<VulkanApp*>(ptr)->framebufferResized_ = true;
+		}
+	);
+}
+
+bool VulkanApp::handleResize()
+{
+	int width = (int)ctx_.vkDev.framebufferWidth;
+	int height = (int)ctx_.vkDev.framebufferHeight;
+
+	if (window_)
+		glfwGetFramebufferSize(window_, &width, &height);
+
+	// Nothing can be presented to a minimized window
+	if (width == 0 || height == 0)
+	{
+		glfwWaitEvents();
+		return false;
+	}
+
+	framebufferResized_ = false;
+
+	ctx_.resize((uint32_t)width, (uint32_t)height);
+
+	resolution_ = Resolution { .width = ctx_.vkDev.framebufferWidth, .height = ctx_.vkDev.framebufferHeight };
+
+	return true;
 }
 
 void VulkanApp::updateBuffers(uint32_t imageIndex)
@@ -212,31 +521,64 @@ void VulkanApp::updateBuffers(uint32_t imageIndex)
 	ctx_.updateBuffers(imageIndex);
 }
 
+bool VulkanApp::shouldExit(uint32_t framesRendered) const
+{
+	if (exitRequested_)
+		return true;
+
+	if (window_)
+		return glfwWindowShouldClose(window_);
+
+	return ctxFeatures_.headlessFrameCount_ > 0 && framesRendered >= ctxFeatures_.headlessFrameCount_;
+}
+
 void VulkanApp::mainLoop()
 {
-	double timeStamp = glfwGetTime();
+	// Headless runs use a fixed time step, so that captured frames do not depend on the speed of the machine
+	constexpr float kHeadlessDeltaSeconds = 1.0f / 60.0f;
+
+	const double startTime = window_ ? glfwGetTime() : 0.0;
+	double timeStamp = startTime;
 	float deltaSeconds = 0.0f;
+	uint32_t framesRendered = 0;
 
 	do
 	{
+		// The limiter sleeps before the input is sampled, so the input is as fresh as possible when the frame is presented
+		frameLimiter_.beginFrame();
+
+		if (window_)
+			glfwPollEvents();
+
+		if ((framebufferResized_ || ctx_.vkDev.swapchainOutOfDate) && !handleResize())
+			continue;
+
 		update(deltaSeconds);
 
-		const double newTimeStamp = glfwGetTime();
+		const double newTimeStamp = window_ ? glfwGetTime() : timeStamp + kHeadlessDeltaSeconds;
 		deltaSeconds = static_cast<float>(newTimeStamp - timeStamp);
 		timeStamp = newTimeStamp;
 
-		fpsCounter_.tick(deltaSeconds);
+		ctx_.time_ = timeStamp - startTime;
 
 		bool frameRendered = drawFrame(ctx_.vkDev,
 			[this](uint32_t img) { this->updateBuffers(img); },
-			[this](auto cmd, auto img) { ctx_.composeFrame(cmd, img); }
+			[this](auto cmd, auto img) { ctx_.composeFrame(cmd, img); },
+			[this](uint32_t img) { return ctx_.isCommandBufferValid(img); }
 		);
 
-		fpsCounter_.tick(deltaSeconds, frameRendered);
+		frameLimiter_.endFrame();
+
+		fpsCounter_.tick(deltaSeconds, frameRendered, frameLimiter_.getInputLatencySeconds());
+
+		if (frameRendered)
+			framesRendered++;
 
-		glfwPollEvents();
+		// The pipelines are created asynchronously, the ones of the first frame have been waited for by now
+		if (frameRendered && framesRendered == 1)
+			printPipelineCacheStats(ctx_.vkDev);
 
-	} while (!glfwWindowShouldClose(window_));
+	} while (!shouldExit(framesRendered));
 }
 
 void CameraApp::handleKey(int key, bool pressed)
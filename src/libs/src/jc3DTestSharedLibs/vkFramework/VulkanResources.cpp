@@ -12,12 +12,18 @@
 #include <gli/texture2d.hpp>
 #include <gli/load_ktx.hpp>
 
+#include <stb_image.h>
+
 #include <algorithm>
+#include <chrono>
 
 glslang_stage_t glslangShaderStageFromFileName(const char* fileName);
 
 VulkanResources::~VulkanResources()
 {
+	// Pipeline jobs still running might be using the resources below
+	executor.wait_for_all();
+
 	for (auto& t: allTextures)
 	{
 		destroyVulkanImage(vkDev.device, t.image);
@@ -50,12 +56,15 @@ VulkanResources::~VulkanResources()
 	for (auto& dpool: allDPools)
 		vkDestroyDescriptorPool(vkDev.device, dpool, nullptr);
 
-	for (auto m: shaderModules)
-		vkDestroyShaderModule(vkDev.device, m.shaderModule, nullptr);
+	for (auto& m: shaderMap)
+		if (m.second.compiled)
+			vkDestroyShaderModule(vkDev.device, m.second.module.shaderModule, nullptr);
 }
 
 VulkanTexture VulkanResources::loadCubeMap(const char* fileName, uint32_t mipLevels)
 {
+	const auto start = std::chrono::high_resolution_clock::now();
+
 	VulkanTexture cubemap;
 
 	uint32_t w = 0, h = 0;
@@ -75,10 +84,322 @@ VulkanTexture VulkanResources::loadCubeMap(const char* fileName, uint32_t mipLev
 	cubemap.height = h;
 	cubemap.depth = 1;
 
+	printf("loadCubeMap(%s): %.1f ms (CPU conversion)\n", fileName, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
 	allTextures.push_back(cubemap);
 	return cubemap;
 }
 
+static uint32_t getFullMipLevels(uint32_t size)
+{
+	uint32_t levels = 1;
+	while (size >>= 1)
+		levels++;
+	return levels;
+}
+
+/* Single mip level of a cube map as an array of six 2D layers (storage images cannot be cube views) */
+static VkImageView createCubeMipView(VkDevice device, VkImage image, VkFormat format, uint32_t mip)
+{
+	const VkImageViewCreateInfo viewInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+		.format = format,
+		.subresourceRange =
+		{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = mip,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 6
+		}
+	};
+
+	VkImageView view;
+	VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &view));
+	return view;
+}
+
+static void cubeMapBarrier(VkCommandBuffer cmd, VkImage image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+{
+	const VkImageMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = srcAccess,
+		.dstAccessMask = dstAccess,
+		.oldLayout = oldLayout,
+		.newLayout = newLayout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 6 }
+	};
+
+	vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+/* Sets of one-off compute work which bind temporary mip views. The pool is destroyed with its sets once the work is done,
+   so the shared pools do not keep sets pointing to destroyed views */
+static VkDescriptorPool createTemporaryDescriptorPool(VkDevice device, uint32_t maxSets, uint32_t sampledImageCount, uint32_t storageImageCount)
+{
+	const VkDescriptorPoolSize sizes[] = {
+		{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = sampledImageCount },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          .descriptorCount = storageImageCount }
+	};
+
+	const VkDescriptorPoolCreateInfo poolInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.maxSets = maxSets,
+		.poolSizeCount = (uint32_t)(sizeof(sizes) / sizeof(sizes[0])),
+		.pPoolSizes = sizes
+	};
+
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
+	return descriptorPool;
+}
+
+/* Previous dispatch wrote the mip which the next one reads */
+static void computeToComputeBarrier(VkCommandBuffer cmd)
+{
+	const VkMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VulkanTexture VulkanResources::addStorageCubeMap(uint32_t faceSize, uint32_t mipLevels, VkFormat format)
+{
+	VulkanTexture cube =
+	{
+		.width = faceSize,
+		.height = faceSize,
+		.depth = 1,
+		.format = format
+	};
+
+	if (!createImage(vkDev.device, vkDev.physicalDevice, faceSize, faceSize, format, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		cube.image.image, cube.image.imageMemory, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT, mipLevels))
+	{
+		printf("Cannot create storage cube map\n");
+		exit(EXIT_FAILURE);
+	}
+
+	createImageView(vkDev.device, cube.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, &cube.image.imageView, VK_IMAGE_VIEW_TYPE_CUBE, 6, mipLevels);
+	createTextureSampler(vkDev.device, &cube.sampler, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, (float)mipLevels);
+
+	allTextures.push_back(cube);
+	return cube;
+}
+
+VulkanTexture VulkanResources::loadCubeMapGPU(const char* fileName, uint32_t faceSize, bool generateMips)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	int w, h, comp;
+	float* img = stbi_loadf(fileName, &w, &h, &comp, 4);
+
+	if (!img)
+	{
+		printf("Failed to load [%s] texture\n", fileName);
+		exit(EXIT_FAILURE);
+	}
+
+	VulkanTexture equirect = { .width = (uint32_t)w, .height = (uint32_t)h, .depth = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT };
+
+	createTextureImageFromData(vkDev, equirect.image.image, equirect.image.imageMemory, img, w, h, VK_FORMAT_R32G32B32A32_SFLOAT);
+	stbi_image_free(img);
+
+	createImageView(vkDev.device, equirect.image.image, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, &equirect.image.imageView);
+	// Clamped like the bilinear lookup of convertEquirectangularMapToVerticalCross()
+	createTextureSampler(vkDev.device, &equirect.sampler, VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+	const uint32_t fs = (faceSize > 0) ? faceSize : (uint32_t)w / 4;
+	const uint32_t mipLevels = generateMips ? getFullMipLevels(fs) : 1;
+
+	VulkanTexture cube = addStorageCubeMap(fs, mipLevels, VK_FORMAT_R32G32B32A32_SFLOAT);
+
+	std::vector<VkImageView> mipViews(mipLevels);
+	for (uint32_t i = 0; i < mipLevels; i++)
+		mipViews[i] = createCubeMipView(vkDev.device, cube.image.image, cube.format, i);
+
+	auto mipTexture = [&cube, &mipViews](uint32_t mip) {
+		VulkanTexture t = cube;
+		t.image.imageView = mipViews[mip];
+		return t;
+	};
+
+	// One set per level: the conversion samples the panorama and writes level 0, every downsample reads one level and writes the next
+	VkDescriptorPool descriptorPool = createTemporaryDescriptorPool(vkDev.device, mipLevels, 1, 2 * mipLevels - 1);
+
+	// Level 0 from the panorama, then every level from the previous one
+	const DescriptorSetInfo convertInfo = { .textures = { csTextureAttachment(equirect), storageImageAttachment(mipTexture(0)) } };
+
+	VkDescriptorSetLayout convertLayout = addDescriptorSetLayout(convertInfo);
+	VkPipelineLayout convertPipelineLayout = addPipelineLayout(convertLayout, std::vector<VkPushConstantRange>());
+	VkPipeline convertPipeline = addComputePipeline("data/shaders/chapter08/EquirectToCube.comp", convertPipelineLayout);
+
+	VkDescriptorSet convertSet = addDescriptorSet(descriptorPool, convertLayout);
+	updateDescriptorSet(convertSet, convertInfo);
+
+	std::vector<VkDescriptorSet> downsampleSets;
+	VkPipelineLayout downsamplePipelineLayout = VK_NULL_HANDLE;
+	VkPipeline downsamplePipeline = VK_NULL_HANDLE;
+
+	for (uint32_t i = 1; i < mipLevels; i++)
+	{
+		const DescriptorSetInfo downsampleInfo = { .textures = { storageImageAttachment(mipTexture(i - 1)), storageImageAttachment(mipTexture(i)) } };
+
+		VkDescriptorSetLayout downsampleLayout = addDescriptorSetLayout(downsampleInfo);
+
+		if (downsamplePipeline == VK_NULL_HANDLE)
+		{
+			downsamplePipelineLayout = addPipelineLayout(downsampleLayout, std::vector<VkPushConstantRange>());
+			downsamplePipeline = addComputePipeline("data/shaders/chapter08/CubeDownsample.comp", downsamplePipelineLayout);
+		}
+
+		downsampleSets.push_back(addDescriptorSet(descriptorPool, downsampleLayout));
+		updateDescriptorSet(downsampleSets.back(), downsampleInfo);
+	}
+
+	flushDescriptorUpdates();
+
+	VkCommandBuffer cmd = beginSingleTimeCommands(vkDev);
+
+	cubeMapBarrier(cmd, cube.image.image, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		0, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, convertPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, convertPipelineLayout, 0, 1, &convertSet, 0, nullptr);
+	vkCmdDispatch(cmd, (fs + 7) / 8, (fs + 7) / 8, 6);
+
+	if (mipLevels > 1)
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipeline);
+
+	for (uint32_t i = 1; i < mipLevels; i++)
+	{
+		const uint32_t mipSize = std::max(fs >> i, 1u);
+
+		computeToComputeBarrier(cmd);
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipelineLayout, 0, 1, &downsampleSets[i - 1], 0, nullptr);
+		vkCmdDispatch(cmd, (mipSize + 7) / 8, (mipSize + 7) / 8, 6);
+	}
+
+	cubeMapBarrier(cmd, cube.image.image, mipLevels, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	endSingleTimeCommands(vkDev, cmd);
+
+	vkDestroyDescriptorPool(vkDev.device, descriptorPool, nullptr);
+
+	for (auto v: mipViews)
+		vkDestroyImageView(vkDev.device, v, nullptr);
+
+	destroyVulkanTexture(vkDev.device, equirect);
+
+	printf("loadCubeMapGPU(%s): %.1f ms (%ux%u faces, %u mips)\n", fileName,
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), fs, fs, mipLevels);
+
+	return cube;
+}
+
+VulkanTexture VulkanResources::prefilterCubeMap(VulkanTexture envMap, uint32_t faceSize, uint32_t mipLevels, uint32_t sampleCount, bool irradiance)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	VulkanTexture cube = addStorageCubeMap(faceSize, mipLevels, VK_FORMAT_R16G16B16A16_SFLOAT);
+
+	std::vector<VkImageView> mipViews(mipLevels);
+	std::vector<VkDescriptorSet> sets(mipLevels);
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	// Every level samples the environment and writes its own view
+	VkDescriptorPool descriptorPool = createTemporaryDescriptorPool(vkDev.device, mipLevels, mipLevels, mipLevels);
+
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		mipViews[i] = createCubeMipView(vkDev.device, cube.image.image, cube.format, i);
+
+		VulkanTexture mip = cube;
+		mip.image.imageView = mipViews[i];
+
+		const DescriptorSetInfo dsInfo = { .textures = { csTextureAttachment(envMap), storageImageAttachment(mip) } };
+
+		VkDescriptorSetLayout dsLayout = addDescriptorSetLayout(dsInfo);
+
+		if (pipeline == VK_NULL_HANDLE)
+		{
+			pipelineLayout = addPipelineLayout(dsLayout, { VkPushConstantRange { .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(float) + sizeof(uint32_t) } });
+			pipeline = addComputePipeline("data/shaders/chapter08/CubePrefilter.comp", pipelineLayout, SpecializationInfo().add(0, irradiance));
+		}
+
+		sets[i] = addDescriptorSet(descriptorPool, dsLayout);
+		updateDescriptorSet(sets[i], dsInfo);
+	}
+
+	flushDescriptorUpdates();
+
+	VkCommandBuffer cmd = beginSingleTimeCommands(vkDev);
+
+	cubeMapBarrier(cmd, cube.image.image, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		0, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	for (uint32_t i = 0; i < mipLevels; i++)
+	{
+		const uint32_t mipSize = std::max(faceSize >> i, 1u);
+
+		struct { float roughness; uint32_t sampleCount; } params = { (mipLevels > 1) ? float(i) / float(mipLevels - 1) : 0.0f, sampleCount };
+
+		vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &sets[i], 0, nullptr);
+		vkCmdDispatch(cmd, (mipSize + 7) / 8, (mipSize + 7) / 8, 6);
+	}
+
+	cubeMapBarrier(cmd, cube.image.image, mipLevels, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	endSingleTimeCommands(vkDev, cmd);
+
+	vkDestroyDescriptorPool(vkDev.device, descriptorPool, nullptr);
+
+	for (auto v: mipViews)
+		vkDestroyImageView(vkDev.device, v, nullptr);
+
+	printf("%s: %.1f ms (%ux%u faces, %u mips, %u samples)\n", irradiance ? "computeIrradianceCubeMap" : "prefilterSpecularCubeMap",
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), faceSize, faceSize, mipLevels, sampleCount);
+
+	return cube;
+}
+
+VulkanTexture VulkanResources::prefilterSpecularCubeMap(VulkanTexture envMap, uint32_t faceSize, uint32_t mipLevels, uint32_t sampleCount)
+{
+	return prefilterCubeMap(envMap, faceSize, std::min(mipLevels, getFullMipLevels(faceSize)), sampleCount, false);
+}
+
+VulkanTexture VulkanResources::computeIrradianceCubeMap(VulkanTexture envMap, uint32_t faceSize, uint32_t sampleCount)
+{
+	return prefilterCubeMap(envMap, faceSize, 1, sampleCount, true);
+}
+
 VulkanTexture VulkanResources::loadKTX(const char* fileName)
 {
 	gli::texture gliTex = gli::load_ktx(fileName);
@@ -213,6 +534,36 @@ VulkanTexture VulkanResources::addColorTexture(int texWidth, int texHeight, VkFo
 	return res;
 }
 
+VulkanTexture VulkanResources::addStorageTexture(int texWidth, int texHeight, VkFormat format, VkFilter filter, VkSamplerAddressMode addressMode)
+{
+	const uint32_t w = (texWidth  > 0) ? texWidth  : vkDev.framebufferWidth;
+	const uint32_t h = (texHeight > 0) ? texHeight : vkDev.framebufferHeight;
+
+	VulkanTexture res =
+	{
+		.width = w,
+		.height = h,
+		.depth = 1,
+		.format = format
+	};
+
+	if (!createImage(vkDev.device, vkDev.physicalDevice, w, h, format, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		res.image.image, res.image.imageMemory))
+	{
+		printf("Cannot create storage texture\n");
+		exit(EXIT_FAILURE);
+	}
+
+	createImageView(vkDev.device, res.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, &res.image.imageView);
+	createTextureSampler(vkDev.device, &res.sampler, filter, filter, addressMode);
+
+	transitionImageLayout(vkDev, res.image.image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	allTextures.push_back(res);
+	return res;
+}
+
 VulkanTexture VulkanResources::addDepthTexture(int texWidth, int texHeight, VkImageLayout layout)
 {
 	const uint32_t w = (texWidth  > 0) ? texWidth  : vkDev.framebufferWidth;
@@ -276,8 +627,18 @@ VulkanBuffer VulkanResources::addVertexBuffer(uint32_t indexBufferSize, const vo
 VkDescriptorPool VulkanResources::addDescriptorPool(const DescriptorSetInfo& dsInfo, uint32_t dSetCount)
 {
 	uint32_t uniformBufferCount = 0;
+	uint32_t dynamicUniformBufferCount = 0;
 	uint32_t storageBufferCount = 0;
-	uint32_t samplerCount = static_cast<uint32_t>(dsInfo.textures.size());
+	uint32_t samplerCount = 0;
+	uint32_t storageImageCount = 0;
+
+	for(const auto& t : dsInfo.textures)
+	{
+		if (t.dInfo.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+			storageImageCount++;
+		else
+			samplerCount++;
+	}
 
 	for(const auto& ta : dsInfo.textureArrays)
 		samplerCount += static_cast<uint32_t>(ta.textures.size());
@@ -286,6 +647,8 @@ VkDescriptorPool VulkanResources::addDescriptorPool(const DescriptorSetInfo& dsI
 	{
 		if (b.dInfo.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
 			uniformBufferCount++;
+		if (b.dInfo.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+			dynamicUniformBufferCount++;
 		if (b.dInfo.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
 			storageBufferCount++;
 	}
@@ -297,44 +660,33 @@ VkDescriptorPool VulkanResources::addDescriptorPool(const DescriptorSetInfo& dsI
 	if (uniformBufferCount)
 		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = dSetCount * uniformBufferCount });
 
+	if (dynamicUniformBufferCount)
+		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = dSetCount * dynamicUniformBufferCount });
+
 	if (storageBufferCount)
 		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = dSetCount * storageBufferCount });
 
 	if (samplerCount)
 		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = dSetCount * samplerCount });
 
-	const VkDescriptorPoolCreateInfo poolInfo = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.pNext = nullptr,
-		.flags = 0,
-		.maxSets = static_cast<uint32_t>(dSetCount),
-		.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
-		.pPoolSizes = poolSizes.empty() ? nullptr : poolSizes.data()
-	};
-
-	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	if (storageImageCount)
+		poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = dSetCount * storageImageCount });
 
-	if (vkCreateDescriptorPool(vkDev.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
-	{
-		printf("Cannot allocate descriptor pool\n");
-		exit(EXIT_FAILURE);
-	}
-
-	allDPools.push_back(descriptorPool);
-	return descriptorPool;
+	return createDescriptorPoolWithSizes(dSetCount, poolSizes.data(), static_cast<uint32_t>(poolSizes.size()));
 }
 
-VkPipeline VulkanResources::addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout)
+VkPipeline VulkanResources::addComputePipeline(const char* shaderFile, VkPipelineLayout pipelineLayout, const SpecializationInfo& specialization, const std::vector<std::string>& defines)
 {
 	ShaderModule s;
-	if (createShaderModule(vkDev.device, &s, shaderFile) == VK_NOT_READY)
+	if (createShaderModule(vkDev.device, &s, shaderFile, defines) == VK_NOT_READY)
 	{
 		printf("Unable to compile shader\n");
 		exit(EXIT_FAILURE);
 	}
 
 	VkPipeline pipeline;
-	VkResult res = createComputePipeline(vkDev.device, s.shaderModule, pipelineLayout, &pipeline);
+	const VkSpecializationInfo specInfo = specialization.get();
+	VkResult res = createComputePipeline(vkDev, s.shaderModule, pipelineLayout, &pipeline, specialization.empty() ? nullptr : &specInfo);
 	if (res != VK_SUCCESS)
 	{
 		printf("Cannot create compute pipeline (%d / %d)\n", res, res);
@@ -343,6 +695,7 @@ VkPipeline VulkanResources::addComputePipeline(const char* shaderFile, VkPipelin
 
 	vkDestroyShaderModule(vkDev.device, s.shaderModule, nullptr);
 
+	std::lock_guard lock(mutex);
 	allPipelines.push_back(pipeline);
 	return pipeline;
 }
@@ -352,14 +705,15 @@ bool VulkanResources::createGraphicsPipeline(
 	VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
 	const std::vector<const char*>& shaderFiles,
 	VkPipeline* pipeline,
-	VkPrimitiveTopology topology,
-	bool useDepth,
-	bool useBlending,
-	bool dynamicScissorState,
-	int32_t customWidth,
-	int32_t customHeight,
-	uint32_t numPatchControlPoints)
+	const PipelineInfo& pInfo)
 {
+	const VkPrimitiveTopology topology = pInfo.topology;
+	const bool useDepth = pInfo.useDepth;
+	const bool useBlending = pInfo.useBlending;
+	const int32_t customWidth = (int32_t)pInfo.width;
+	const int32_t customHeight = (int32_t)pInfo.height;
+	const SpecializationInfo& specialization = pInfo.specialization;
+
 	std::vector<ShaderModule> localShaderModules;
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 
@@ -370,25 +724,20 @@ bool VulkanResources::createGraphicsPipeline(
 	{
 		const char* file = shaderFiles[i];
 
-		auto idx = shaderMap.find(file);
-
-		if (idx != shaderMap.end())
-		{
-			// printf("Already compiled file (%s)\n", file);
-			localShaderModules[i] = shaderModules[idx->second];
-		} else
-		{
-			// printf("Compiling new file (%s)\n", file);
-			VK_CHECK(createShaderModule(vkDev.device, &localShaderModules[i], file));
-			shaderModules.push_back(localShaderModules[i]);
-			shaderMap[std::string(file)] = (int)shaderModules.size() - 1;
-		}
+		if (!getShaderModule(file, &localShaderModules[i]))
+			return false;
 
 		VkShaderStageFlagBits stage = glslangShaderStageToVulkan(glslangShaderStageFromFileName(file));
 
 		shaderStages[i] = shaderStageInfo(stage, localShaderModules[i], "main");
 	}
 
+	const VkSpecializationInfo specInfo = specialization.get();
+
+	if (!specialization.empty())
+		for (auto& s: shaderStages)
+			s.pSpecializationInfo = &specInfo;
+
 	const VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
 	};
@@ -439,13 +788,13 @@ bool VulkanResources::createGraphicsPipeline(
 
 	const VkPipelineColorBlendAttachmentState colorBlendAttachment = {
 		.blendEnable = VK_TRUE,
-		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.srcColorBlendFactor = pInfo.additiveBlending ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = pInfo.additiveBlending ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
 		.colorBlendOp = VK_BLEND_OP_ADD,
 		.srcAlphaBlendFactor = useBlending ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE,
 		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
 		.alphaBlendOp = VK_BLEND_OP_ADD,
-		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+		.colorWriteMask = pInfo.colorWrite ? (VkColorComponentFlags)(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT) : 0u
 	};
 
 	const VkPipelineColorBlendStateCreateInfo colorBlending = {
@@ -460,28 +809,30 @@ bool VulkanResources::createGraphicsPipeline(
 	const VkPipelineDepthStencilStateCreateInfo depthStencil = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
 		.depthTestEnable = static_cast<VkBool32>(useDepth ? VK_TRUE : VK_FALSE),
-		.depthWriteEnable = static_cast<VkBool32>(useDepth ? VK_TRUE : VK_FALSE),
-		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthWriteEnable = static_cast<VkBool32>((useDepth && pInfo.depthWrite) ? VK_TRUE : VK_FALSE),
+		.depthCompareOp = pInfo.depthCompareOp,
 		.depthBoundsTestEnable = VK_FALSE,
 		.minDepthBounds = 0.0f,
 		.maxDepthBounds = 1.0f
 	};
 
-	VkDynamicState dynamicStateElt = VK_DYNAMIC_STATE_SCISSOR;
+	// Viewport and scissor are always set by Renderer::beginRenderPass(), so pipelines survive framebuffer resizes.
+	// The static values above are ignored
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 
 	const VkPipelineDynamicStateCreateInfo dynamicState = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.dynamicStateCount = 1,
-		.pDynamicStates = &dynamicStateElt
+		.dynamicStateCount = 2,
+		.pDynamicStates = dynamicStates
 	};
 
 	const VkPipelineTessellationStateCreateInfo tessellationState = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.patchControlPoints = numPatchControlPoints
+		.patchControlPoints = pInfo.patchControlPoints
 	};
 
 	const VkGraphicsPipelineCreateInfo pipelineInfo = {
@@ -496,7 +847,7 @@ bool VulkanResources::createGraphicsPipeline(
 		.pMultisampleState = &multisampling,
 		.pDepthStencilState = useDepth ? &depthStencil : nullptr,
 		.pColorBlendState = &colorBlending,
-		.pDynamicState = dynamicScissorState ? &dynamicState : nullptr,
+		.pDynamicState = &dynamicState,
 		.layout = pipelineLayout,
 		.renderPass = renderPass,
 		.subpass = 0,
@@ -504,32 +855,111 @@ bool VulkanResources::createGraphicsPipeline(
 		.basePipelineIndex = -1
 	};
 
-	VK_CHECK(vkCreateGraphicsPipelines(vkDev.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline));
+	return (createGraphicsPipelineWithCache(vkDev, pipelineInfo, pipeline) == VK_SUCCESS);
+}
 
-	return true;
+bool VulkanResources::getShaderModule(const char* fileName, ShaderModule* shaderModule)
+{
+	ShaderJob* job = nullptr;
+
+	{
+		std::lock_guard lock(mutex);
+		// std::map nodes are stable, the job outlives the lock
+		job = &shaderMap.try_emplace(std::string(fileName)).first->second;
+	}
+
+	std::call_once(job->once, [this, job, fileName]()
+	{
+		job->compiled = (createShaderModule(vkDev.device, &job->module, fileName) == VK_SUCCESS);
+
+		if (!job->compiled)
+			printf("Unable to compile shader %s\n", fileName);
+	});
+
+	*shaderModule = job->module;
+
+	return job->compiled;
 }
 
-VkPipeline VulkanResources::addPipeline(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+void VulkanResources::compileShaderAsync(const char* fileName)
+{
+	{
+		std::lock_guard lock(mutex);
+
+		if (shaderMap.find(fileName) != shaderMap.end())
+			return;
+	}
+
+	executor.async([this, file = std::string(fileName)]()
+	{
+		ShaderModule shaderModule;
+		getShaderModule(file.c_str(), &shaderModule);
+	});
+}
+
+std::shared_future<VkPipeline> VulkanResources::addPipelineAsync(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
 	const std::vector<const char*>& shaderFiles,
 	const PipelineInfo& ppInfo)
 {
-	VkPipeline pipeline;
+	// Kick off shader compilation right away, so that shaders from different pipelines compile concurrently
+	for (const char* file: shaderFiles)
+		compileShaderAsync(file);
+
+	std::vector<std::string> files(shaderFiles.begin(), shaderFiles.end());
+
+	// Shared, because the executor copies the job
+	auto promise = std::make_shared<std::promise<VkPipeline>>();
+
+	std::shared_future<VkPipeline> result = promise->get_future().share();
+
+	executor.async([this, renderPass, pipelineLayout, files, ppInfo, promise]()
+	{
+		std::vector<const char*> fileNames;
+		for (const auto& f: files)
+			fileNames.push_back(f.c_str());
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		// Reported by the thread which resolves the future
+		if (!this->createGraphicsPipeline(vkDev, renderPass, pipelineLayout, fileNames, &pipeline, ppInfo))
+		{
+			promise->set_value(VK_NULL_HANDLE);
+			return;
+		}
+
+		{
+			std::lock_guard lock(mutex);
+			allPipelines.push_back(pipeline);
+		}
+
+		promise->set_value(pipeline);
+	});
+
+	return result;
+}
+
+VkPipeline VulkanResources::waitPipeline(const std::shared_future<VkPipeline>& pipeline)
+{
+	const VkPipeline result = pipeline.get();
 
-	if (!this->createGraphicsPipeline(vkDev, renderPass, pipelineLayout, shaderFiles,
-		&pipeline, ppInfo.topology, ppInfo.useDepth, ppInfo.useBlending, ppInfo.dynamicScissorState, ppInfo.width, ppInfo.height, ppInfo.patchControlPoints))
+	if (result == VK_NULL_HANDLE)
 	{
 		printf("Cannot create graphics pipeline\n");
 		exit(EXIT_FAILURE);
 	}
 
-	allPipelines.push_back(pipeline);
-	return pipeline;
+	return result;
 }
 
-VkDescriptorSetLayout VulkanResources::addDescriptorSetLayout(const DescriptorSetInfo& dsInfo)
+VkPipeline VulkanResources::addPipeline(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+	const std::vector<const char*>& shaderFiles,
+	const PipelineInfo& ppInfo)
 {
-	VkDescriptorSetLayout descriptorSetLayout;
+	return waitPipeline(addPipelineAsync(renderPass, pipelineLayout, shaderFiles, ppInfo));
+}
 
+VkDescriptorSetLayout VulkanResources::addDescriptorSetLayout(const DescriptorSetInfo& dsInfo)
+{
 	uint32_t bindingIdx = 0;
 
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
@@ -546,6 +976,21 @@ VkDescriptorSetLayout VulkanResources::addDescriptorSetLayout(const DescriptorSe
 		bindings.push_back(descriptorSetLayoutBinding(bindingIdx++, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, t.dInfo.shaderStageFlags, static_cast<uint32_t>(t.textures.size())));
 	}
 
+	// Binding signature: (type, stages, count) for every binding, bindings are numbered sequentially
+	std::vector<uint32_t> key;
+	key.reserve(bindings.size() * 3);
+
+	for (const auto& b: bindings)
+	{
+		key.push_back((uint32_t)b.descriptorType);
+		key.push_back((uint32_t)b.stageFlags);
+		key.push_back(b.descriptorCount);
+	}
+
+	const auto cached = dsLayoutCache.find(key);
+	if (cached != dsLayoutCache.end())
+		return cached->second;
+
 	const VkDescriptorSetLayoutCreateInfo layoutInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		.pNext = nullptr,
@@ -554,12 +999,29 @@ VkDescriptorSetLayout VulkanResources::addDescriptorSetLayout(const DescriptorSe
 		.pBindings = bindings.size() > 0 ? bindings.data() : nullptr
 	};
 
+	VkDescriptorSetLayout descriptorSetLayout;
+
 	if (vkCreateDescriptorSetLayout(vkDev.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
 	{
 		printf("Failed to create descriptor set layout\n");
 		exit(EXIT_FAILURE);
 	}
 
+	// Remember how many descriptors of each type a set with this layout needs
+	std::vector<VkDescriptorPoolSize>& poolSizes = dsLayoutPoolSizes[descriptorSetLayout];
+
+	for (const auto& b: bindings)
+	{
+		auto i = std::find_if(poolSizes.begin(), poolSizes.end(), [&b](const VkDescriptorPoolSize& ps) { return ps.type == b.descriptorType; });
+
+		if (i == poolSizes.end())
+			poolSizes.push_back(VkDescriptorPoolSize { .type = b.descriptorType, .descriptorCount = b.descriptorCount });
+		else
+			i->descriptorCount += b.descriptorCount;
+	}
+
+	dsLayoutCache[key] = descriptorSetLayout;
+
 	allDSLayouts.push_back(descriptorSetLayout);
 	return descriptorSetLayout;
 }
@@ -585,84 +1047,226 @@ VkDescriptorSet VulkanResources::addDescriptorSet(VkDescriptorPool descriptorPoo
 	return descriptorSet;
 }
 
+/* Capacity of a single shared pool; sets which do not fit get a dedicated pool */
+static const uint32_t kSharedPoolMaxSets = 256;
+
+static const VkDescriptorPoolSize kSharedPoolSizes[] = {
+	{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         .descriptorCount = 512  },
+	{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 128  },
+	{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         .descriptorCount = 1024 },
+	{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 2048 },
+	{ .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          .descriptorCount = 128  },
+};
+
+static bool fitsIntoSharedPool(const std::vector<VkDescriptorPoolSize>& sizes)
+{
+	for (const auto& s: sizes)
+	{
+		const auto i = std::find_if(std::begin(kSharedPoolSizes), std::end(kSharedPoolSizes), [&s](const VkDescriptorPoolSize& ps) { return ps.type == s.type; });
+
+		if (i == std::end(kSharedPoolSizes) || i->descriptorCount < s.descriptorCount)
+			return false;
+	}
+
+	return true;
+}
+
+VkDescriptorPool VulkanResources::createDescriptorPoolWithSizes(uint32_t maxSets, const VkDescriptorPoolSize* sizes, uint32_t numSizes)
+{
+	const VkDescriptorPoolCreateInfo poolInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.maxSets = maxSets,
+		.poolSizeCount = numSizes,
+		.pPoolSizes = numSizes ? sizes : nullptr
+	};
+
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+	if (vkCreateDescriptorPool(vkDev.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	{
+		printf("Cannot allocate descriptor pool\n");
+		exit(EXIT_FAILURE);
+	}
+
+	allDPools.push_back(descriptorPool);
+	return descriptorPool;
+}
+
+VkDescriptorSet VulkanResources::allocateDescriptorSet(VkDescriptorSetLayout dsLayout)
+{
+	const auto sizes = dsLayoutPoolSizes.find(dsLayout);
+
+	// Huge texture arrays would exhaust a shared pool at once
+	if (sizes != dsLayoutPoolSizes.end() && !fitsIntoSharedPool(sizes->second))
+		return addDescriptorSet(createDescriptorPoolWithSizes(1, sizes->second.data(), (uint32_t)sizes->second.size()), dsLayout);
+
+	const uint32_t numSharedSizes = (uint32_t)(sizeof(kSharedPoolSizes) / sizeof(kSharedPoolSizes[0]));
+
+	for (int attempt = 0; attempt != 2; attempt++)
+	{
+		if (currentSharedDPool == VK_NULL_HANDLE)
+			currentSharedDPool = createDescriptorPoolWithSizes(kSharedPoolMaxSets, kSharedPoolSizes, numSharedSizes);
+
+		const VkDescriptorSetAllocateInfo allocInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.descriptorPool = currentSharedDPool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &dsLayout
+		};
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		const VkResult result = vkAllocateDescriptorSets(vkDev.device, &allocInfo, &descriptorSet);
+
+		if (result == VK_SUCCESS)
+			return descriptorSet;
+
+		if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+			break;
+
+		// The current pool is exhausted, grow by adding another one
+		currentSharedDPool = VK_NULL_HANDLE;
+	}
+
+	printf("Cannot allocate descriptor set\n");
+	exit(EXIT_FAILURE);
+}
+
+void VulkanResources::updateDescriptorSetTexture(VkDescriptorSet ds, VulkanTexture t, uint32_t textureIndex, uint32_t bindingIdx)
+{
+	pendingImageInfos.push_back(VkDescriptorImageInfo {
+		.sampler = t.sampler,
+		.imageView = t.image.imageView,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	});
+
+	pendingWrites.push_back(PendingDescriptorWrite {
+		.write = VkWriteDescriptorSet {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = ds,
+			.dstBinding = bindingIdx,
+			.dstArrayElement = textureIndex,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+		},
+		.infoOffset = pendingImageInfos.size() - 1
+	});
+}
+
+uint32_t VulkanResources::flushDescriptorUpdates()
+{
+	if (pendingWrites.empty())
+		return 0;
+
+	// Info arrays could have been reallocated while the writes were queued, so pointers are resolved only now
+	std::vector<VkWriteDescriptorSet> writes;
+	writes.reserve(pendingWrites.size());
+
+	for (const auto& w: pendingWrites)
+	{
+		VkWriteDescriptorSet write = w.write;
+
+		if (w.isBuffer)
+			write.pBufferInfo = pendingBufferInfos.data() + w.infoOffset;
+		else
+			write.pImageInfo = pendingImageInfos.data() + w.infoOffset;
+
+		writes.push_back(write);
+	}
+
+	vkUpdateDescriptorSets(vkDev.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+	pendingWrites.clear();
+	pendingBufferInfos.clear();
+	pendingImageInfos.clear();
+
+	return static_cast<uint32_t>(writes.size());
+}
+
 /*
-	This routine counts all textures in all texture arrays (if any of them are present),
-	creates a list of DescriptorWrite operations with required buffer/image info structures
-	and calls the vkUpdateDescriptorSets()
+	This routine queues the DescriptorWrite operations for all buffers, textures and texture arrays.
+	The writes are submitted by flushDescriptorUpdates()
 */
 void VulkanResources::updateDescriptorSet(VkDescriptorSet ds, const DescriptorSetInfo& dsInfo)
 {
 	uint32_t bindingIdx = 0;
-	std::vector<VkWriteDescriptorSet> descriptorWrites;
 
-	std::vector<VkDescriptorBufferInfo> bufferDescriptors(dsInfo.buffers.size());
-	std::vector<VkDescriptorImageInfo>  imageDescriptors(dsInfo.textures.size());
-	std::vector<VkDescriptorImageInfo>  imageArrayDescriptors;
-
-	for (size_t i = 0 ; i < dsInfo.buffers.size() ; i++)
+	for (const auto& b: dsInfo.buffers)
 	{
-		BufferAttachment b = dsInfo.buffers[i];
-			
-		bufferDescriptors[i] = VkDescriptorBufferInfo {
+		pendingBufferInfos.push_back(VkDescriptorBufferInfo {
 			.buffer = b.buffer.buffer,
 			.offset = b.offset,
 			.range  = (b.size > 0) ? b.size : VK_WHOLE_SIZE
-		};
-
-		descriptorWrites.push_back(bufferWriteDescriptorSet(ds, &bufferDescriptors[i], bindingIdx++, b.dInfo.type));
+		});
+
+		pendingWrites.push_back(PendingDescriptorWrite {
+			.write = VkWriteDescriptorSet {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = ds,
+				.dstBinding = bindingIdx++,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = b.dInfo.type
+			},
+			.infoOffset = pendingBufferInfos.size() - 1,
+			.isBuffer = true
+		});
 	}
 
-	for(size_t i = 0 ; i < dsInfo.textures.size() ; i++)
+	for (const auto& t: dsInfo.textures)
 	{
-		VulkanTexture t = dsInfo.textures[i].texture;
-
-		imageDescriptors[i] = VkDescriptorImageInfo {
-			.sampler = t.sampler,
-			.imageView = t.image.imageView,
-			.imageLayout = /* t.texture.layout */ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-		};
+		if (t.dInfo.type != VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+		{
+			updateDescriptorSetTexture(ds, t.texture, 0, bindingIdx++);
+			continue;
+		}
 
-		descriptorWrites.push_back(imageWriteDescriptorSet(ds, &imageDescriptors[i], bindingIdx++));
+		pendingImageInfos.push_back(VkDescriptorImageInfo {
+			.sampler = VK_NULL_HANDLE,
+			.imageView = t.texture.image.imageView,
+			.imageLayout = VK_IMAGE_LAYOUT_GENERAL
+		});
+
+		pendingWrites.push_back(PendingDescriptorWrite {
+			.write = VkWriteDescriptorSet {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = ds,
+				.dstBinding = bindingIdx++,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+			},
+			.infoOffset = pendingImageInfos.size() - 1
+		});
 	}
 
-	uint32_t taOffset = 0;
-	std::vector<uint32_t> taOffsets(dsInfo.textureArrays.size());
-	for (size_t ta = 0 ; ta < dsInfo.textureArrays.size() ; ta++)
+	for (const auto& ta: dsInfo.textureArrays)
 	{
-		taOffsets[ta] = taOffset;
+		const size_t first = pendingImageInfos.size();
 
-		for (size_t j = 0 ; j < dsInfo.textureArrays[ta].textures.size() ; j++)
+		for (const auto& t: ta.textures)
 		{
-			VulkanTexture t = dsInfo.textureArrays[ta].textures[j];
-
-			VkDescriptorImageInfo imageInfo = {
+			pendingImageInfos.push_back(VkDescriptorImageInfo {
 				.sampler = t.sampler,
 				.imageView = t.image.imageView,
 				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-			};
-
-			imageArrayDescriptors.push_back(imageInfo); // item 'taOffsets[ta] + j'
+			});
 		}
 
-		taOffset += static_cast<uint32_t>(dsInfo.textureArrays[ta].textures.size());
-	}
-
-	for (size_t ta = 0 ; ta < dsInfo.textureArrays.size() ; ta++)
-	{
-		VkWriteDescriptorSet writeSet = {
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = ds,
-			.dstBinding = bindingIdx++,
-			.dstArrayElement = 0,
-			.descriptorCount = static_cast<uint32_t>(dsInfo.textureArrays[ta].textures.size()),
-			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			.pImageInfo = imageArrayDescriptors.data() + taOffsets[ta]
-		};
-
-		descriptorWrites.push_back(writeSet);
+		pendingWrites.push_back(PendingDescriptorWrite {
+			.write = VkWriteDescriptorSet {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = ds,
+				.dstBinding = bindingIdx++,
+				.dstArrayElement = 0,
+				.descriptorCount = static_cast<uint32_t>(ta.textures.size()),
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+			},
+			.infoOffset = first
+		});
 	}
-
-	vkUpdateDescriptorSets(vkDev.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
 VkFramebuffer VulkanResources::addFramebuffer(RenderPass renderPass, const std::vector<VulkanTexture>& images)
@@ -704,6 +1308,46 @@ std::vector<VkFramebuffer> VulkanResources::addFramebuffers(VkRenderPass renderP
 	return framebuffers;
 }
 
+void VulkanResources::destroyTexture(const VulkanTexture& texture)
+{
+	auto i = std::find_if(allTextures.begin(), allTextures.end(), [&texture](const VulkanTexture& t) { return t.image.image == texture.image.image; });
+
+	if (i == allTextures.end())
+		return;
+
+	destroyVulkanImage(vkDev.device, i->image);
+	vkDestroySampler(vkDev.device, i->sampler, nullptr);
+
+	allTextures.erase(i);
+}
+
+void VulkanResources::destroyBuffer(const VulkanBuffer& buffer)
+{
+	auto i = std::find_if(allBuffers.begin(), allBuffers.end(), [&buffer](const VulkanBuffer& b) { return b.buffer == buffer.buffer; });
+
+	if (i == allBuffers.end())
+		return;
+
+	if (buffer.ptr != nullptr)
+		vkUnmapMemory(vkDev.device, buffer.memory);
+	vkDestroyBuffer(vkDev.device, buffer.buffer, nullptr);
+	vkFreeMemory(vkDev.device, buffer.memory, nullptr);
+
+	allBuffers.erase(i);
+}
+
+void VulkanResources::destroyFramebuffer(VkFramebuffer framebuffer)
+{
+	auto i = std::find(allFramebuffers.begin(), allFramebuffers.end(), framebuffer);
+
+	if (i == allFramebuffers.end())
+		return;
+
+	vkDestroyFramebuffer(vkDev.device, framebuffer, nullptr);
+
+	allFramebuffers.erase(i);
+}
+
 RenderPass VulkanResources::addFullScreenPass(bool useDepth, const RenderPassCreateInfo& ci)
 {
 	RenderPass result(vkDev, useDepth, ci);
@@ -778,6 +1422,29 @@ VkPipelineLayout VulkanResources::addPipelineLayout(VkDescriptorSetLayout dsLayo
 	return pipelineLayout;
 }
 
+VkPipelineLayout VulkanResources::addPipelineLayout(VkDescriptorSetLayout dsLayout, const std::vector<VkPushConstantRange>& pushConstants)
+{
+	const VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.setLayoutCount = 1,
+		.pSetLayouts = &dsLayout,
+		.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size()),
+		.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data()
+	};
+
+	VkPipelineLayout pipelineLayout;
+	if (vkCreatePipelineLayout(vkDev.device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	{
+		printf("Cannot create pipeline layout\n");
+		exit(EXIT_FAILURE);
+	}
+
+	allPipelineLayouts.push_back(pipelineLayout);
+	return pipelineLayout;
+}
+
 VulkanTexture VulkanResources::createFontTexture(const char* fontFile)
 {
 	ImGuiIO& io = ImGui::GetIO();
@@ -14,7 +14,7 @@ VulkanShaderProcessor::VulkanShaderProcessor(VulkanRenderContext& ctx,
 	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
 
 	descriptorSets_.resize(1);
-	descriptorSets_[0] = ctx.resources.addDescriptorSet(ctx.resources.addDescriptorPool(dsInfo), descriptorSetLayout_);
+	descriptorSets_[0] = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
 	ctx.resources.updateDescriptorSet(descriptorSets_[0], dsInfo);
 
 	initPipeline(shaders, initRenderPass(pInfo, outputs, screenRenderPass, ctx.screenRenderPass_NoDepth));
@@ -27,3 +27,73 @@ void VulkanShaderProcessor::fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t
 	vkCmdDraw(cmdBuffer, static_cast<uint32_t>((indexBufferSize) / sizeof(uint32_t)), 1, 0, 0);
 	vkCmdEndRenderPass(cmdBuffer);
 }
+
+void VulkanShaderProcessor::updateAttachments(const DescriptorSetInfo& dsInfo, const std::vector<VulkanTexture>& outputs)
+{
+	ctx_.resources.updateDescriptorSet(descriptorSets_[0], dsInfo);
+
+	updateOutputs(outputs);
+	invalidateCommands();
+}
+
+ComputeProcessor::ComputeProcessor(VulkanRenderContext& ctx,
+	const DescriptorSetInfo& dsInfo,
+	const char* shaderFile,
+	uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ,
+	const SpecializationInfo& specialization,
+	const std::vector<uint8_t>& pushConstants,
+	const std::vector<std::string>& defines)
+	: Renderer(ctx)
+	, groups_ { groupsX, groupsY, groupsZ }
+	, pushConstants_(pushConstants)
+{
+	descriptorSetLayout_ = ctx.resources.addDescriptorSetLayout(dsInfo);
+
+	descriptorSets_.resize(1);
+	descriptorSets_[0] = ctx.resources.allocateDescriptorSet(descriptorSetLayout_);
+	ctx.resources.updateDescriptorSet(descriptorSets_[0], dsInfo);
+
+	std::vector<VkPushConstantRange> ranges;
+	if (!pushConstants_.empty())
+		ranges.push_back(VkPushConstantRange { .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = static_cast<uint32_t>(pushConstants_.size()) });
+
+	pipelineLayout_ = ctx.resources.addPipelineLayout(descriptorSetLayout_, ranges);
+	graphicsPipeline_ = ctx.resources.addComputePipeline(shaderFile, pipelineLayout_, specialization, defines);
+}
+
+void ComputeProcessor::fillCommandBuffer(VkCommandBuffer cmdBuffer, size_t currentImage, VkFramebuffer fb, VkRenderPass rp)
+{
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, getPipeline());
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSets_[0], 0, nullptr);
+
+	if (!pushConstants_.empty())
+		pushConstants(cmdBuffer, VK_SHADER_STAGE_COMPUTE_BIT, 0, static_cast<uint32_t>(pushConstants_.size()), pushConstants_.data());
+
+	vkCmdDispatch(cmdBuffer, groups_[0], groups_[1], groups_[2]);
+}
+
+void ComputeProcessor::updateAttachments(const DescriptorSetInfo& dsInfo, uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ)
+{
+	ctx_.resources.updateDescriptorSet(descriptorSets_[0], dsInfo);
+
+	groups_[0] = groupsX;
+	groups_[1] = groupsY;
+	groups_[2] = groupsZ;
+
+	invalidateCommands();
+}
+
+void ComputeProcessor::setPushConstants(const void* data, uint32_t size)
+{
+	if (size != pushConstants_.size())
+	{
+		printf("ComputeProcessor: push constant size mismatch (%u != %u)\n", size, (uint32_t)pushConstants_.size());
+		exit(EXIT_FAILURE);
+	}
+
+	if (!memcmp(pushConstants_.data(), data, size))
+		return;
+
+	memcpy(pushConstants_.data(), data, size);
+	invalidateCommands();
+}
@@ -8,18 +8,12 @@ VulkanCanvas::VulkanCanvas(VulkanRenderDevice& vkDev, VulkanImage depth)
 
 	storageBuffer_.resize(imgCount);
 	storageBufferMemory_.resize(imgCount);
+	storageBufferPtr_.resize(imgCount);
+	storageBufferSize_.resize(imgCount);
 
+	// Descriptor sets do not exist yet, createDescriptorSet() writes them
 	for(size_t i = 0 ; i < imgCount ; i++)
-	{
-		if (!createBuffer(vkDev.device, vkDev.physicalDevice, kMaxLinesDataSize,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			storageBuffer_[i], storageBufferMemory_[i]))
-		{
-			printf("VaulkanCanvas: createBuffer() failed\n");
-			exit(EXIT_FAILURE);
-		}
-	}
+		createStorageBuffer(vkDev, i, kInitialLinesDataSize);
 
 	if (!createColorAndDepthRenderPass(vkDev, (depth.image != VK_NULL_HANDLE), &renderPass_, RenderPassCreateInfo()) ||
 		!createUniformBuffers(vkDev, sizeof(UniformBuffer)) ||
@@ -36,11 +30,38 @@ VulkanCanvas::VulkanCanvas(VulkanRenderDevice& vkDev, VulkanImage depth)
 
 VulkanCanvas::~VulkanCanvas()
 {
-	for (size_t i = 0; i < swapchainFramebuffers_.size(); i++)
+	for (size_t i = 0; i < storageBuffer_.size(); i++)
+		destroyStorageBuffer(i);
+}
+
+void VulkanCanvas::createStorageBuffer(VulkanRenderDevice& vkDev, size_t image, VkDeviceSize size)
+{
+	if (!createBuffer(vkDev.device, vkDev.physicalDevice, size,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		storageBuffer_[image], storageBufferMemory_[image]))
 	{
-		vkDestroyBuffer(device_, storageBuffer_[i], nullptr);
-		vkFreeMemory(device_, storageBufferMemory_[i], nullptr);
+		printf("VaulkanCanvas: createBuffer() failed\n");
+		exit(EXIT_FAILURE);
 	}
+
+	VK_CHECK(vkMapMemory(vkDev.device, storageBufferMemory_[image], 0, VK_WHOLE_SIZE, 0, &storageBufferPtr_[image]));
+	storageBufferSize_[image] = size;
+}
+
+void VulkanCanvas::destroyStorageBuffer(size_t image)
+{
+	vkUnmapMemory(device_, storageBufferMemory_[image]);
+	vkDestroyBuffer(device_, storageBuffer_[image], nullptr);
+	vkFreeMemory(device_, storageBufferMemory_[image], nullptr);
+}
+
+void VulkanCanvas::updateStorageDescriptor(size_t image)
+{
+	const VkDescriptorBufferInfo bufferInfo = { storageBuffer_[image], 0, storageBufferSize_[image] };
+	const VkWriteDescriptorSet write = bufferWriteDescriptorSet(descriptorSets_[image], &bufferInfo, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+	vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
 }
 
 void VulkanCanvas::updateBuffer(VulkanRenderDevice& vkDev, size_t currentImage)
@@ -50,7 +71,22 @@ void VulkanCanvas::updateBuffer(VulkanRenderDevice& vkDev, size_t currentImage)
 
 	const VkDeviceSize bufferSize = lines_.size() * sizeof(VertexData);
 
-	uploadBufferData(vkDev, storageBufferMemory_[currentImage], 0, lines_.data(), bufferSize);
+	if (bufferSize > storageBufferSize_[currentImage])
+	{
+		VkDeviceSize newSize = storageBufferSize_[currentImage];
+		while (newSize < bufferSize)
+			newSize *= 2;
+
+		// Growing is rare, so simply make sure the old buffer and descriptor set are no longer in use
+		VK_CHECK(vkDeviceWaitIdle(vkDev.device));
+
+		destroyStorageBuffer(currentImage);
+		createStorageBuffer(vkDev, currentImage, newSize);
+		updateStorageDescriptor(currentImage);
+	}
+
+	// Persistently mapped: only the used range is written, without map/unmap calls
+	memcpy(storageBufferPtr_[currentImage], lines_.data(), bufferSize);
 }
 
 bool VulkanCanvas::createDescriptorSet(VulkanRenderDevice& vkDev)
@@ -89,7 +125,7 @@ bool VulkanCanvas::createDescriptorSet(VulkanRenderDevice& vkDev)
 		VkDescriptorSet ds = descriptorSets_[i];
 
 		const VkDescriptorBufferInfo bufferInfo  = { uniformBuffers_[i], 0, sizeof(UniformBuffer) };
-		const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[i], 0, kMaxLinesDataSize };
+		const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[i], 0, storageBufferSize_[i] };
 
 		const std::array<VkWriteDescriptorSet, 2> descriptorWrites = {
 			bufferWriteDescriptorSet(ds, &bufferInfo,	0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER),
@@ -1,24 +1,55 @@
 #include <jc3DTestSharedLibs/vkRenderers/VulkanComputeBase.h>
 
-ComputeBase::ComputeBase(VulkanRenderDevice& vkDev, const char* shaderName, uint32_t inputSize, uint32_t outputSize):
-	vkDev(vkDev)
+ComputeBase::ComputeBase(VulkanRenderDevice& vkDev, const char* shaderName, uint32_t inputSize, uint32_t outputSize, bool doubleBuffered):
+	vkDev(vkDev),
+	numSlots(doubleBuffered ? 2 : 1)
 {
-	createSharedBuffer(vkDev, inputSize,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		inBuffer, inBufferMemory);
+	inBuffer.resize(numSlots);
+	outBuffer.resize(numSlots);
+	inBufferMemory.resize(numSlots);
+	outBufferMemory.resize(numSlots);
+
+	for (uint32_t i = 0; i < numSlots; i++)
+	{
+		createSharedBuffer(vkDev, inputSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			inBuffer[i], inBufferMemory[i]);
+
+		createSharedBuffer(vkDev, outputSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			outBuffer[i], outBufferMemory[i]);
+	}
+
+	commandBuffers.resize(numSlots);
+	fences.resize(numSlots);
+
+	const VkCommandBufferAllocateInfo ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.commandPool = vkDev.computeCommandPool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = numSlots
+	};
+
+	VK_CHECK(vkAllocateCommandBuffers(vkDev.device, &ai, commandBuffers.data()));
+
+	const VkFenceCreateInfo fenceCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT
+	};
 
-	createSharedBuffer(vkDev, outputSize,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		outBuffer, outBufferMemory);
+	for (auto& f: fences)
+		VK_CHECK(vkCreateFence(vkDev.device, &fenceCreateInfo, nullptr, &f));
 
 	ShaderModule s;
 	createShaderModule(vkDev.device, &s, shaderName);
 
 	createComputeDescriptorSetLayout(vkDev.device, &dsLayout);
 	createPipelineLayout(vkDev.device, dsLayout, &pipelineLayout);
-	createComputePipeline(vkDev.device, s.shaderModule, pipelineLayout, &pipeline);
+	createComputePipeline(vkDev, s.shaderModule, pipelineLayout, &pipeline);
 	createComputeDescriptorSet(vkDev.device, dsLayout);
 
 	vkDestroyShaderModule(vkDev.device, s.shaderModule, nullptr);
@@ -26,11 +57,20 @@ ComputeBase::ComputeBase(VulkanRenderDevice& vkDev, const char* shaderName, uint
 
 ComputeBase::~ComputeBase()
 {
-	vkDestroyBuffer(vkDev.device, inBuffer, nullptr);
-	vkFreeMemory(vkDev.device, inBufferMemory, nullptr);
+	vkWaitForFences(vkDev.device, numSlots, fences.data(), VK_TRUE, UINT64_MAX);
 
-	vkDestroyBuffer(vkDev.device, outBuffer, nullptr);
-	vkFreeMemory(vkDev.device, outBufferMemory, nullptr);
+	for (uint32_t i = 0; i < numSlots; i++)
+	{
+		vkDestroyBuffer(vkDev.device, inBuffer[i], nullptr);
+		vkFreeMemory(vkDev.device, inBufferMemory[i], nullptr);
+
+		vkDestroyBuffer(vkDev.device, outBuffer[i], nullptr);
+		vkFreeMemory(vkDev.device, outBufferMemory[i], nullptr);
+
+		vkDestroyFence(vkDev.device, fences[i], nullptr);
+	}
+
+	vkFreeCommandBuffers(vkDev.device, vkDev.computeCommandPool, numSlots, commandBuffers.data());
 
 	vkDestroyPipelineLayout(vkDev.device, pipelineLayout, nullptr);
 	vkDestroyPipeline(vkDev.device, pipeline, nullptr);
@@ -39,36 +79,98 @@ ComputeBase::~ComputeBase()
 	vkDestroyDescriptorPool(vkDev.device, descriptorPool, nullptr);
 }
 
+bool ComputeBase::executeAsync(uint32_t xsize, uint32_t ysize, uint32_t zsize)
+{
+	const uint32_t slot = getWriteSlot();
+
+	// The command buffer and the buffers of this slot were used 'numSlots' dispatches ago
+	waitSlot(slot);
+	VK_CHECK(vkResetFences(vkDev.device, 1, &fences[slot]));
+
+	VkCommandBuffer commandBuffer = commandBuffers[slot];
+
+	const VkCommandBufferBeginInfo commandBufferBeginInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = nullptr
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[slot], 0, 0);
+
+	vkCmdDispatch(commandBuffer, xsize, ysize, zsize);
+
+	const VkMemoryBarrier readoutBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+	};
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &readoutBarrier, 0, nullptr, 0, nullptr);
+
+	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+	const VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &commandBuffer,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr
+	};
+
+	if (vkQueueSubmit(vkDev.computeQueue, 1, &submitInfo, fences[slot]) != VK_SUCCESS)
+		return false;
+
+	submitCount++;
+
+	return true;
+}
+
 bool ComputeBase::createComputeDescriptorSet(VkDevice device, VkDescriptorSetLayout descriptorSetLayout)
 {
 	// Descriptor pool
-	VkDescriptorPoolSize descriptorPoolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 };
+	VkDescriptorPoolSize descriptorPoolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * numSlots };
 
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
-		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, 0, 0, 1, 1, &descriptorPoolSize
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, 0, 0, numSlots, 1, &descriptorPoolSize
 	};
 
 	VK_CHECK(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, 0, &descriptorPool));
 
-	// Descriptor set
+	// Descriptor sets, one per slot
+	const std::vector<VkDescriptorSetLayout> layouts(numSlots, descriptorSetLayout);
+
 	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
 		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		0, descriptorPool, 1, &descriptorSetLayout
+		0, descriptorPool, numSlots, layouts.data()
 	};
 
-	VK_CHECK(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &descriptorSet));
+	descriptorSets.resize(numSlots);
 
-	// Finally, update descriptor set with concrete buffer pointers
-	VkDescriptorBufferInfo inBufferInfo = { inBuffer, 0, VK_WHOLE_SIZE };
+	VK_CHECK(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets.data()));
 
-	VkDescriptorBufferInfo outBufferInfo = { outBuffer, 0, VK_WHOLE_SIZE };
+	// Finally, update descriptor sets with concrete buffer pointers
+	for (uint32_t i = 0; i < numSlots; i++)
+	{
+		VkDescriptorBufferInfo inBufferInfo = { inBuffer[i], 0, VK_WHOLE_SIZE };
 
-	VkWriteDescriptorSet writeDescriptorSet[2] = {
-		{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, descriptorSet, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0,  &inBufferInfo, 0 },
-		{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, descriptorSet, 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &outBufferInfo, 0 }
-	};
+		VkDescriptorBufferInfo outBufferInfo = { outBuffer[i], 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet writeDescriptorSet[2] = {
+			{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, descriptorSets[i], 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0,  &inBufferInfo, 0 },
+			{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, 0, descriptorSets[i], 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &outBufferInfo, 0 }
+		};
 
-	vkUpdateDescriptorSets(device, 2, writeDescriptorSet, 0, 0);
+		vkUpdateDescriptorSets(device, 2, writeDescriptorSet, 0, 0);
+	}
 
 	return true;
 }
@@ -31,7 +31,7 @@ ComputedImage::ComputedImage(VulkanRenderDevice& vkDev, const char* shaderName,
 
 	ShaderModule s;
 	createShaderModule(vkDev.device, &s, shaderName);
-	if (createComputePipeline(vkDev.device, s.shaderModule, pipelineLayout, &pipeline) != VK_SUCCESS)
+	if (createComputePipeline(vkDev, s.shaderModule, pipelineLayout, &pipeline) != VK_SUCCESS)
 		exit(EXIT_FAILURE);
 
 	vkDestroyShaderModule(vkDev.device, s.shaderModule, nullptr);
@@ -104,17 +104,17 @@ bool ComputedImage::createDescriptorSet()
 		.pSetLayouts = &dsLayout
 	};
 
-	VK_CHECK(vkAllocateDescriptorSets(vkDev.device, &allocInfo, &descriptorSet));
+	VK_CHECK(vkAllocateDescriptorSets(vkDev.device, &allocInfo, &descriptorSets[0]));
 
-	const VkDescriptorBufferInfo bufferInfo  = { uniformBuffer.buffer, 0, uniformBuffer.size };
+	const VkDescriptorBufferInfo bufferInfo  = { uniformBuffers[0].buffer, 0, uniformBuffers[0].size };
 	const VkDescriptorImageInfo  imageInfo   = { computedImageSampler, computed.imageView, VK_IMAGE_LAYOUT_GENERAL/*VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL*/ };
 
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 		VkWriteDescriptorSet { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .pNext = nullptr,
-			.dstSet = descriptorSet, .dstBinding = 0, .dstArrayElement = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.dstSet = descriptorSets[0], .dstBinding = 0, .dstArrayElement = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
 			.pImageInfo = &imageInfo, .pBufferInfo = nullptr, .pTexelBufferView = nullptr
 		},
-		bufferWriteDescriptorSet(descriptorSet, &bufferInfo, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		bufferWriteDescriptorSet(descriptorSets[0], &bufferInfo, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
 	};
 
 	vkUpdateDescriptorSets(vkDev.device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
@@ -1,9 +1,24 @@
 #include <jc3DTestSharedLibs/vkRenderers/VulkanComputedItem.h>
 
-ComputedItem::ComputedItem(VulkanRenderDevice& vkDev, uint32_t uniformBufferSize)
+ComputedItem::ComputedItem(VulkanRenderDevice& vkDev, uint32_t uniformBufferSize, uint32_t numSlots)
 	: vkDev(vkDev)
+	, numSlots(numSlots > 0 ? numSlots : 1)
 {
-	uniformBuffer.size = uniformBufferSize;
+	commandBuffers.resize(this->numSlots);
+	uniformBuffers.resize(this->numSlots);
+	fences.resize(this->numSlots);
+	descriptorSets.resize(this->numSlots);
+
+	// Separate command buffers: the one of the previous slot may still be executing while the next dispatch is recorded
+	const VkCommandBufferAllocateInfo ai = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.commandPool = vkDev.computeCommandPool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = this->numSlots
+	};
+
+	VK_CHECK(vkAllocateCommandBuffers(vkDev.device, &ai, commandBuffers.data()));
 
 	VkFenceCreateInfo fenceCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
@@ -11,19 +26,53 @@ ComputedItem::ComputedItem(VulkanRenderDevice& vkDev, uint32_t uniformBufferSize
 		.flags = VK_FENCE_CREATE_SIGNALED_BIT
 	};
 
-	if (vkCreateFence(vkDev.device, &fenceCreateInfo, nullptr, &fence) != VK_SUCCESS)
-		exit(EXIT_FAILURE);
+	for (auto& f: fences)
+		if (vkCreateFence(vkDev.device, &fenceCreateInfo, nullptr, &f) != VK_SUCCESS)
+			exit(EXIT_FAILURE);
+
+	if (vkDev.timelineSemaphores)
+	{
+		const VkSemaphoreTypeCreateInfoKHR typeInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+			.pNext = nullptr,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+			.initialValue = 0
+		};
+
+		const VkSemaphoreCreateInfo semaphoreInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &typeInfo,
+			.flags = 0
+		};
+
+		VK_CHECK(vkCreateSemaphore(vkDev.device, &semaphoreInfo, nullptr, &timeline));
+	}
 
-	if (!createUniformBuffer(vkDev, uniformBuffer.buffer, uniformBuffer.memory, uniformBuffer.size))
-		exit(EXIT_FAILURE);
+	for (auto& b: uniformBuffers)
+	{
+		b.size = uniformBufferSize;
+		if (!createUniformBuffer(vkDev, b.buffer, b.memory, b.size))
+			exit(EXIT_FAILURE);
+	}
 }
 
 ComputedItem::~ComputedItem()
 {
-	vkDestroyBuffer(vkDev.device, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(vkDev.device, uniformBuffer.memory, nullptr);
+	vkWaitForFences(vkDev.device, numSlots, fences.data(), VK_TRUE, UINT64_MAX);
+
+	for (auto& b: uniformBuffers)
+	{
+		vkDestroyBuffer(vkDev.device, b.buffer, nullptr);
+		vkFreeMemory(vkDev.device, b.memory, nullptr);
+	}
+
+	for (auto f: fences)
+		vkDestroyFence(vkDev.device, f, nullptr);
+
+	if (timeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(vkDev.device, timeline, nullptr);
 
-	vkDestroyFence(vkDev.device, fence, nullptr);
+	vkFreeCommandBuffers(vkDev.device, vkDev.computeCommandPool, numSlots, commandBuffers.data());
 
 	vkDestroyDescriptorPool(vkDev.device, descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(vkDev.device, dsLayout, nullptr);
@@ -33,7 +82,12 @@ ComputedItem::~ComputedItem()
 
 void ComputedItem::fillComputeCommandBuffer(void* pushConstant, uint32_t pushConstantSize, uint32_t xsize, uint32_t ysize, uint32_t zsize)
 {
-	VkCommandBuffer commandBuffer = vkDev.computeCommandBuffer;
+	const uint32_t slot = getWriteSlot();
+
+	// The command buffer of this slot may still be pending from 'numSlots' dispatches ago
+	waitSlot(slot);
+
+	VkCommandBuffer commandBuffer = commandBuffers[slot];
 
 	const VkCommandBufferBeginInfo beginInfo = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -45,7 +99,7 @@ void ComputedItem::fillComputeCommandBuffer(void* pushConstant, uint32_t pushCon
 	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, 0);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[slot], 0, 0);
 
 	if (pushConstant && pushConstantSize > 0)
 	{
@@ -56,28 +110,80 @@ void ComputedItem::fillComputeCommandBuffer(void* pushConstant, uint32_t pushCon
 	vkEndCommandBuffer(commandBuffer);
 }
 
+void ComputedItem::uploadUniformBuffer(uint32_t size, void* data)
+{
+	const uint32_t slot = getWriteSlot();
+
+	// Still read by the dispatch submitted 'numSlots' times ago
+	waitSlot(slot);
+
+	uploadBufferData(vkDev, uniformBuffers[slot].memory, 0, data, size);
+}
+
 bool ComputedItem::submit()
 {
+	const uint32_t slot = getWriteSlot();
+
 	// Use a fence to ensure that compute command buffer has finished executing before using it again
-	waitFence();
+	waitSlot(slot);
+	vkResetFences(vkDev.device, 1, &fences[slot]);
+
+	const uint64_t signalValue = submitCount + 1;
+
+	const VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+		.pNext = nullptr,
+		.waitSemaphoreValueCount = 0,
+		.pWaitSemaphoreValues = nullptr,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &signalValue
+	};
 
 	const VkSubmitInfo submitInfo = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = nullptr,
+		.pNext = (timeline != VK_NULL_HANDLE) ? &timelineInfo : nullptr,
 		.waitSemaphoreCount = 0,
 		.pWaitSemaphores = nullptr,
 		.pWaitDstStageMask = nullptr,
 		.commandBufferCount = 1,
-		.pCommandBuffers = &vkDev.computeCommandBuffer,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = nullptr
+		.pCommandBuffers = &commandBuffers[slot],
+		.signalSemaphoreCount = (timeline != VK_NULL_HANDLE) ? 1u : 0u,
+		.pSignalSemaphores = (timeline != VK_NULL_HANDLE) ? &timeline : nullptr
 	};
 
-	return (vkQueueSubmit(vkDev.computeQueue, 1, &submitInfo, fence) == VK_SUCCESS);
+	if (vkQueueSubmit(vkDev.computeQueue, 1, &submitInfo, fences[slot]) != VK_SUCCESS)
+		return false;
+
+	submitCount++;
+
+	return true;
 }
 
 void ComputedItem::waitFence()
 {
-	vkWaitForFences(vkDev.device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkResetFences(vkDev.device, 1, &fence);
+	if (submitCount > 0)
+		waitSlot((uint32_t)((submitCount - 1) % numSlots));
+}
+
+void ComputedItem::waitInFrame(VkPipelineStageFlags stage)
+{
+	if (submitCount == 0)
+		return;
+
+	const uint64_t dispatch = getReadDispatch();
+
+	if (timeline == VK_NULL_HANDLE)
+	{
+		waitSlot((uint32_t)(dispatch % numSlots));
+		return;
+	}
+
+	vkDev.frameWaitSemaphores.push_back(timeline);
+	vkDev.frameWaitValues.push_back(dispatch + 1);
+	vkDev.frameWaitStages.push_back(stage);
+}
+
+void ComputedItem::waitSlot(uint32_t slot)
+{
+	vkWaitForFences(vkDev.device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
 }
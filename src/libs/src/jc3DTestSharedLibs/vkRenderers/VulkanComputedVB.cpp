@@ -5,8 +5,9 @@ ComputedVertexBuffer::ComputedVertexBuffer(VulkanRenderDevice& vkDev, const char
 	uint32_t uniformBufferSize,
 	uint32_t vertexSize,
 	uint32_t vertexCount,
-	bool supportDownload)
-	: ComputedItem(vkDev, uniformBufferSize)
+	bool supportDownload,
+	bool doubleBuffered)
+	: ComputedItem(vkDev, uniformBufferSize, doubleBuffered ? 2 : 1)
 	, computedVertexCount(vertexCount)
 	, indexBufferSize(indexBufferSize)
 	, vertexSize(vertexSize)
@@ -20,34 +21,53 @@ ComputedVertexBuffer::ComputedVertexBuffer(VulkanRenderDevice& vkDev, const char
 
 	ShaderModule s;
 	createShaderModule(vkDev.device, &s, shaderName);
-	if (createComputePipeline(vkDev.device, s.shaderModule, pipelineLayout, &pipeline) != VK_SUCCESS)
+	if (createComputePipeline(vkDev, s.shaderModule, pipelineLayout, &pipeline) != VK_SUCCESS)
 		exit(EXIT_FAILURE);
 
 	vkDestroyShaderModule(vkDev.device, s.shaderModule, nullptr);
 }
 
+ComputedVertexBuffer::~ComputedVertexBuffer()
+{
+	vkWaitForFences(vkDev.device, numSlots, fences.data(), VK_TRUE, UINT64_MAX);
+
+	for (uint32_t i = 0; i < numSlots; i++)
+	{
+		vkDestroyBuffer(vkDev.device, computedBuffers[i], nullptr);
+		vkFreeMemory(vkDev.device, computedMemory[i], nullptr);
+	}
+}
+
 bool ComputedVertexBuffer::createComputedBuffer()
 {
-	return createBuffer(vkDev.device, vkDev.physicalDevice,
-		computedVertexCount * vertexSize + indexBufferSize,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | (canDownloadVertices ? VK_BUFFER_USAGE_TRANSFER_SRC_BIT : 0) | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		!canDownloadVertices? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
-		computedBuffer, computedMemory);
+	computedBuffers.resize(numSlots);
+	computedMemory.resize(numSlots);
+
+	// Concurrent sharing: the compute queue writes a slot which the graphics queue reads a frame later, no ownership transfers
+	for (uint32_t i = 0; i < numSlots; i++)
+		if (!createSharedBuffer(vkDev,
+			computedVertexCount * vertexSize + indexBufferSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | (canDownloadVertices ? VK_BUFFER_USAGE_TRANSFER_SRC_BIT : 0) | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			!canDownloadVertices? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+			computedBuffers[i], computedMemory[i]))
+			return false;
+
+	return true;
 }
 
 bool ComputedVertexBuffer::createComputedSetLayout()
 {
 	std::vector<VkDescriptorPoolSize> poolSizes =
 	{
-		{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1 },
-		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1 }
+		{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = numSlots },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = numSlots }
 	};
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.maxSets = 1,
+		.maxSets = numSlots,
 		.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
 		.pPoolSizes    = poolSizes.data()
 	};
@@ -74,25 +94,30 @@ bool ComputedVertexBuffer::createComputedSetLayout()
 
 bool ComputedVertexBuffer::createDescriptorSet()
 {
+	const std::vector<VkDescriptorSetLayout> layouts(numSlots, dsLayout);
+
 	VkDescriptorSetAllocateInfo allocInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 		.pNext = nullptr,
 		.descriptorPool = descriptorPool,
-		.descriptorSetCount = 1,
-		.pSetLayouts = &dsLayout
+		.descriptorSetCount = numSlots,
+		.pSetLayouts = layouts.data()
 	};
 
-	VK_CHECK(vkAllocateDescriptorSets(vkDev.device, &allocInfo, &descriptorSet));
+	VK_CHECK(vkAllocateDescriptorSets(vkDev.device, &allocInfo, descriptorSets.data()));
 
-	const VkDescriptorBufferInfo bufferInfo  = { computedBuffer,        0, computedVertexCount * vertexSize };
-	const VkDescriptorBufferInfo bufferInfo2 = { uniformBuffer.buffer,  0, uniformBuffer.size };
+	for (uint32_t i = 0; i < numSlots; i++)
+	{
+		const VkDescriptorBufferInfo bufferInfo  = { computedBuffers[i],    0, computedVertexCount * vertexSize };
+		const VkDescriptorBufferInfo bufferInfo2 = { uniformBuffers[i].buffer, 0, uniformBuffers[i].size };
 
-	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-		bufferWriteDescriptorSet(descriptorSet, &bufferInfo,  0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
-		bufferWriteDescriptorSet(descriptorSet, &bufferInfo2, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
-	};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			bufferWriteDescriptorSet(descriptorSets[i], &bufferInfo,  0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+			bufferWriteDescriptorSet(descriptorSets[i], &bufferInfo2, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		};
 
-	vkUpdateDescriptorSets(vkDev.device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		vkUpdateDescriptorSets(vkDev.device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
 
 	return true;
 }
@@ -102,10 +127,18 @@ void ComputedVertexBuffer::downloadVertices(void* vertexData)
 	if (!canDownloadVertices || !vertexData)
 		return;
 
-	downloadBufferData(vkDev, computedMemory, 0, vertexData, computedVertexCount * vertexSize);
+	if (submitCount == 0)
+		return;
+
+	waitFence();
+
+	const uint32_t latestSlot = (uint32_t)((submitCount - 1) % numSlots);
+
+	downloadBufferData(vkDev, computedMemory[latestSlot], 0, vertexData, computedVertexCount * vertexSize);
 }
 
 void ComputedVertexBuffer::uploadIndexData(uint32_t* indices)
 {
-	uploadBufferData(vkDev, computedMemory, computedVertexCount * vertexSize, indices, indexBufferSize);
+	for (uint32_t i = 0; i < numSlots; i++)
+		uploadBufferData(vkDev, computedMemory[i], computedVertexCount * vertexSize, indices, indexBufferSize);
 }
@@ -1,5 +1,7 @@
 #include <imgui.h>
 
+#include <algorithm>
+
 #include <jc3DTestSharedLibs/vkRenderers/VulkanImGui.h>
 #include <jc3DTestSharedLibs/EasyProfilerWrapper.h>
 
@@ -10,8 +12,9 @@ using glm::vec2;
 using glm::vec3;
 using glm::vec4;
 
-constexpr uint32_t ImGuiVtxBufferSize = 512 * 1024 * sizeof(ImDrawVert);
-constexpr uint32_t ImGuiIdxBufferSize = 512 * 1024 * sizeof(uint32_t);
+// Initial sizes only, the buffers grow when a frame does not fit
+constexpr VkDeviceSize ImGuiInitialVtxBufferSize = 16 * 1024 * sizeof(ImDrawVert);
+constexpr VkDeviceSize ImGuiInitialIdxBufferSize = 32 * 1024 * sizeof(uint32_t);
 
 bool ImGuiRenderer::createDescriptorSet(VulkanRenderDevice& vkDev)
 {
@@ -50,8 +53,8 @@ bool ImGuiRenderer::createDescriptorSet(VulkanRenderDevice& vkDev)
 	{
 		VkDescriptorSet ds = descriptorSets_[i];
 		const VkDescriptorBufferInfo bufferInfo  = { uniformBuffers_[i], 0, sizeof(mat4) };
-		const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[i], 0, ImGuiVtxBufferSize };
-		const VkDescriptorBufferInfo bufferInfo3 = { storageBuffer_[i], ImGuiVtxBufferSize, ImGuiIdxBufferSize };
+		const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[i], 0, vtxBufferSize_[i] };
+		const VkDescriptorBufferInfo bufferInfo3 = { storageBuffer_[i], vtxBufferSize_[i], idxBufferSize_[i] };
 		const VkDescriptorImageInfo  imageInfo   = { fontSampler_, font_.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
 
 		const std::array<VkWriteDescriptorSet, 4> descriptorWrites = {
@@ -117,8 +120,8 @@ bool ImGuiRenderer::createMultiDescriptorSet(VulkanRenderDevice& vkDev)
 	{
 		VkDescriptorSet ds = descriptorSets_[i];
 		const VkDescriptorBufferInfo bufferInfo  = { uniformBuffers_[i], 0, sizeof(mat4) };
-		const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[i], 0, ImGuiVtxBufferSize };
-		const VkDescriptorBufferInfo bufferInfo3 = { storageBuffer_[i], ImGuiVtxBufferSize, ImGuiIdxBufferSize };
+		const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[i], 0, vtxBufferSize_[i] };
+		const VkDescriptorBufferInfo bufferInfo3 = { storageBuffer_[i], vtxBufferSize_[i], idxBufferSize_[i] };
 
 		const std::array<VkWriteDescriptorSet, 4> descriptorWrites = {
 			bufferWriteDescriptorSet(ds, &bufferInfo,  0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER),
@@ -222,28 +225,83 @@ void ImGuiRenderer::updateBuffers(VulkanRenderDevice& vkDev, uint32_t currentIma
 
 	uploadBufferData(vkDev, uniformBuffersMemory_[currentImage], 0, glm::value_ptr(inMtx), sizeof(mat4));
 
-	void* data = nullptr;
-	vkMapMemory(vkDev.device, storageBufferMemory_[currentImage], 0, bufferSize_, 0, &data);
+	const VkDeviceSize vtxSize = drawData->TotalVtxCount * sizeof(ImDrawVert);
+	const VkDeviceSize idxSize = drawData->TotalIdxCount * sizeof(uint32_t);
 
-	ImDrawVert* vtx = (ImDrawVert*)data;
-	for (int n = 0; n < drawData->CmdListsCount; n++)
+	if (vtxSize > vtxBufferSize_[currentImage] || idxSize > idxBufferSize_[currentImage])
 	{
-		const ImDrawList* cmdList = drawData->CmdLists[n];
-		memcpy(vtx, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
-		vtx += cmdList->VtxBuffer.Size;
+		VkDeviceSize newVtxSize = vtxBufferSize_[currentImage];
+		while (newVtxSize < vtxSize)
+			newVtxSize *= 2;
+
+		VkDeviceSize newIdxSize = idxBufferSize_[currentImage];
+		while (newIdxSize < idxSize)
+			newIdxSize *= 2;
+
+		// Growing is rare, so simply make sure the old buffer and descriptor set are no longer in use
+		VK_CHECK(vkDeviceWaitIdle(vkDev.device));
+
+		destroyStorageBuffer(currentImage);
+		createStorageBuffer(vkDev, currentImage, newVtxSize, newIdxSize);
+		updateStorageDescriptors(currentImage);
 	}
 
-	uint32_t* idx = (uint32_t*)((uint8_t*)data + ImGuiVtxBufferSize);
+	// Persistently mapped: a single pass over the draw lists writes only the used ranges, 16-bit indices are widened for imgui.vert
+	ImDrawVert* vtx = (ImDrawVert*)storageBufferPtr_[currentImage];
+	uint32_t* idx = (uint32_t*)((uint8_t*)storageBufferPtr_[currentImage] + vtxBufferSize_[currentImage]);
+
 	for (int n = 0; n < drawData->CmdListsCount; n++)
 	{
 		const ImDrawList* cmdList = drawData->CmdLists[n];
-		const uint16_t* src = (const uint16_t*)cmdList->IdxBuffer.Data;
 
+		memcpy(vtx, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
+		vtx += cmdList->VtxBuffer.Size;
+
+		const uint16_t* src = (const uint16_t*)cmdList->IdxBuffer.Data;
 		for (int j = 0; j < cmdList->IdxBuffer.Size; j++)
 			*idx++ = (uint32_t)*src++;
 	}
 
-	vkUnmapMemory(vkDev.device, storageBufferMemory_[currentImage]);
+	bytesPerFrame_ = vtxSize + idxSize;
+}
+
+void ImGuiRenderer::createStorageBuffer(VulkanRenderDevice& vkDev, size_t image, VkDeviceSize vtxSize, VkDeviceSize idxSize)
+{
+	// The index data starts right after the vertex data, at a valid storage buffer offset
+	vtxSize = (vtxSize + storageAlignment_ - 1) / storageAlignment_ * storageAlignment_;
+
+	if (!createBuffer(vkDev.device, vkDev.physicalDevice, vtxSize + idxSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		storageBuffer_[image], storageBufferMemory_[image]))
+	{
+		printf("ImGuiRenderer: createBuffer() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	VK_CHECK(vkMapMemory(vkDev.device, storageBufferMemory_[image], 0, VK_WHOLE_SIZE, 0, &storageBufferPtr_[image]));
+	vtxBufferSize_[image] = vtxSize;
+	idxBufferSize_[image] = idxSize;
+}
+
+void ImGuiRenderer::destroyStorageBuffer(size_t image)
+{
+	vkUnmapMemory(device_, storageBufferMemory_[image]);
+	vkDestroyBuffer(device_, storageBuffer_[image], nullptr);
+	vkFreeMemory(device_, storageBufferMemory_[image], nullptr);
+}
+
+void ImGuiRenderer::updateStorageDescriptors(size_t image)
+{
+	const VkDescriptorBufferInfo bufferInfo2 = { storageBuffer_[image], 0, vtxBufferSize_[image] };
+	const VkDescriptorBufferInfo bufferInfo3 = { storageBuffer_[image], vtxBufferSize_[image], idxBufferSize_[image] };
+
+	const std::array<VkWriteDescriptorSet, 2> descriptorWrites = {
+		bufferWriteDescriptorSet(descriptorSets_[image], &bufferInfo2, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+		bufferWriteDescriptorSet(descriptorSets_[image], &bufferInfo3, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+	};
+
+	vkUpdateDescriptorSets(device_, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
 bool createFontTexture(ImGuiIO& io, const char* fontFile, VulkanRenderDevice& vkDev, VkImage& textureImage, VkDeviceMemory& textureImageMemory)
@@ -290,20 +348,15 @@ ImGuiRenderer::ImGuiRenderer(VulkanRenderDevice& vkDev)
 
 	storageBuffer_.resize(imgCount);
 	storageBufferMemory_.resize(imgCount);
+	storageBufferPtr_.resize(imgCount);
+	vtxBufferSize_.resize(imgCount);
+	idxBufferSize_.resize(imgCount);
 
-	bufferSize_ = ImGuiVtxBufferSize + ImGuiIdxBufferSize;
+	storageAlignment_ = std::max<VkDeviceSize>(1, getVulkanBufferAlignment(vkDev));
 
+	// Descriptor sets do not exist yet, they are written below
 	for(size_t i = 0 ; i < imgCount ; i++)
-	{
-		if (!createBuffer(vkDev.device, vkDev.physicalDevice, bufferSize_,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			storageBuffer_[i], storageBufferMemory_[i]))
-		{
-			printf("ImGuiRenderer: createBuffer() failed\n");
-			exit(EXIT_FAILURE);
-		}
-	}
+		createStorageBuffer(vkDev, i, ImGuiInitialVtxBufferSize, ImGuiInitialIdxBufferSize);
 
 	// Pipeline creation
 	if (!createColorAndDepthRenderPass(vkDev, false, &renderPass_, RenderPassCreateInfo()) ||
@@ -337,20 +390,15 @@ ImGuiRenderer::ImGuiRenderer(VulkanRenderDevice& vkDev, const std::vector<Vulkan
 
 	storageBuffer_.resize(imgCount);
 	storageBufferMemory_.resize(imgCount);
+	storageBufferPtr_.resize(imgCount);
+	vtxBufferSize_.resize(imgCount);
+	idxBufferSize_.resize(imgCount);
 
-	bufferSize_ = ImGuiVtxBufferSize + ImGuiIdxBufferSize;
+	storageAlignment_ = std::max<VkDeviceSize>(1, getVulkanBufferAlignment(vkDev));
 
+	// Descriptor sets do not exist yet, they are written below
 	for(size_t i = 0 ; i < imgCount ; i++)
-	{
-		if (!createBuffer(vkDev.device, vkDev.physicalDevice, bufferSize_,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			storageBuffer_[i], storageBufferMemory_[i]))
-		{
-			printf("ImGuiRenderer: createBuffer() failed\n");
-			exit(EXIT_FAILURE);
-		}
-	}
+		createStorageBuffer(vkDev, i, ImGuiInitialVtxBufferSize, ImGuiInitialIdxBufferSize);
 
 	// Pipeline creation
 	if (!createColorAndDepthRenderPass(vkDev, false, &renderPass_, RenderPassCreateInfo()) ||
@@ -370,11 +418,8 @@ ImGuiRenderer::ImGuiRenderer(VulkanRenderDevice& vkDev, const std::vector<Vulkan
 
 ImGuiRenderer::~ImGuiRenderer()
 {
-	for (size_t i = 0; i < swapchainFramebuffers_.size(); i++)
-	{
-		vkDestroyBuffer(device_, storageBuffer_[i], nullptr);
-		vkFreeMemory(device_, storageBufferMemory_[i], nullptr);
-	}
+	for (size_t i = 0; i < storageBuffer_.size(); i++)
+		destroyStorageBuffer(i);
 
 	vkDestroySampler(device_, fontSampler_, nullptr);
 	destroyVulkanImage(device_, font_);
@@ -96,7 +96,33 @@ void PBRModelRenderer::fillCommandBuffer(VkCommandBuffer commandBuffer, size_t c
 {
 	beginRenderPass(commandBuffer, currentImage);
 
-	vkCmdDraw(commandBuffer, static_cast<uint32_t>(indexBufferSize_ / (sizeof(unsigned int))), 1, 0, 0);
+	const uint32_t numIndices = static_cast<uint32_t>(indexBufferSize_ / (sizeof(unsigned int)));
+
+	if (overdrawView_)
+	{
+		const VkClearAttachment clearAttachment = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.colorAttachment = 0,
+			.clearValue = { .color = { 0.0f, 0.0f, 0.0f, 1.0f } }
+		};
+
+		const VkClearRect clearRect = {
+			.rect = { .offset = { 0, 0 }, .extent = { .width = framebufferWidth_, .height = framebufferHeight_ } },
+			.baseArrayLayer = 0,
+			.layerCount = 1
+		};
+
+		vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, 1, &clearRect);
+	}
+
+	if (depthPrepass_)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, prepassPipeline_);
+		vkCmdDraw(commandBuffer, numIndices, 1, 0, 0);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
+	}
+
+	vkCmdDraw(commandBuffer, numIndices, 1, 0, 0);
 	vkCmdEndRenderPass(commandBuffer);
 }
 
@@ -133,7 +159,11 @@ PBRModelRenderer::PBRModelRenderer(VulkanRenderDevice& vkDev,
 	const char* texNormalFile,
 	const char* texEnvMapFile,
 	const char* texIrrMapFile,
-	VulkanImage depthTexture): RendererBase(vkDev, VulkanImage())
+	VulkanImage depthTexture,
+	bool depthPrepass,
+	bool overdrawView): RendererBase(vkDev, VulkanImage())
+	, depthPrepass_(depthPrepass)
+	, overdrawView_(overdrawView)
 {
 	depthTexture_ = depthTexture;
 
@@ -174,12 +204,24 @@ PBRModelRenderer::PBRModelRenderer(VulkanRenderDevice& vkDev,
 		!createDescriptorSet(vkDev, uniformBufferSize) ||
 		!createPipelineLayout(vkDev.device, descriptorSetLayout_, &pipelineLayout_) ||
 		!createGraphicsPipeline(vkDev, renderPass_, pipelineLayout_,
-			{ "data/shaders/chapter06/VK05_mesh.vert", "data/shaders/chapter06/VK05_mesh.frag" },
-			&graphicsPipeline_))
+			{ "data/shaders/chapter06/VK05_mesh.vert", overdrawView_ ? "data/shaders/chapter08/Overdraw.frag" : "data/shaders/chapter06/VK05_mesh.frag" },
+			&graphicsPipeline_, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, true, true, false, -1, -1, 0,
+			depthPrepass_ ? VK_COMPARE_OP_LESS_OR_EQUAL : VK_COMPARE_OP_LESS, !depthPrepass_, true, overdrawView_))
 	{
 		printf("PBRModelRenderer: failed to create pipeline\n");
 		exit(EXIT_FAILURE);
 	}
+
+	// The mesh vertex shader itself, so the prepass produces the same positions as the shading pass
+	if (depthPrepass_ &&
+		!createGraphicsPipeline(vkDev, renderPass_, pipelineLayout_,
+			{ "data/shaders/chapter06/VK05_mesh.vert" },
+			&prepassPipeline_, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, true, true, false, -1, -1, 0,
+			VK_COMPARE_OP_LESS, true, false))
+	{
+		printf("PBRModelRenderer: failed to create depth prepass pipeline\n");
+		exit(EXIT_FAILURE);
+	}
 }
 
 PBRModelRenderer::~PBRModelRenderer()
@@ -197,4 +239,6 @@ PBRModelRenderer::~PBRModelRenderer()
 	destroyVulkanTexture(device_,  envMapIrradiance_);
 
 	destroyVulkanTexture(device_,  brdfLUT_);
+
+	vkDestroyPipeline(device_, prepassPipeline_, nullptr);
 }